@@ -1,3 +1,8 @@
+newoption {
+    trigger = "no-ray-stats",
+    description = "Compile out the ray tracing counters"
+}
+
 workspace "Pathtracing"
     architecture "x86_64"
     configurations { "Debug", "Release" }
@@ -14,6 +19,9 @@ workspace "Pathtracing"
         symbols "On"
         optimize "On"
         
+    filter "options:no-ray-stats"
+        defines { "RT_RAY_STATS=0" }
+
     filter "system:windows"
         systemversion "latest"
 
@@ -136,6 +144,7 @@ project "PathtracingUtility"
     includedirs { 
         "vendor/glm",
         "vendor/spdlog/include",
+        "vendor/stb/include",
         "vendor/json",
         "src/Pathtracing"
     }
@@ -212,3 +221,32 @@ project "Sandbox"
         links { "GL", "X11", "pthread", "dl" }
 
 
+
+project "Benchmarks"
+    location(_ACTION)
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+
+    objdir "bin-int/%{cfg.buildcfg}/%{prj.name}"
+    targetdir "bin/%{cfg.buildcfg}/%{prj.name}"
+    debugdir "bin/%{cfg.buildcfg}/%{prj.name}"
+
+    includedirs { 
+        "vendor/glm",
+        "vendor/spdlog/include",
+        "vendor/json",
+        "src/Pathtracing",
+        "src/PathtracingUtility"
+    }
+
+    files { "src/Benchmarks/**.cpp", "src/Benchmarks/**.h"  }
+
+    links { "Pathtracing", "PathtracingUtility" }
+
+    postbuildcommands {
+        "{COPY} ../src/res ../bin/%{cfg.buildcfg}/%{prj.name}/res"
+    }
+
+    filter "system:linux"
+        links { "pthread" }
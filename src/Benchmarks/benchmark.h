@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cinttypes>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace rtbench
+{
+	/// <summary>
+	/// The result of a benchmark
+	/// </summary>
+	struct benchmark_result
+	{
+		std::string name;
+		uint64_t operations = 0;
+		double seconds = 0.0;
+
+		/// <summary>
+		/// Returns the average time of a single operation in nanoseconds
+		/// </summary>
+		double ns_per_operation() const { return seconds * 1e9 / operations; }
+
+		/// <summary>
+		/// Returns the throughput in millions of operations per second
+		/// </summary>
+		double mops_per_second() const { return operations / seconds * 1e-6; }
+	};
+
+	/// <summary>
+	/// The time taken to render a full frame
+	/// </summary>
+	struct frame_result
+	{
+		std::string name;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint64_t samples_per_pixel = 0;
+		double seconds = 0.0;
+
+		/// <summary>
+		/// Peak resident set size of the process when the frame was done
+		/// </summary>
+		size_t peak_rss_bytes = 0;
+
+		/// <summary>
+		/// Returns the throughput in millions of camera samples per second
+		/// </summary>
+		double msamples_per_second() const { return double(width) * height * samples_per_pixel / seconds * 1e-6; }
+	};
+
+	/// <summary>
+	/// The time taken by a render to get close enough to a reference
+	/// </summary>
+	struct convergence_result
+	{
+		std::string name;
+
+		/// <summary>
+		/// The error to reach, relative to the average of the reference
+		/// </summary>
+		double target_rmse = 0.0;
+
+		/// <summary>
+		/// The error, samples and time when the render stopped
+		/// </summary>
+		double rmse = 0.0;
+		uint64_t samples_per_pixel = 0;
+		double seconds = 0.0;
+
+		/// <summary>
+		/// Whether the target was reached before the sample limit
+		/// </summary>
+		bool converged = false;
+	};
+
+	/// <summary>
+	/// Prevents the compiler from optimizing away a computed value
+	/// </summary>
+	template<typename T>
+	void do_not_optimize(T value)
+	{
+#ifdef _MSC_VER
+		// No inline assembly: the value is stored to a sink the barrier keeps in place
+		static volatile T s_sink;
+		s_sink = value;
+		_ReadWriteBarrier();
+#else
+		// The value is an input of an assembly statement, it has to be computed
+		asm volatile("" : : "g"(value) : "memory");
+#endif
+	}
+
+	/// <summary>
+	/// Runs a benchmark. The function is called once to warm up, then measured over the given
+	/// number of runs
+	/// </summary>
+	/// <param name="name">The name of the benchmark</param>
+	/// <param name="operations">The number of operations performed by a single call of the function</param>
+	/// <param name="runs">Number of measured calls</param>
+	/// <param name="fn">The function to measure</param>
+	/// <returns>The result</returns>
+	template<typename Fn>
+	benchmark_result run_benchmark(std::string_view name, uint64_t operations, uint32_t runs, Fn&& fn)
+	{
+		using seconds = std::chrono::duration<double, std::ratio<1>>;
+
+		fn();
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < runs; ++i)
+			fn();
+
+		const auto elapsed = seconds(std::chrono::steady_clock::now() - start).count();
+
+		return { std::string(name), operations * runs, elapsed };
+	}
+
+	/// <summary>
+	/// Logs a benchmark result
+	/// </summary>
+	void report(const benchmark_result& result);
+	void report(const frame_result& result);
+	void report(const convergence_result& result);
+
+	/// <summary>
+	/// Micro benchmarks of the ray tracing building blocks
+	/// </summary>
+	void run_micro_benchmarks();
+
+	/// <summary>
+	/// Texture sampling benchmarks
+	/// </summary>
+	void run_texture_benchmarks();
+
+	/// <summary>
+	/// Primary ray tracing benchmarks, single rays against packets
+	/// </summary>
+	void run_ray_benchmarks();
+
+	/// <summary>
+	/// Full frame and time-to-error benchmarks of the integrators on the sample scenes
+	/// </summary>
+	/// <param name="threads">Rendering threads</param>
+	void run_frame_benchmarks(uint32_t threads);
+}
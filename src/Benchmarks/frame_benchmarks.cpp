@@ -0,0 +1,152 @@
+#include "benchmark.h"
+
+#include <cmath>
+#include <memory>
+
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include <pathtracer.h>
+#include <wavefront_pathtracer.h>
+#include <scene_loader.h>
+
+namespace rtbench
+{
+	// Full frames
+	static constexpr uint32_t s_frame_size = 64;
+	static constexpr uint64_t s_frame_samples = 16;
+
+	// Convergence, smaller to keep the reference affordable
+	static constexpr uint32_t s_convergence_size = 32;
+	static constexpr uint64_t s_reference_samples = 1024;
+	static constexpr uint64_t s_samples_per_iteration = 8;
+	static constexpr uint64_t s_max_convergence_samples = 256;
+
+	/// <summary>
+	/// Root mean square error relative to the average of the reference
+	/// </summary>
+	static double relative_rmse(const rt::image& image, const rt::image& reference)
+	{
+		double error = 0.0, sum = 0.0;
+
+		for (uint32_t y = 0; y < reference.get_height(); ++y)
+		{
+			for (uint32_t x = 0; x < reference.get_width(); ++x)
+			{
+				const auto ref = reference.get_pixel(x, y);
+				const auto diff = image.get_pixel(x, y) - ref;
+				error += double(diff.x) * diff.x + double(diff.y) * diff.y + double(diff.z) * diff.z;
+				sum += double(ref.x) + ref.y + ref.z;
+			}
+		}
+
+		const double count = 3.0 * reference.get_width() * reference.get_height();
+		return sum > 0.0 ? std::sqrt(error / count) / (sum / count) : 0.0;
+	}
+
+	/// <summary>
+	/// Renders a square image in a single iteration
+	/// </summary>
+	static rt::image render(rt::abstract_pathtracer& tracer, rt::scene& scene, uint32_t size, uint64_t samples, uint32_t threads)
+	{
+		rt::view_parameters view_params;
+		view_params.width = size;
+		view_params.height = size;
+
+		rt::trace_parameters trace_params;
+		trace_params.num_threads = threads;
+		trace_params.iterations = 1;
+		trace_params.samples_per_iteration = samples;
+		trace_params.deferred_start = true;
+
+		rt::image result;
+		auto process = tracer.run(view_params, trace_params, scene);
+		process->on_end.subscribe([&result](const rt::image& image) { result = image; });
+		process->start();
+		process->wait();
+
+		return result;
+	}
+
+	static void run_convergence_benchmark(const std::string& name, rt::scene& scene, double target_rmse, uint32_t threads)
+	{
+		rt::pathtracer tracer;
+
+		spdlog::info("{0}: rendering the reference ({1} spp)", name, s_reference_samples);
+		const auto reference = render(tracer, scene, s_convergence_size, s_reference_samples, threads);
+
+		// An empty reference would have no error, every render would converge right away
+		if (reference.get_width() != s_convergence_size || reference.get_height() != s_convergence_size)
+		{
+			spdlog::error("{0}: the reference wasn't rendered, skipping the convergence benchmark", name);
+			return;
+		}
+
+		rt::view_parameters view_params;
+		view_params.width = s_convergence_size;
+		view_params.height = s_convergence_size;
+
+		rt::trace_parameters trace_params;
+		trace_params.num_threads = threads;
+		trace_params.iterations = s_max_convergence_samples / s_samples_per_iteration;
+		trace_params.samples_per_iteration = s_samples_per_iteration;
+		trace_params.deferred_start = true;
+
+		convergence_result result = { "convergence/pathtracer/" + name, target_rmse };
+
+		auto process = tracer.run(view_params, trace_params, scene);
+		auto* self = process.get();
+
+		// Stops at the first iteration under the target
+		process->on_iteration_end.subscribe([&result, &reference, self](const rt::image& image, const uint64_t& iteration) {
+			result.seconds = self->get_elapsed_time();
+			result.samples_per_pixel = (iteration + 1) * s_samples_per_iteration;
+			result.rmse = relative_rmse(image, reference);
+
+			if (result.rmse <= result.target_rmse)
+			{
+				result.converged = true;
+				self->interrupt();
+			}
+		});
+
+		process->start();
+		process->wait();
+
+		report(result);
+	}
+
+	void run_frame_benchmarks(uint32_t threads)
+	{
+		using seconds = std::chrono::duration<double, std::ratio<1>>;
+
+		const auto tracers = {
+			std::make_tuple("pathtracer", std::shared_ptr<rt::abstract_pathtracer>(std::make_shared<rt::pathtracer>())),
+			std::make_tuple("wavefront", std::shared_ptr<rt::abstract_pathtracer>(std::make_shared<rt::wavefront_pathtracer>())),
+		};
+
+		// Targets are reachable within the sample limit, scenes lit by small emitters converge slowly
+		const auto scenes = {
+			std::make_tuple("room", 0.5),
+			std::make_tuple("mario", 0.5),
+			std::make_tuple("materials", 0.15),
+			std::make_tuple("furnace", 0.05),
+		};
+
+		for (const auto& [name, target_rmse] : scenes)
+		{
+			auto scene = rt::utility::load_scene(std::string("res/scenes/") + name + ".json");
+
+			for (const auto& [tracer_name, tracer] : tracers)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				render(*tracer, scene, s_frame_size, s_frame_samples, threads);
+				const auto elapsed = seconds(std::chrono::steady_clock::now() - start).count();
+
+				report(frame_result{ std::string("frame/") + tracer_name + "/" + name, s_frame_size, s_frame_size, s_frame_samples, elapsed, rt::get_peak_rss() });
+			}
+
+			run_convergence_benchmark(name, scene, target_rmse, threads);
+		}
+	}
+}
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <json.hpp>
+
+#include <memory_stats.h>
+#include <system_info.h>
+
+#include "benchmark.h"
+
+namespace rtbench
+{
+	static std::vector<benchmark_result> s_results;
+	static std::vector<frame_result> s_frames;
+	static std::vector<convergence_result> s_convergence;
+
+	void report(const benchmark_result& result)
+	{
+		spdlog::info("{0}: {1:.2f} ns/op, {2:.2f} Mops/sec", result.name, result.ns_per_operation(), result.mops_per_second());
+		s_results.push_back(result);
+	}
+
+	void report(const frame_result& result)
+	{
+		spdlog::info("{0}: {1}x{2} @ {3} spp in {4:.2f} s, {5:.3f} Msamples/sec, {6:.1f} MB peak",
+			result.name, result.width, result.height, result.samples_per_pixel, result.seconds, result.msamples_per_second(),
+			result.peak_rss_bytes / (1024.0 * 1024.0));
+		s_frames.push_back(result);
+	}
+
+	void report(const convergence_result& result)
+	{
+		if (result.converged)
+		{
+			spdlog::info("{0}: relative RMSE {1:.4f} <= {2} after {3} spp, {4:.2f} s",
+				result.name, result.rmse, result.target_rmse, result.samples_per_pixel, result.seconds);
+		}
+		else
+		{
+			spdlog::warn("{0}: relative RMSE {1:.4f} > {2} after {3} spp, {4:.2f} s",
+				result.name, result.rmse, result.target_rmse, result.samples_per_pixel, result.seconds);
+		}
+
+		s_convergence.push_back(result);
+	}
+
+	/// <summary>
+	/// Writes all the reported results to a JSON file
+	/// </summary>
+	static bool write_json(const std::string& file_name, const std::string& label, uint32_t threads)
+	{
+		nlohmann::json j;
+		j["label"] = label;
+		j["timestamp"] = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		j["threads"] = threads;
+		j["cpu"] = rt::utility::get_cpu_model();
+		j["peak_rss_bytes"] = rt::get_peak_rss();
+		j["benchmarks"] = nlohmann::json::array();
+		j["frames"] = nlohmann::json::array();
+		j["convergence"] = nlohmann::json::array();
+
+		for (const auto& r : s_results)
+		{
+			j["benchmarks"].push_back({
+				{ "name", r.name },
+				{ "operations", r.operations },
+				{ "seconds", r.seconds },
+				{ "ns_per_operation", r.ns_per_operation() },
+				{ "mops_per_second", r.mops_per_second() },
+			});
+		}
+
+		for (const auto& r : s_frames)
+		{
+			j["frames"].push_back({
+				{ "name", r.name },
+				{ "width", r.width },
+				{ "height", r.height },
+				{ "samples_per_pixel", r.samples_per_pixel },
+				{ "seconds", r.seconds },
+				{ "msamples_per_second", r.msamples_per_second() },
+				{ "peak_rss_bytes", r.peak_rss_bytes },
+			});
+		}
+
+		for (const auto& r : s_convergence)
+		{
+			j["convergence"].push_back({
+				{ "name", r.name },
+				{ "target_rmse", r.target_rmse },
+				{ "rmse", r.rmse },
+				{ "samples_per_pixel", r.samples_per_pixel },
+				{ "seconds", r.seconds },
+				{ "converged", r.converged },
+			});
+		}
+
+		std::ofstream file(file_name);
+
+		if (!file)
+			return false;
+
+		file << j.dump(4) << std::endl;
+		return bool(file);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::set<std::string> all_suites = { "micro", "texture", "ray", "frame" };
+
+	std::set<std::string> suites;
+	std::string out_file;
+	std::string label;
+	uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string param_name = argv[i];
+
+		if (param_name == "--suite" && i + 1 < argc)
+		{
+			const std::string suite = argv[++i];
+
+			if (all_suites.count(suite) == 0)
+			{
+				spdlog::error("Unknown suite: {0}", suite);
+				return -1;
+			}
+
+			suites.insert(suite);
+		}
+		else if (param_name == "--out" && i + 1 < argc)
+		{
+			out_file = argv[++i];
+		}
+		else if (param_name == "--label" && i + 1 < argc)
+		{
+			// Identifies the run in the report, e.g. a commit hash
+			label = argv[++i];
+		}
+		else if (param_name == "--threads" && i + 1 < argc)
+		{
+			threads = std::stoul(argv[++i]);
+		}
+		else
+		{
+			spdlog::error("Unknown parameter: {0}", param_name);
+			return -1;
+		}
+	}
+
+	if (suites.empty())
+		suites = all_suites;
+
+	if (suites.count("micro"))
+		rtbench::run_micro_benchmarks();
+
+	if (suites.count("texture"))
+		rtbench::run_texture_benchmarks();
+
+	if (suites.count("ray"))
+		rtbench::run_ray_benchmarks();
+
+	if (suites.count("frame"))
+		rtbench::run_frame_benchmarks(threads);
+
+	if (!out_file.empty())
+	{
+		if (!rtbench::write_json(out_file, label, threads))
+		{
+			spdlog::error("Can't write file: {0}", out_file);
+			return -1;
+		}
+
+		spdlog::info("Results written: {0}", out_file);
+	}
+
+	return 0;
+}
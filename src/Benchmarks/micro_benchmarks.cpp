@@ -0,0 +1,135 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <rng.h>
+#include <scene.h>
+#include <scene_loader.h>
+
+namespace rtbench
+{
+	static constexpr size_t s_rays = 1 << 20;
+	static constexpr size_t s_kd_rays = 1 << 15;
+
+	/// <summary>
+	/// Uniformly distributed unit vector
+	/// </summary>
+	static glm::vec3 random_direction(std::mt19937& e)
+	{
+		std::normal_distribution<float> d;
+		return glm::normalize(glm::vec3(d(e), d(e), d(e)) + glm::vec3(1e-6f));
+	}
+
+	/// <summary>
+	/// Rays starting inside the given box, in random directions
+	/// </summary>
+	static std::vector<rt::ray> make_random_rays(const rt::bounding_box& box, size_t count, uint32_t seed)
+	{
+		std::mt19937 e(seed);
+		std::uniform_real_distribution<float> d01;
+		std::vector<rt::ray> rays(count);
+
+		for (auto& r : rays)
+		{
+			r.origin = glm::mix(box.min, box.max, glm::vec3(d01(e), d01(e), d01(e)));
+			r.direction = random_direction(e);
+		}
+
+		return rays;
+	}
+
+	static void run_box_benchmarks()
+	{
+		const rt::bounding_box box({ -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f });
+
+		// Starting around the box, about half of them hit it
+		const auto rays = make_random_rays(rt::bounding_box({ -3.0f, -3.0f, -3.0f }, { 3.0f, 3.0f, 3.0f }), s_rays, 1);
+
+		report(run_benchmark("bounding_box::intersect", rays.size(), 10, [&box, &rays] {
+			size_t hits = 0;
+			for (const auto& r : rays)
+				hits += box.intersect(r);
+			do_not_optimize(hits);
+		}));
+	}
+
+	static void run_triangle_benchmarks()
+	{
+		const rt::triangle triangle({ -1.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, -1.0f }, { 0.0f, 0.0f, 1.0f },
+			{ 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.5f, 1.0f });
+
+		// From above the triangle, so the plane test doesn't reject them all early
+		auto rays = make_random_rays(rt::bounding_box({ -2.0f, 0.5f, -2.0f }, { 2.0f, 2.0f, 2.0f }), s_rays, 2);
+
+		for (auto& r : rays)
+			r.direction.y = -glm::abs(r.direction.y);
+
+		report(run_benchmark("mesh::intersect_triangle", rays.size(), 10, [&triangle, &rays] {
+			size_t hits = 0;
+			glm::vec3 position, bar;
+			for (const auto& r : rays)
+				hits += rt::mesh::intersect_triangle(r, triangle, position, bar);
+			do_not_optimize(hits);
+		}));
+	}
+
+	static void run_kd_benchmarks()
+	{
+		for (const auto* name : { "room", "mario" })
+		{
+			auto scene = rt::utility::load_scene(std::string("res/scenes/") + name + ".json");
+			scene.compile();
+
+			// The largest mesh of the scene, rays in its local space
+			std::shared_ptr<rt::mesh> largest;
+
+			for (const auto& node : scene.nodes)
+			{
+				const auto mesh = std::dynamic_pointer_cast<rt::mesh>(node->shape);
+
+				if (mesh && (!largest || mesh->get_triangle_count() > largest->get_triangle_count()))
+					largest = mesh;
+			}
+
+			if (!largest)
+				continue;
+
+			const auto rays = make_random_rays(largest->get_bounds(), s_kd_rays, 3);
+
+			report(run_benchmark(std::string("kd_traversal/") + name, rays.size(), 3, [&largest, &rays] {
+				size_t hits = 0;
+				for (const auto& r : rays)
+					hits += largest->intersect(r).hit;
+				do_not_optimize(hits);
+			}));
+		}
+	}
+
+	static void run_rng_benchmarks()
+	{
+		std::mt19937 e(4);
+		std::vector<glm::vec3> normals(s_rays);
+
+		for (auto& n : normals)
+			n = random_direction(e);
+
+		report(run_benchmark("rng::hemisphere", normals.size(), 10, [&normals] {
+			glm::vec3 sum(0.0f);
+			for (const auto& n : normals)
+				sum += rt::rng::hemisphere(n);
+			do_not_optimize(sum.x + sum.y + sum.z);
+		}));
+	}
+
+	void run_micro_benchmarks()
+	{
+		run_box_benchmarks();
+		run_triangle_benchmarks();
+		run_kd_benchmarks();
+		run_rng_benchmarks();
+	}
+}
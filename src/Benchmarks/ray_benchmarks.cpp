@@ -0,0 +1,103 @@
+#include "benchmark.h"
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+#include <scene.h>
+#include <scene_loader.h>
+
+namespace rtbench
+{
+	static constexpr uint32_t s_view_size = 256;
+	static constexpr uint32_t s_block_size = 4;
+
+	/// <summary>
+	/// Camera rays through the pixel centers, same projection as abstract_pathtracer
+	/// </summary>
+	static std::vector<rt::ray> make_camera_rays(const rt::scene& scene)
+	{
+		const auto forward = glm::normalize(scene.camera.get_direction());
+		const auto right = glm::normalize(glm::cross(forward, glm::vec3{ 0.0f, 1.0f, 0.0f }));
+		const auto up = glm::cross(right, forward);
+		const float h2 = std::atan(glm::pi<float>() / 8.0f);
+
+		// Grouped by 4x4 blocks, so that each packet is a contiguous range
+		std::vector<rt::ray> rays;
+		rays.reserve(s_view_size * s_view_size);
+
+		for (uint32_t by = 0; by < s_view_size; by += s_block_size)
+		for (uint32_t bx = 0; bx < s_view_size; bx += s_block_size)
+		for (uint32_t y = by; y < by + s_block_size; ++y)
+		for (uint32_t x = bx; x < bx + s_block_size; ++x)
+		{
+			const float x_factor = (x + 0.5f) / s_view_size * 2.0f - 1.0f;
+			const float y_factor = 1.0f - (y + 0.5f) / s_view_size * 2.0f;
+
+			rt::ray r;
+			r.origin = scene.camera.position;
+			r.direction = glm::normalize(forward + right * x_factor * h2 + up * y_factor * h2);
+			rays.push_back(r);
+		}
+
+		return rays;
+	}
+
+	void run_ray_benchmarks()
+	{
+		for (const auto* name : { "room", "mario", "materials" })
+		{
+			auto scene = rt::utility::load_scene(std::string("res/scenes/") + name + ".json");
+			scene.compile();
+
+			const auto rays = make_camera_rays(scene);
+			const size_t packet_size = s_block_size * s_block_size;
+
+			// Both paths must find the same hits
+			size_t mismatches = 0;
+
+			for (size_t i = 0; i < rays.size(); i += packet_size)
+			{
+				rt::raycast_result results[rt::s_max_packet_size];
+				const rt::scene_node* nodes[rt::s_max_packet_size];
+				scene.cast_packet(&rays[i], packet_size, results, nodes);
+
+				for (size_t k = 0; k < packet_size; ++k)
+				{
+					const auto [result, node] = scene.cast_ray(rays[i + k]);
+
+					if (node.get() != nodes[k] || result.hit != results[k].hit || (result.hit && result.position != results[k].position))
+						++mismatches;
+				}
+			}
+
+			if (mismatches > 0)
+				spdlog::error("{0}: {1} packet hits differ from single ray hits", name, mismatches);
+
+			// Mops/sec are Mrays/sec
+			report(run_benchmark(std::string("primary/single/") + name, rays.size(), 3, [&scene, &rays] {
+				size_t hits = 0;
+				for (const auto& r : rays)
+					hits += std::get<0>(scene.cast_ray(r)).hit;
+				do_not_optimize(hits);
+			}));
+
+			report(run_benchmark(std::string("primary/packet/") + name, rays.size(), 3, [&scene, &rays] {
+				size_t hits = 0;
+				rt::raycast_result results[rt::s_max_packet_size];
+				const rt::scene_node* nodes[rt::s_max_packet_size];
+
+				for (size_t i = 0; i < rays.size(); i += packet_size)
+				{
+					scene.cast_packet(&rays[i], packet_size, results, nodes);
+
+					for (size_t k = 0; k < packet_size; ++k)
+						hits += results[k].hit;
+				}
+
+				do_not_optimize(hits);
+			}));
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#include "benchmark.h"
+
+#include <random>
+#include <vector>
+#include <sstream>
+
+#include <glm/glm.hpp>
+
+#include <sampler.h>
+
+namespace rtbench
+{
+	static constexpr size_t s_samples = 1 << 20;
+
+	static rt::image make_noise_image(uint32_t size, rt::pixel_layout layout, rt::texel_format format)
+	{
+		std::mt19937 e(42);
+		std::uniform_real_distribution<float> d01;
+
+		rt::image image;
+		image.set_layout(layout);
+		image.resize(size, size);
+
+		for (uint32_t y = 0; y < size; ++y)
+			for (uint32_t x = 0; x < size; ++x)
+				image.set_pixel(x, y, { d01(e), d01(e), d01(e) });
+
+		image.set_format(format);
+		return image;
+	}
+
+	void run_texture_benchmarks()
+	{
+		std::mt19937 e(7);
+		std::uniform_real_distribution<float> d01;
+
+		// Random uvs model incoherent secondary rays, the coherent ones walk a small
+		// area like adjacent primary rays do
+		std::vector<glm::vec2> random_uvs(s_samples), coherent_uvs(s_samples);
+
+		for (auto& uv : random_uvs)
+			uv = { d01(e), d01(e) };
+
+		for (size_t i = 0; i < s_samples; ++i)
+			coherent_uvs[i] = glm::vec2(float(i % 1024) / 1024.0f, float(i / 1024) / 1024.0f) * 0.25f;
+
+		const auto layouts = {
+			std::make_tuple("linear", rt::pixel_layout::linear),
+			std::make_tuple("tiled", rt::pixel_layout::tiled),
+		};
+
+		const auto formats = {
+			std::make_tuple("rgb32f", rt::texel_format::rgb32f),
+			std::make_tuple("rgba8_srgb", rt::texel_format::rgba8_srgb),
+			std::make_tuple("rgb16f", rt::texel_format::rgb16f),
+			std::make_tuple("rgb9e5", rt::texel_format::rgb9e5),
+		};
+
+		for (const uint32_t size : { 256u, 2048u })
+		{
+			for (const auto& [layout_name, layout] : layouts)
+			for (const auto& [format_name, format] : formats)
+			{
+				const auto image = make_noise_image(size, layout, format);
+
+				for (const auto& [uvs_name, uvs] : { std::make_tuple("random", &random_uvs), std::make_tuple("coherent", &coherent_uvs) })
+				{
+					std::stringstream name;
+					name << "image::sample/" << layout_name << "/" << format_name << "/" << uvs_name << "/" << size;
+
+					report(run_benchmark(name.str(), s_samples, 10, [&image, &uvs = *uvs] {
+						glm::vec3 sum(0.0f);
+						for (const auto& uv : uvs)
+							sum += image.sample(uv);
+						do_not_optimize(sum.x + sum.y + sum.z);
+					}));
+				}
+			}
+		}
+	}
+}
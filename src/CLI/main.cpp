@@ -1,13 +1,271 @@
+#include <algorithm>
 #include <vector>
+#include <map>
+#include <filesystem>
+#include <optional>
+#include <fstream>
+#include <chrono>
+#include <numeric>
 
 #include <spdlog/spdlog.h>
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
+#include <json.hpp>
 
 #include <pathtracer.h>
+#include <wavefront_pathtracer.h>
+#include <debug_pathtracer.h>
+#include <texture_cache.h>
+#include <profiler.h>
 #include <scene_loader.h>
+#include <asset_cache.h>
+#include <accel_report.h>
+#include <image_io.h>
+#include <image_writer.h>
+#include <image_metrics.h>
+#include <system_info.h>
+
+
+static const std::map<std::string, rt::aov> s_aov_names = {
+	{ "albedo", rt::aov::albedo },
+	{ "normal", rt::aov::normal },
+	{ "depth", rt::aov::depth },
+};
+
+static const std::map<std::string, rt::utility::debug_pathtracer::mode> s_debug_modes = {
+	{ "albedo", rt::utility::debug_pathtracer::mode::albedo },
+	{ "emission", rt::utility::debug_pathtracer::mode::emission },
+	{ "roughness", rt::utility::debug_pathtracer::mode::roughness },
+	{ "metallic", rt::utility::debug_pathtracer::mode::metallic },
+	{ "normal", rt::utility::debug_pathtracer::mode::normal },
+	{ "node-visits", rt::utility::debug_pathtracer::mode::node_visits },
+	{ "triangle-tests", rt::utility::debug_pathtracer::mode::triangle_tests },
+	{ "cast-time", rt::utility::debug_pathtracer::mode::cast_time },
+};
+
+/// <summary>
+/// Returns true if the file keeps linear values (PFM, HDR, EXR) rather than display colors
+/// </summary>
+static bool is_linear_format(const std::string& file_name)
+{
+	const auto extension = std::filesystem::path(file_name).extension();
+	return extension == ".pfm" || extension == ".hdr" || extension == ".exr";
+}
+
+/// <summary>
+/// Auxiliary outputs are saved next to the main image, ie "result.png" -> "result.albedo.png"
+/// </summary>
+static std::string get_aov_file_name(const std::string& file_name, const std::string& aov_name)
+{
+	auto path = std::filesystem::path(file_name);
+	path.replace_extension(aov_name + path.extension().string());
+	return path.string();
+}
+
+/// <summary>
+/// Queues an auxiliary output. In 8 bit files normals are remapped to colors, depth is
+/// normalized to the maximum value, on the writer thread
+/// </summary>
+static void save_aov(rt::utility::image_writer& writer, const rt::image& image, rt::aov channel, const std::string& file_name,
+	rt::utility::image_output_options options)
+{
+	// Only the file settings of the main image apply, not its conversions
+	options.tone_mapping = false;
+	options.convert = nullptr;
+
+	if (!is_linear_format(file_name))
+	{
+		options.convert = [channel](rt::image& image) {
+			float max_value = 0.0f;
+
+			if (channel == rt::aov::depth)
+			{
+				for (uint32_t y = 0; y < image.get_height(); ++y)
+					for (uint32_t x = 0; x < image.get_width(); ++x)
+						max_value = std::max(max_value, image.get_pixel(x, y).r);
+			}
+
+			for (uint32_t y = 0; y < image.get_height(); ++y)
+			{
+				for (uint32_t x = 0; x < image.get_width(); ++x)
+				{
+					auto color = image.get_pixel(x, y);
+
+					if (channel == rt::aov::normal)
+						color = color * 0.5f + 0.5f;
+					else if (max_value > 0.0f)
+						color /= max_value;
+
+					image.set_pixel(x, y, color);
+				}
+			}
+		};
+	}
+
+	writer.write(image, file_name, options);
+}
+
+/// <summary>
+/// Error against the reference after an iteration
+/// </summary>
+struct convergence_sample
+{
+	uint64_t iteration;
+	uint64_t samples_per_pixel;
+	double seconds;
+	rt::utility::image_error error;
+};
+
+/// <summary>
+/// Writes the convergence curve as JSON if the file name ends with ".json", as CSV otherwise
+/// </summary>
+static bool write_convergence(const std::string& file_name, const std::string& scene_file, const std::string& integrator,
+	const std::vector<convergence_sample>& samples)
+{
+	std::ofstream out(file_name);
+
+	if (!out)
+		return false;
+
+	if (std::filesystem::path(file_name).extension() == ".json")
+	{
+		nlohmann::json j;
+		j["scene"] = scene_file;
+		j["integrator"] = integrator;
+		j["samples"] = nlohmann::json::array();
+
+		for (const auto& s : samples)
+		{
+			j["samples"].push_back({
+				{ "iteration", s.iteration },
+				{ "samples_per_pixel", s.samples_per_pixel },
+				{ "seconds", s.seconds },
+				{ "rmse", s.error.rmse },
+				{ "relmse", s.error.relmse },
+				{ "flip", s.error.flip },
+			});
+		}
+
+		out << j.dump(4) << std::endl;
+	}
+	else
+	{
+		out << "iteration,samples_per_pixel,seconds,rmse,relmse,flip\n";
+
+		for (const auto& s : samples)
+		{
+			out << s.iteration << "," << s.samples_per_pixel << "," << s.seconds << ","
+				<< s.error.rmse << "," << s.error.relmse << "," << s.error.flip << "\n";
+		}
+	}
+
+	return bool(out);
+}
+
+/// <summary>
+/// Measures of a --benchmark run
+/// </summary>
+struct benchmark_report
+{
+	std::string scene_file;
+	std::string integrator;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	size_t threads = 0;
+	uint64_t samples_per_pixel = 0;
+	uint32_t seed = 0;
+	double load_seconds = 0.0;
+	double compile_seconds = 0.0;
+	double render_seconds = 0.0;
+	std::vector<double> iteration_seconds;
+	uint64_t rays = 0;
+};
+
+static bool write_benchmark_report(const std::string& file_name, const benchmark_report& report)
+{
+	nlohmann::json j;
+	j["scene"] = report.scene_file;
+	j["integrator"] = report.integrator;
+	j["cpu"] = rt::utility::get_cpu_model();
+	j["threads"] = report.threads;
+	j["width"] = report.width;
+	j["height"] = report.height;
+	j["samples_per_pixel"] = report.samples_per_pixel;
+	j["seed"] = report.seed;
+	j["load_seconds"] = report.load_seconds;
+	j["compile_seconds"] = report.compile_seconds;
+	j["render_seconds"] = report.render_seconds;
+	j["iteration_seconds"] = report.iteration_seconds;
+	j["rays"] = report.rays;
+	j["rays_per_second"] = report.render_seconds > 0.0 ? report.rays / report.render_seconds : 0.0;
+	j["samples_per_second"] = report.render_seconds > 0.0 ? double(report.width) * report.height * report.samples_per_pixel / report.render_seconds : 0.0;
+	j["peak_rss_bytes"] = rt::get_peak_rss();
+
+	std::ofstream out(file_name);
+
+	if (!out)
+		return false;
+
+	out << j.dump(4) << std::endl;
+	return bool(out);
+}
+
+/// <summary>
+/// Prints the quality report of the KD-tree of each mesh of a scene
+/// </summary>
+/// <returns>0 if all the trees are valid</returns>
+static int print_accel_report(const std::string& scene_file)
+{
+	auto scene = rt::utility::load_scene(scene_file);
+	scene.compile();
+
+	spdlog::info("Acceleration structures: {0}", scene_file);
+
+	// Meshes can be shared by several nodes
+	std::vector<const rt::mesh*> meshes;
+
+	for (const auto& node : scene.nodes)
+	{
+		const auto mesh = dynamic_cast<const rt::mesh*>(node->shape.get());
+
+		if (mesh && std::find(meshes.begin(), meshes.end(), mesh) == meshes.end())
+			meshes.push_back(mesh);
+	}
+
+	bool valid = true;
+
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		const auto report = rt::utility::analyze_kd_tree(*meshes[i]);
+
+		spdlog::info("Mesh {0}: {1} triangles, {2} nodes, {3} leaves, {4:.1f} KB",
+			i, report.triangle_count, report.node_count, report.leaf_count, report.memory_bytes / 1024.0);
+		spdlog::info(" Depth: {0} max, {1:.1f} average leaf depth", report.max_depth, report.average_leaf_depth);
+		spdlog::info(" References: {0} ({1:.2f} per triangle), SAH cost: {2:.1f}",
+			report.triangle_references, report.get_duplication(), report.sah_cost);
+
+		std::string histogram;
+
+		for (size_t size = 0; size < report.leaf_sizes.size(); ++size)
+		{
+			if (report.leaf_sizes[size] > 0)
+				histogram += fmt::format(" {0}{1}:{2}", size, size == rt::utility::kd_tree_report::s_max_leaf_size ? "+" : "", report.leaf_sizes[size]);
+		}
+
+		spdlog::info(" Leaf sizes:{0}", histogram);
+
+		if (report.is_valid())
+		{
+			spdlog::info(" Valid");
+		}
+		else
+		{
+			spdlog::error(" Invalid: {0} node bounds, {1} triangle bounds, {2} missing triangles, {3} structure errors",
+				report.bounds_errors, report.triangle_bounds_errors, report.missing_triangles, report.structure_errors);
+			valid = false;
+		}
+	}
 
+	return valid ? 0 : 1;
+}
 
 int main(int argc, char** argv)
 {
@@ -17,8 +275,26 @@ int main(int argc, char** argv)
 	size_t threads = 4;
 	std::string scene_file;
 	std::string out_file = "result.png";
+	std::vector<std::pair<std::string, rt::aov>> aovs;
+	uint32_t primary_hit_positions = 0;
+	bool primary_packets = false;
+	std::string integrator = "pathtracer";
+	std::optional<rt::utility::debug_pathtracer::mode> debug_mode;
+	std::optional<float> heatmap_min, heatmap_max;
+	bool heatmap_log = false;
+	std::string trace_file;
+	std::string reference_file;
+	std::string convergence_file;
+	std::string benchmark_file;
+	std::optional<uint32_t> seed;
+	float snapshot_interval = 0.0f;
+	uint32_t tile_size = 0;
+	rt::utility::image_output_options output_options;
 
-	for (size_t i = 1; i < argc; ++i)
+	// Subcommand: "accel-report --scene <file>" reports on the acceleration structures instead of rendering
+	const bool accel_report = argc > 1 && std::string(argv[1]) == "accel-report";
+
+	for (size_t i = accel_report ? 2 : 1; i < argc; ++i)
 	{
 		std::string param_name = argv[i];
 
@@ -38,11 +314,133 @@ int main(int argc, char** argv)
 		{
 			iterations = std::stoull(argv[++i]);
 		}
+		else if (param_name == "--aov")
+		{
+			const std::string aov_name = argv[++i];
+			const auto it = s_aov_names.find(aov_name);
+
+			if (it == s_aov_names.end())
+			{
+				spdlog::error("Unknown aov: {0}", aov_name);
+				return -1;
+			}
+
+			aovs.push_back(*it);
+		}
 		else if (param_name == "--resolution")
 		{
 			width = std::stoull(argv[++i]);
 			height = std::stoull(argv[++i]);
 		}
+		else if (param_name == "--primary-hit-cache")
+		{
+			// Subpixel positions per pixel
+			primary_hit_positions = std::stoul(argv[++i]);
+		}
+		else if (param_name == "--packets")
+		{
+			primary_packets = true;
+		}
+		else if (param_name == "--integrator")
+		{
+			// "pathtracer" (depth-first) or "wavefront" (breadth-first)
+			integrator = argv[++i];
+
+			if (integrator != "pathtracer" && integrator != "wavefront")
+			{
+				spdlog::error("Unknown integrator: {0}", integrator);
+				return -1;
+			}
+		}
+		else if (param_name == "--debug")
+		{
+			// Renders a debug channel or a heatmap instead of the image
+			const std::string mode_name = argv[++i];
+			const auto it = s_debug_modes.find(mode_name);
+
+			if (it == s_debug_modes.end())
+			{
+				spdlog::error("Unknown debug mode: {0}", mode_name);
+				return -1;
+			}
+
+			if (!rt::utility::debug_pathtracer::is_supported(it->second))
+			{
+				spdlog::error("Debug mode {0} needs a build with RT_RAY_STATS", mode_name);
+				return -1;
+			}
+
+			debug_mode = it->second;
+		}
+		else if (param_name == "--heatmap-min")
+		{
+			heatmap_min = std::stof(argv[++i]);
+		}
+		else if (param_name == "--heatmap-max")
+		{
+			heatmap_max = std::stof(argv[++i]);
+		}
+		else if (param_name == "--heatmap-log")
+		{
+			heatmap_log = true;
+		}
+		else if (param_name == "--trace-out")
+		{
+			// Chrome trace of the loading and rendering
+			trace_file = argv[++i];
+			rt::profiler::get_instance().set_enabled(true);
+		}
+		else if (param_name == "--reference")
+		{
+			// PFM or EXR image the iterations are compared to
+			reference_file = argv[++i];
+		}
+		else if (param_name == "--convergence-out")
+		{
+			// Error after each iteration, .csv or .json
+			convergence_file = argv[++i];
+		}
+		else if (param_name == "--benchmark")
+		{
+			// Renders without saving the image and writes a JSON report of the timings
+			benchmark_file = argv[++i];
+		}
+		else if (param_name == "--seed")
+		{
+			seed = std::stoul(argv[++i]);
+		}
+		else if (param_name == "--snapshot-interval")
+		{
+			// In seconds, the image is saved at the end of the first iteration past each interval
+			snapshot_interval = std::stof(argv[++i]);
+		}
+		else if (param_name == "--exr-compression")
+		{
+			const std::string compression = argv[++i];
+
+			if (compression != "none" && compression != "zip")
+			{
+				spdlog::error("Unknown EXR compression: {0}", compression);
+				return -1;
+			}
+
+			output_options.compression = compression == "zip" ? rt::utility::exr_compression::zip : rt::utility::exr_compression::none;
+		}
+		else if (param_name == "--tile-size")
+		{
+			// Renders tile by tile, the tiles are streamed to the output file (EXR only)
+			tile_size = std::stoul(argv[++i]);
+		}
+		else if (param_name == "--asset-budget")
+		{
+			// In MB, memory kept by the cache of loaded meshes and images
+			rt::utility::asset_cache::get_instance().set_memory_budget(std::stoull(argv[++i]) << 20);
+		}
+		else if (param_name == "--texture-budget")
+		{
+			// In MB
+			rt::texture_cache::get_instance().set_memory_budget(std::stoull(argv[++i]) << 20);
+		}
 		else
 		{
 			spdlog::error("Unknown parameter: {0}", param_name);
@@ -50,14 +448,111 @@ int main(int argc, char** argv)
 		}
 	}
 
+	if (accel_report)
+		return print_accel_report(scene_file);
+
+	// Both shade the screen rays one by one, the wavefront integrator needs them in batches
+	if (integrator == "wavefront" && !debug_mode && (primary_hit_positions > 0 || primary_packets))
+	{
+		spdlog::error("--primary-hit-cache and --packets can't be used with --integrator wavefront");
+		return -1;
+	}
+
+	// Comparing to the reference walks the whole image between iterations, it would be timed as rendering
+	if (!benchmark_file.empty() && (!reference_file.empty() || !convergence_file.empty()))
+	{
+		spdlog::error("--reference and --convergence-out can't be used with --benchmark");
+		return -1;
+	}
+
+	// Shared with the callbacks, which outlive this scope until result->wait()
+	auto reference = std::make_shared<rt::image>();
+
+	if (!reference_file.empty())
+	{
+		const auto extension = std::filesystem::path(reference_file).extension();
+
+		if (extension != ".pfm" && extension != ".exr")
+		{
+			spdlog::error("The reference must be a PFM or EXR file: {0}", reference_file);
+			return -1;
+		}
+
+		if (!(extension == ".exr" ? rt::utility::read_exr(reference_file, *reference) : rt::utility::read_pfm(reference_file, *reference)))
+			return -1;
+
+		if (reference->get_width() != width || reference->get_height() != height)
+		{
+			spdlog::error("The reference is {0} x {1} px, the viewport {2} x {3} px", reference->get_width(), reference->get_height(), width, height);
+			return -1;
+		}
+	}
+	else if (!convergence_file.empty())
+	{
+		spdlog::error("--convergence-out needs a --reference");
+		return -1;
+	}
+
+	const bool benchmark = !benchmark_file.empty();
+
+	// Tiled renders never hold the whole image, only the tiled output and the final tile count make sense
+	if (tile_size > 0)
+	{
+		if (std::filesystem::path(out_file).extension() != ".exr")
+		{
+			spdlog::error("Tiled renders are saved as EXR, not: {0}", out_file);
+			return -1;
+		}
+
+		if (!reference_file.empty() || benchmark || snapshot_interval > 0.0f)
+		{
+			spdlog::error("--reference, --benchmark and --snapshot-interval need the whole image, they can't be used with --tile-size");
+			return -1;
+		}
+	}
+
+	// Benchmarks are repeatable by default
+	if (benchmark && !seed)
+		seed = 1;
+
+	auto report = std::make_shared<benchmark_report>();
+	const auto load_start = std::chrono::steady_clock::now();
+
 	auto scene = rt::utility::load_scene(scene_file);
 
+	report->load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+
+	if (benchmark)
+	{
+		// Compiled here to be timed apart, "run" finds the meshes already compiled
+		const auto compile_start = std::chrono::steady_clock::now();
+		scene.compile();
+		report->compile_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - compile_start).count();
+	}
+
 	spdlog::info("Starting pathtracing");
 	spdlog::info(" Scene: {0}", scene_file);
 	spdlog::info(" Threads: {0}", threads);
 	spdlog::info(" Viewport: {0} x {1} px", width, height);
+	spdlog::info(" Integrator: {0}", integrator);
 		
-	rt::pathtracer pathtracer;
+	std::unique_ptr<rt::abstract_pathtracer> pathtracer;
+
+	if (debug_mode)
+	{
+		auto debug = std::make_unique<rt::utility::debug_pathtracer>();
+		debug->current_mode = *debug_mode;
+		pathtracer = std::move(debug);
+	}
+	else if (integrator == "wavefront")
+	{
+		pathtracer = std::make_unique<rt::wavefront_pathtracer>();
+	}
+	else
+	{
+		pathtracer = std::make_unique<rt::pathtracer>();
+	}
+
 	rt::view_parameters view_params;
 	rt::trace_parameters trace_params;
 
@@ -69,47 +564,229 @@ int main(int argc, char** argv)
 	trace_params.iterations = iterations;
 	trace_params.samples_per_iteration = 256;
 
-	auto result = pathtracer.run(view_params, trace_params, scene);
+	for (const auto& [name, channel] : aovs)
+		trace_params.aovs.push_back(channel);
+
+	trace_params.cache_primary_hits = primary_hit_positions > 0;
+	trace_params.primary_hit_positions = primary_hit_positions;
+	trace_params.primary_packets = primary_packets;
+	trace_params.seed = seed;
+	trace_params.tile_size = tile_size;
+
+	// Heatmaps are rendered as costs, mapped to display colors when saved
+	if (debug_mode && rt::utility::debug_pathtracer::is_heatmap(*debug_mode))
+	{
+		auto scale = rt::utility::debug_pathtracer::get_default_scale(*debug_mode);
+		scale.min = heatmap_min.value_or(scale.min);
+		scale.max = heatmap_max.value_or(scale.max);
+		scale.logarithmic = scale.logarithmic || heatmap_log;
+
+		output_options.tone_mapping = false;
+		output_options.convert = [scale](rt::image& image) { rt::utility::debug_pathtracer::apply_heatmap(image, scale); };
+	}
+
+	// Tiled renders write the tiles as they come, the files are opened beforehand
+	auto tile_writer = std::make_shared<rt::utility::exr_tile_writer>();
+	auto aov_tile_writers = std::make_shared<std::map<rt::aov, rt::utility::exr_tile_writer>>();
+
+	if (tile_size > 0)
+	{
+		if (!tile_writer->open(out_file, width, height, tile_size, output_options.compression))
+		{
+			spdlog::error("Can't write file: {0}", out_file);
+			return -1;
+		}
+
+		for (const auto& [name, channel] : aovs)
+		{
+			const auto aov_file = get_aov_file_name(out_file, name);
+
+			if (!(*aov_tile_writers)[channel].open(aov_file, width, height, tile_size, output_options.compression))
+			{
+				spdlog::error("Can't write file: {0}", aov_file);
+				return -1;
+			}
+		}
+
+		// Tiles can end before "run" returns, the handler is subscribed by the pathtracer before the first one
+		const uint32_t tile_count = ((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size);
+
+		trace_params.tile_handler = [tile_writer, aov_tile_writers, output_options, tile_count,
+			start_time = std::chrono::steady_clock::now(), completed_tiles = 0u, last_percent = -1](const rt::image_tile& tile) mutable {
+			if (output_options.convert)
+			{
+				auto color = tile.color;
+				output_options.convert(color);
+				tile_writer->write_tile(tile.x, tile.y, color);
+			}
+			else
+			{
+				tile_writer->write_tile(tile.x, tile.y, tile.color);
+			}
+
+			for (const auto& [channel, aov_image] : tile.aovs)
+				aov_tile_writers->at(channel).write_tile(tile.x, tile.y, aov_image);
+
+			const int percent = int(++completed_tiles * 100.0f / tile_count);
+
+			if (percent != last_percent)
+			{
+				const double elapsed_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+				spdlog::info("Tiles completed: {0}%, elapsed time: {1:.2f}", percent, elapsed_time);
+				last_percent = percent;
+			}
+		};
+	}
+
+	// Iterations can end before "run" returns, the render starts once every handler is subscribed
+	trace_params.deferred_start = true;
+
+	auto result = pathtracer->run(view_params, trace_params, scene);
+
+	if (benchmark)
+	{
+		result->on_iteration_end.subscribe([result, report, last_time = 0.0](const rt::image& img, const uint64_t& iteration) mutable {
+			const double elapsed_time = result->get_elapsed_time();
+			report->iteration_seconds.push_back(elapsed_time - last_time);
+			last_time = elapsed_time;
+		});
+	}
 	
+	auto convergence = std::make_shared<std::vector<convergence_sample>>();
+
+	if (!reference_file.empty())
+	{
+		// Time spent comparing is not rendering time, it's taken out of the curve
+		auto comparison_time = std::make_shared<double>(0.0);
+
+		result->on_iteration_end.subscribe([result, reference, convergence, comparison_time](const rt::image& img, const uint64_t& iteration) {
+			const double elapsed_time = result->get_elapsed_time();
+			const auto error = rt::utility::compare_images(img, *reference);
+
+			convergence->push_back({ iteration, result->samples_per_pixel.load(), elapsed_time - *comparison_time, error });
+			*comparison_time += result->get_elapsed_time() - elapsed_time;
+
+			spdlog::info("Error: RMSE {0:.5f}, relMSE {1:.5f}, FLIP {2:.4f}", error.rmse, error.relmse, error.flip);
+		});
+	}
+
 	result->on_iteration_end.subscribe([trace_params, result, iterations](const rt::image& img, const uint64_t& iteration) {
 		const float elapsed_time = result->get_elapsed_time();
 		const auto samples = result->samples_per_pixel.load();
 		const float eta = (trace_params.iterations - (iteration + 1)) * (elapsed_time / (iteration + 1));
 
-		spdlog::info("Iteration completed: {0} / {1}, {2} spp/sec, ETA: {3:.2f}", iteration + 1, iterations, samples / elapsed_time, eta);
+		const auto rays = result->get_ray_stats().get_total_rays();
+
+		spdlog::info("Iteration completed: {0} / {1}, {2} spp/sec, {3:.2f} Mrays/sec, ETA: {4:.2f}",
+			iteration + 1, iterations, samples / elapsed_time, rays / elapsed_time * 1e-6, eta);
 	});
 
 
-	result->on_end.subscribe([out_file](const rt::image& image) {
-		// Save image here
-		std::vector<uint32_t> pixels(image.get_height() * image.get_width());
+	// Images are converted and written in the background, the render threads only wait for a copy
+	auto writer = std::make_shared<rt::utility::image_writer>(threads);
 
-		for (uint32_t x = 0; x < image.get_width(); ++x)
-		{
-			for (uint32_t y = 0; y < image.get_height(); ++y)
-			{
-				auto color = image.get_pixel(x, y);
+	if (snapshot_interval > 0.0f && !benchmark)
+	{
+		result->on_iteration_end.subscribe([result, writer, out_file, output_options, snapshot_interval, last_snapshot = 0.0f](const rt::image& img, const uint64_t& iteration) mutable {
+			const float elapsed_time = result->get_elapsed_time();
 
-				// Tone mapping
-				color = glm::vec3(1.0f) - glm::exp(-color);
+			if (elapsed_time - last_snapshot >= snapshot_interval)
+			{
+				writer->write(img, out_file, output_options);
+				last_snapshot = elapsed_time;
+			}
+		});
+	}
 
-				// Gamma correction
-				color = glm::pow(color, glm::vec3(1.0f / 2.2f));
+	result->on_end.subscribe([out_file, aovs, result, writer, output_options, benchmark, tile_size](const rt::image& image) {
+		// Benchmarks only measure the rendering, tiled renders are already written
+		if (!benchmark && tile_size == 0)
+		{
+			writer->write(image, out_file, output_options);
 
-				pixels[y * image.get_width() + x] =
-					((uint32_t(color.r * 255) << 0)) |
-					((uint32_t(color.g * 255) << 8)) |
-					((uint32_t(color.b * 255) << 16)) |
-					((uint32_t(255) << 24));
-			}
+			for (const auto& [name, channel] : aovs)
+				save_aov(*writer, *result->get_aov(channel), channel, get_aov_file_name(out_file, name), output_options);
 		}
 
-		stbi_write_png(out_file.c_str(), image.get_width(), image.get_height(), 4, pixels.data(), 0);
+		const auto texture_stats = rt::texture_cache::get_instance().get_stats();
+
+		const auto ray_stats = result->get_ray_stats();
+		const auto rays = ray_stats.get_total_rays();
+
+		if (rays > 0)
+		{
+			spdlog::info("Rays: {0} primary, {1} secondary, {2:.1f}% hits, {3:.2f} Mrays/sec",
+				ray_stats.rays[size_t(rt::ray_type::primary)], ray_stats.rays[size_t(rt::ray_type::secondary)],
+				100.0 * ray_stats.hits / rays, rays / result->get_elapsed_time() * 1e-6);
+			spdlog::info("Traversal: {0:.1f} nodes and {1:.1f} triangles per ray, {2:.2f} rays per path",
+				double(ray_stats.nodes_visited) / rays, double(ray_stats.triangles_tested) / rays, ray_stats.get_average_path_length());
+		}
 
-		spdlog::info("image saved: {0}", out_file);
+		if (texture_stats.lookups > 0)
+		{
+			spdlog::info("Texture cache: {0} lookups, {1:.1f}% hits ({2} local, {3} shared), {4} tiles loaded ({5:.1f} MB), {6} evicted, {7:.1f} MB resident",
+				texture_stats.lookups, texture_stats.get_hit_rate() * 100.0, texture_stats.local_hits, texture_stats.shared_hits,
+				texture_stats.loads, texture_stats.bytes_loaded / (1024.0 * 1024.0), texture_stats.evictions, texture_stats.resident_bytes / (1024.0 * 1024.0));
+		}
 
 	});
 
+	result->start();
 	result->wait();
+	writer->wait();
+
+	if (tile_size > 0)
+	{
+		if (tile_writer->close())
+			spdlog::info("image saved: {0}", out_file);
+		else
+			spdlog::error("Can't write file: {0}", out_file);
+
+		for (const auto& [name, channel] : aovs)
+		{
+			const auto aov_file = get_aov_file_name(out_file, name);
+
+			if (aov_tile_writers->at(channel).close())
+				spdlog::info("image saved: {0}", aov_file);
+			else
+				spdlog::error("Can't write file: {0}", aov_file);
+		}
+	}
+
+	if (benchmark)
+	{
+		report->scene_file = scene_file;
+		report->integrator = debug_mode ? "debug" : integrator;
+		report->width = width;
+		report->height = height;
+		report->threads = threads;
+		report->samples_per_pixel = result->samples_per_pixel;
+		report->seed = *seed;
+		report->render_seconds = std::accumulate(report->iteration_seconds.begin(), report->iteration_seconds.end(), 0.0);
+		report->rays = result->get_ray_stats().get_total_rays();
+
+		if (write_benchmark_report(benchmark_file, *report))
+			spdlog::info("benchmark saved: {0}", benchmark_file);
+		else
+			spdlog::error("Can't write file: {0}", benchmark_file);
+	}
+
+	if (!convergence_file.empty())
+	{
+		if (write_convergence(convergence_file, scene_file, debug_mode ? "debug" : integrator, *convergence))
+			spdlog::info("convergence saved: {0}", convergence_file);
+		else
+			spdlog::error("Can't write file: {0}", convergence_file);
+	}
+
+	if (!trace_file.empty())
+	{
+		rt::profiler::get_instance().set_enabled(false);
+
+		if (rt::profiler::get_instance().write_chrome_trace(trace_file))
+			spdlog::info("trace saved: {0}", trace_file);
+		else
+			spdlog::error("Can't write file: {0}", trace_file);
+	}
 
 }
\ No newline at end of file
@@ -1,28 +1,144 @@
 #include "abstract_pathtracer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <optional>
 #include <limits>
 #include <spdlog/spdlog.h>
 
 #include "rng.h"
+#include "profiler.h"
 
 namespace rt {
 
+	// Primary ray packets cover blocks of pixels
+	static constexpr uint32_t s_packet_width = 4;
+	static constexpr uint32_t s_packet_height = 4;
+	static_assert(s_packet_width * s_packet_height <= s_max_packet_size, "a block of pixels must fit in a packet");
+
+	/// <summary>
+	/// Seed of the generator for a band or a tile, from the seed of the render. The noise then
+	/// doesn't depend on which thread traces what
+	/// </summary>
+	static std::uint32_t get_work_seed(std::uint32_t seed, uint64_t iteration, uint32_t index)
+	{
+		// splitmix64 finalizer, over each value in turn
+		const auto mix = [](uint64_t h) {
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+			return h ^ (h >> 31);
+		};
+
+		const uint64_t h = mix(mix(mix(seed) ^ iteration) ^ index);
+		return std::uint32_t(h ^ (h >> 32));
+	}
+
+	/// <summary>
+	/// Builds the camera rays for positions in pixels
+	/// </summary>
+	class camera_rays
+	{
+	public:
+		/// <summary>
+		/// Angle covered by a single pixel, the spread of the camera rays cones
+		/// </summary>
+		float pixel_angle;
+
+		camera_rays(const camera& camera, const view_parameters& view_params) : m_camera(camera)
+		{
+			const auto forward = glm::normalize(camera.get_direction());
+			const auto right = glm::normalize(glm::cross(forward, glm::vec3{ 0.0f, 1.0f, 0.0f }));
+			const auto up = glm::cross(right, forward);
+
+			const float h2 = std::atan(view_params.fov_y / 2.0f);
+			const float w2 = h2 * (float)view_params.width / view_params.height;
+
+			pixel_angle = 2.0f * h2 / view_params.height;
+
+			// Direction (before normalization) as the top left corner plus the steps of one pixel
+			// to the right and down
+			m_top_left = forward - right * w2 + up * h2;
+			m_pixel_dx = right * (2.0f * w2 / view_params.width);
+			m_pixel_dy = -up * (2.0f * h2 / view_params.height);
+		}
+
+		ray operator()(float fx, float fy) const
+		{
+			ray r;
+			r.origin = m_camera.position;
+			r.direction = glm::normalize(m_top_left + m_pixel_dx * fx + m_pixel_dy * fy);
+			r.cone_angle = pixel_angle;
+			return r;
+		}
+
+	private:
+		const camera& m_camera;
+		glm::vec3 m_top_left;
+		glm::vec3 m_pixel_dx;
+		glm::vec3 m_pixel_dy;
+	};
+
 	std::shared_ptr<pathtracer_result> abstract_pathtracer::run(const view_parameters& view_params, const trace_parameters& trace_params, scene& scene)
 	{
 		scene.compile();
+		log_memory_stats("scene compiled", scene.get_memory_stats());
+
+		if (trace_params.tile_size > 0)
+			return run_tiled(view_params, trace_params, scene);
+
 		return std::make_shared<pathtracer_result>([&, trace_params, view_params](pathtracer_result& self) -> void {
 				
 			std::mutex line_mutex;
 
+			const std::uint32_t seed = trace_params.seed ? *trace_params.seed : rng::next<std::uint32_t>(0u, std::numeric_limits<std::uint32_t>::max());
+
 			image image(view_params.width, view_params.height);
+
+			for (const auto channel : trace_params.aovs)
+				self.m_aovs[channel].resize(view_params.width, view_params.height);
+
+			const bool has_aovs = !self.m_aovs.empty();
 			
-			const auto forward = glm::normalize(scene.camera.get_direction());
-			const auto right = glm::normalize(glm::cross(forward, glm::vec3{ 0.0f, 1.0f, 0.0f }));
-			const auto up = glm::cross(right, forward);
+			const camera_rays camera_ray(scene.camera, view_params);
 
-			const float h2 = std::atan(view_params.fov_y / 2.0f);
-			const float w2 = h2 * (float)view_params.width / view_params.height;
+			// First hits of the camera rays, filled during the first iteration
+			struct primary_hit
+			{
+				raycast_result result;
+				glm::vec3 direction;
+				const scene_node* node;
+			};
+
+			// The positions are rounded up to fill the grid, a partial grid would leave part of every pixel unsampled
+			const uint32_t requested_positions = trace_params.cache_primary_hits ? std::max(trace_params.primary_hit_positions, 1u) : 0;
+			const uint32_t strata_x = uint32_t(std::ceil(std::sqrt(float(requested_positions))));
+			const uint32_t strata_y = requested_positions > 0 ? (requested_positions + strata_x - 1) / strata_x : 0;
+			const uint32_t positions = strata_x * strata_y;
+			std::vector<primary_hit> primary_hits(size_t(view_params.width) * view_params.height * positions);
+			std::atomic<uint64_t> warm_up_time = 0;
+
+			// Packets are only used to trace the primary rays, the cache makes them useless
+			const bool packets = trace_params.primary_packets && positions == 0;
+
+			// Batched tracers get bands of enough lines to fill a batch
+			const size_t line_rays = size_t(view_params.width) * trace_params.samples_per_iteration;
+			const uint32_t batch_lines = (get_batch_size() > 0 && positions == 0 && !packets) ?
+				uint32_t(std::clamp<size_t>(get_batch_size() / std::max<size_t>(line_rays, 1), 1, view_params.height)) : 0;
+
+			const uint32_t band_height = packets ? s_packet_height : std::max(batch_lines, 1u);
+
+			size_t framebuffer_bytes = image.get_size_in_bytes() + primary_hits.size() * sizeof(primary_hit);
+
+			for (const auto& [channel, aov_image] : self.m_aovs)
+				framebuffer_bytes += aov_image.get_size_in_bytes();
+
+			self.m_framebuffer_bytes = framebuffer_bytes;
+
+			if (positions > 0)
+			{
+				spdlog::info("Primary hit cache: {0} positions per pixel ({1} x {2}), {3:.1f} MB",
+					positions, strata_x, strata_y, primary_hits.size() * sizeof(primary_hit) / (1024.0 * 1024.0));
+			}
 
 			auto next_iteration = [trace_params, current = uint64_t(0)] () mutable -> std::optional<uint64_t> {
 				if (trace_params.iterations != 0 && current == trace_params.iterations)
@@ -37,97 +153,569 @@ namespace rt {
 
 			for (auto it = next_iteration(); it.has_value() && !self.is_interrupted(); it = next_iteration())
 			{
+				RT_PROFILE_ZONE("iteration", int64_t(it.value()));
+
 				self.on_iteration_start(it.value());
 
-				auto next_scan_line = [&, current = uint32_t(0)]() mutable -> std::optional<uint32_t> {
+				// Work is split in bands of lines, one line or a row of packets
+				auto next_band = [&, current = uint32_t(0)]() mutable -> std::optional<uint32_t> {
 					std::lock_guard guard(line_mutex);
 
-					if (current == image.get_height())
+					if (current >= image.get_height())
 					{
 						return std::nullopt;
 					}
 					else
 					{
 						self.progress = current / float(image.get_height());
-						return current++;
+						const auto band = current;
+						current += band_height;
+						return band;
 					}
 				};
 
+				const float t = it.value() / float(it.value() + 1);
+				const float inv_samples = 1.0f / trace_params.samples_per_iteration;
 
-				const auto thread_func = [&] (const std::uint32_t seed) {
+				// Blends the samples of this iteration with the previous ones
+				const auto store_pixel = [&](uint32_t x, uint32_t y, const glm::vec3& color, const aov_sample& aov_sum) {
+					auto prev_color = image.get_pixel(x, y);
+					auto next_color = glm::mix(color * inv_samples, prev_color, t);
+					image.set_pixel(x, y, next_color);
 
-					// Sync here ?
+					for (auto& [channel, aov_image] : self.m_aovs)
+					{
+						glm::vec3 value;
 
-					rng::seed(seed);
+						switch (channel)
+						{
+						case aov::albedo: value = aov_sum.albedo * inv_samples; break;
+						case aov::normal: value = aov_sum.normal * inv_samples; break;
+						case aov::depth: value = glm::vec3(aov_sum.depth * inv_samples); break;
+						}
 
-					for (auto scan_line = next_scan_line(); !self.is_interrupted() && scan_line.has_value(); scan_line = next_scan_line())
+						aov_image.set_pixel(x, y, glm::mix(value, aov_image.get_pixel(x, y), t));
+					}
+				};
+
+				const auto add_aov = [](aov_sample& sum, const aov_sample& aov) {
+					sum.albedo += aov.albedo;
+					sum.normal += aov.normal;
+					sum.depth += aov.depth;
+				};
+
+				const auto trace_packets = [&](uint32_t y_begin, uint32_t y_end) {
+					for (uint32_t x_begin = 0; x_begin < view_params.width && !self.is_interrupted(); x_begin += s_packet_width)
 					{
-						const auto y = scan_line.value();
-						const float t = it.value() / float(it.value() + 1);
+						const uint32_t x_end = std::min(x_begin + s_packet_width, view_params.width);
+						const size_t count = size_t(x_end - x_begin) * (y_end - y_begin);
+
+						glm::vec3 colors[s_max_packet_size] = {};
+						aov_sample aov_sums[s_max_packet_size];
+						ray rays[s_max_packet_size];
+						raycast_result hits[s_max_packet_size];
+						const scene_node* hit_nodes[s_max_packet_size];
+
+						// One sample of every pixel of the block per packet
+						for (size_t s = 0; s < trace_params.samples_per_iteration && !self.is_interrupted(); ++s)
+						{
+							size_t k = 0;
+
+							for (uint32_t y = y_begin; y < y_end; ++y)
+							{
+								for (uint32_t x = x_begin; x < x_end; ++x)
+								{
+									const float fx = rng::next() - 0.5f + x;
+									const float fy = rng::next() - 0.5f + y;
+									rays[k++] = camera_ray(fx, fy);
+								}
+							}
+
+							RT_COUNT(ray_stats::local().add_rays(ray_type::primary, count));
+							scene.cast_packet(rays, count, hits, hit_nodes);
+
+							// Shading is per ray
+							for (k = 0; k < count; ++k)
+							{
+								aov_sample aov;
+								colors[k] += trace_from_hit(view_params, rays[k], hits[k], hit_nodes[k], scene, has_aovs ? &aov : nullptr);
+
+								if (has_aovs)
+									add_aov(aov_sums[k], aov);
+							}
+						}
+
+						size_t k = 0;
+
+						for (uint32_t y = y_begin; y < y_end; ++y)
+							for (uint32_t x = x_begin; x < x_end; ++x, ++k)
+								store_pixel(x, y, colors[k], aov_sums[k]);
+					}
+				};
+
+				// Per-thread counters, merged when the threads end
+				std::mutex stats_mutex;
+				ray_stats iteration_stats;
+
+				const auto trace_batch_band = [&](uint32_t y_begin, uint32_t y_end) {
+					const size_t count = size_t(y_end - y_begin) * line_rays;
+					std::vector<ray> rays;
+					std::vector<glm::vec3> colors(count);
+					std::vector<aov_sample> aovs(has_aovs ? count : 0);
+
+					// The samples of a pixel are contiguous
+					rays.reserve(count);
+
+					for (uint32_t y = y_begin; y < y_end; ++y)
+					{
+						for (uint32_t x = 0; x < view_params.width; ++x)
+						{
+							for (size_t s = 0; s < trace_params.samples_per_iteration; ++s)
+							{
+								const float fx = rng::next() - 0.5f + x;
+								const float fy = rng::next() - 0.5f + y;
+								rays.push_back(camera_ray(fx, fy));
+							}
+						}
+					}
+
+					RT_COUNT(ray_stats::local().add_rays(ray_type::primary, count));
+					trace_batch(view_params, rays.data(), count, scene, colors.data(), has_aovs ? aovs.data() : nullptr);
+
+					if (self.is_interrupted())
+						return;
+
+					size_t k = 0;
+
+					for (uint32_t y = y_begin; y < y_end; ++y)
+					{
+						for (uint32_t x = 0; x < view_params.width; ++x)
+						{
+							glm::vec3 color(0.0f);
+							aov_sample aov_sum;
+
+							for (size_t s = 0; s < trace_params.samples_per_iteration; ++s, ++k)
+							{
+								color += colors[k];
+
+								if (has_aovs)
+									add_aov(aov_sum, aovs[k]);
+							}
+
+							store_pixel(x, y, color, aov_sum);
+						}
+					}
+				};
+
+				const auto thread_func = [&] {
+					RT_PROFILE_ZONE("render thread");
+
+					// Sync here ?
+
+					for (auto band = next_band(); !self.is_interrupted() && band.has_value(); band = next_band())
+					{
+						RT_PROFILE_ZONE("band", int64_t(band.value()));
+
+						rng::seed(get_work_seed(seed, it.value(), band.value()));
+
+						if (packets)
+						{
+							trace_packets(band.value(), std::min(band.value() + band_height, view_params.height));
+							continue;
+						}
+
+						if (batch_lines > 0)
+						{
+							trace_batch_band(band.value(), std::min(band.value() + band_height, view_params.height));
+							continue;
+						}
+
+						const auto y = band.value();
+
+						if (positions > 0 && it.value() == 0)
+						{
+							// Warm-up: one stratified, jittered position per cell. Each line is filled by
+							// a single thread, before being sampled
+							const auto start = std::chrono::steady_clock::now();
+
+							for (uint32_t x = 0; x < view_params.width && !self.is_interrupted(); ++x)
+							{
+								for (uint32_t i = 0; i < positions; ++i)
+								{
+									const float fx = x - 0.5f + ((i % strata_x) + rng::next()) / strata_x;
+									const float fy = y - 0.5f + ((i / strata_x) + rng::next()) / strata_y;
+									const auto r = camera_ray(fx, fy);
+									RT_COUNT(ray_stats::local().add_rays(ray_type::primary));
+									const auto [result, node] = scene.cast_ray(r);
+
+									primary_hits[(size_t(y) * view_params.width + x) * positions + i] = { result, r.direction, node.get() };
+								}
+							}
+
+							warm_up_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+						}
 
 						for (uint32_t x = 0; x < view_params.width && !self.is_interrupted(); ++x)
 						{
 							glm::vec3 color(0.0f);
+							aov_sample aov_sum;
 
 							for (size_t s = 0; s < trace_params.samples_per_iteration && !self.is_interrupted(); ++s)
 							{
-								ray r;
-								
-								float fx = rng::next() - 0.5f + x;
-								float fy = rng::next() - 0.5f + y;
-								
-								float x_factor = fx / view_params.width * 2.0f - 1.0f;
-								float y_factor = 1.0f - fy / view_params.height * 2.0f;
-
-								r.origin = scene.camera.position;
-								r.direction = glm::normalize(forward + right * x_factor * w2 + up * y_factor * h2);
-								
-								color += trace(view_params, r, scene);
+								aov_sample aov;
+								aov_sample* aov_ptr = has_aovs ? &aov : nullptr;
+
+								if (positions > 0)
+								{
+									// Cycles through the cached positions over the samples of all iterations
+									const auto& hit = primary_hits[(size_t(y) * view_params.width + x) * positions + (it.value() * trace_params.samples_per_iteration + s) % positions];
+
+									ray r;
+									r.origin = scene.camera.position;
+									r.direction = hit.direction;
+									r.cone_angle = camera_ray.pixel_angle;
+
+									color += trace_from_hit(view_params, r, hit.result, hit.node, scene, aov_ptr);
+								}
+								else
+								{
+									const float fx = rng::next() - 0.5f + x;
+									const float fy = rng::next() - 0.5f + y;
+
+									RT_COUNT(ray_stats::local().add_rays(ray_type::primary));
+									color += trace(view_params, camera_ray(fx, fy), scene, aov_ptr);
+								}
+
+								if (has_aovs)
+									add_aov(aov_sum, aov);
 							}
 
-							auto prev_color = image.get_pixel(x, y);
-							auto next_color = glm::mix(color / float(trace_params.samples_per_iteration), prev_color, t);
-							image.set_pixel(x, y, next_color);
+							store_pixel(x, y, color, aov_sum);
 						}
 
 						// ScanLine end
 					}
+
+#if RT_RAY_STATS
+					std::lock_guard guard(stats_mutex);
+					iteration_stats.merge(ray_stats::local());
+					ray_stats::local() = ray_stats();
+#endif
 				};
 
 				std::vector<std::thread> threads(trace_params.num_threads);
 
 				for (size_t i = 0; i < threads.size(); ++i)
-					threads[i] = std::thread(thread_func, rng::next<std::uint32_t>(0u, std::numeric_limits<std::uint32_t>::max()));
+					threads[i] = std::thread(thread_func);
 
 				for (size_t i = 0; i < threads.size(); ++i)
 					threads[i].join();
 
+				if (positions > 0 && it.value() == 0)
+				{
+					spdlog::info("Primary hit cache: {0} primary rays traced in {1:.2f} s (all threads), {2} saved per iteration",
+						primary_hits.size(), warm_up_time / 1e9, size_t(view_params.width) * view_params.height * trace_params.samples_per_iteration);
+				}
+
+				{
+					std::lock_guard guard(self.m_stats_mutex);
+					self.m_ray_stats.merge(iteration_stats);
+				}
+
 				self.iteration = it.value();
 				self.samples_per_pixel += trace_params.samples_per_iteration;
 
 				// iteration End
-				self.on_iteration_end(image, it.value());
+				{
+					RT_PROFILE_ZONE("on_iteration_end", int64_t(it.value()));
+					self.on_iteration_end(image, it.value());
+				}
 
 
 			}
 
-			self.on_end(image);
+			{
+				auto stats = scene.get_memory_stats();
+				stats.framebuffers = self.m_framebuffer_bytes;
+				log_memory_stats("render end", stats);
+			}
+
+			{
+				RT_PROFILE_ZONE("on_end");
+				self.on_end(image);
+			}
 
 
-		});
+		}, trace_params.deferred_start);
 
 	}
 	
-	pathtracer_result::pathtracer_result(const fn& fn)
+	std::shared_ptr<pathtracer_result> abstract_pathtracer::run_tiled(const view_parameters& view_params, const trace_parameters& trace_params, scene& scene)
+	{
+		return std::make_shared<pathtracer_result>([&, trace_params, view_params](pathtracer_result& self) -> void {
+
+			if (trace_params.tile_handler)
+				self.on_tile_end.subscribe(trace_params.tile_handler);
+
+			const std::uint32_t seed = trace_params.seed ? *trace_params.seed : rng::next<std::uint32_t>(0u, std::numeric_limits<std::uint32_t>::max());
+
+			const camera_rays camera_ray(scene.camera, view_params);
+
+			const uint32_t tile_size = trace_params.tile_size;
+			const uint32_t tiles_x = (view_params.width + tile_size - 1) / tile_size;
+			const uint32_t tiles_y = (view_params.height + tile_size - 1) / tile_size;
+			const uint32_t tile_count = tiles_x * tiles_y;
+
+			// Every sample of a tile is traced at once, the iterations can't be endless
+			if (trace_params.iterations == 0)
+				spdlog::warn("Tiled renders need a number of iterations, 1 is used");
+
+			const uint64_t samples = std::max<uint64_t>(trace_params.iterations, 1) * trace_params.samples_per_iteration;
+			const float inv_samples = 1.0f / samples;
+			const bool has_aovs = !trace_params.aovs.empty();
+			const size_t batch_size = get_batch_size();
+
+			// Each thread holds the tile it renders
+			self.m_framebuffer_bytes = size_t(trace_params.num_threads) * tile_size * tile_size * (1 + trace_params.aovs.size()) * sizeof(glm::vec3);
+
+			spdlog::info("Tiled render: {0} x {1} tiles of {2} px", tiles_x, tiles_y, tile_size);
+
+			std::mutex tile_mutex;
+			uint32_t next_tile = 0;
+
+			// Serializes the handlers, the next tiles can be handed out meanwhile
+			std::mutex end_mutex;
+			uint32_t completed_tiles = 0;
+
+			// Per-thread counters, merged when the threads end
+			std::mutex stats_mutex;
+			ray_stats render_stats;
+
+			const auto thread_func = [&] {
+				RT_PROFILE_ZONE("render thread");
+
+				image_tile tile;
+
+				// Per-thread buffers of the batched tracers
+				std::vector<ray> rays;
+				std::vector<glm::vec3> colors, color_sums;
+				std::vector<aov_sample> aovs, aov_sums;
+
+				while (!self.is_interrupted())
+				{
+					uint32_t index;
+
+					{
+						std::lock_guard guard(tile_mutex);
+
+						if (next_tile == tile_count)
+							break;
+
+						index = next_tile++;
+					}
+
+					RT_PROFILE_ZONE("tile", int64_t(index));
+
+					rng::seed(get_work_seed(seed, 0, index));
+
+					tile.x = (index % tiles_x) * tile_size;
+					tile.y = (index / tiles_x) * tile_size;
+
+					const uint32_t width = std::min(tile_size, view_params.width - tile.x);
+					const uint32_t height = std::min(tile_size, view_params.height - tile.y);
+
+					tile.color.resize(width, height);
+
+					for (const auto channel : trace_params.aovs)
+						tile.aovs[channel].resize(width, height);
+
+					const auto store_pixel = [&](uint32_t x, uint32_t y, const glm::vec3& color, const aov_sample& aov_sum) {
+						tile.color.set_pixel(x, y, color * inv_samples);
+
+						for (auto& [channel, aov_image] : tile.aovs)
+						{
+							switch (channel)
+							{
+							case aov::albedo: aov_image.set_pixel(x, y, aov_sum.albedo * inv_samples); break;
+							case aov::normal: aov_image.set_pixel(x, y, aov_sum.normal * inv_samples); break;
+							case aov::depth: aov_image.set_pixel(x, y, glm::vec3(aov_sum.depth * inv_samples)); break;
+							}
+						}
+					};
+
+					if (batch_size > 0)
+					{
+						// Batched tracers get the samples of the tile by batches, the samples of a pixel are contiguous
+						const size_t count = size_t(width) * height * samples;
+
+						color_sums.assign(size_t(width) * height, glm::vec3(0.0f));
+						aov_sums.assign(has_aovs ? size_t(width) * height : 0, aov_sample());
+
+						for (size_t begin = 0; begin < count && !self.is_interrupted(); begin += batch_size)
+						{
+							const size_t batch = std::min(batch_size, count - begin);
+
+							rays.clear();
+
+							for (size_t k = begin; k < begin + batch; ++k)
+							{
+								const size_t pixel = k / samples;
+								const float fx = rng::next() - 0.5f + (tile.x + uint32_t(pixel % width));
+								const float fy = rng::next() - 0.5f + (tile.y + uint32_t(pixel / width));
+								rays.push_back(camera_ray(fx, fy));
+							}
+
+							colors.resize(batch);
+							aovs.resize(has_aovs ? batch : 0);
+
+							RT_COUNT(ray_stats::local().add_rays(ray_type::primary, batch));
+							trace_batch(view_params, rays.data(), batch, scene, colors.data(), has_aovs ? aovs.data() : nullptr);
+
+							for (size_t k = 0; k < batch; ++k)
+							{
+								const size_t pixel = (begin + k) / samples;
+								color_sums[pixel] += colors[k];
+
+								if (has_aovs)
+								{
+									aov_sums[pixel].albedo += aovs[k].albedo;
+									aov_sums[pixel].normal += aovs[k].normal;
+									aov_sums[pixel].depth += aovs[k].depth;
+								}
+							}
+						}
+
+						for (uint32_t y = 0; y < height; ++y)
+						{
+							for (uint32_t x = 0; x < width; ++x)
+							{
+								const size_t pixel = size_t(y) * width + x;
+								store_pixel(x, y, color_sums[pixel], has_aovs ? aov_sums[pixel] : aov_sample());
+							}
+						}
+					}
+					else
+					{
+						for (uint32_t y = 0; y < height && !self.is_interrupted(); ++y)
+						{
+							for (uint32_t x = 0; x < width && !self.is_interrupted(); ++x)
+							{
+								glm::vec3 color(0.0f);
+								aov_sample aov_sum;
+
+								for (uint64_t s = 0; s < samples && !self.is_interrupted(); ++s)
+								{
+									const float fx = rng::next() - 0.5f + (tile.x + x);
+									const float fy = rng::next() - 0.5f + (tile.y + y);
+
+									aov_sample aov;
+									RT_COUNT(ray_stats::local().add_rays(ray_type::primary));
+									color += trace(view_params, camera_ray(fx, fy), scene, has_aovs ? &aov : nullptr);
+
+									if (has_aovs)
+									{
+										aov_sum.albedo += aov.albedo;
+										aov_sum.normal += aov.normal;
+										aov_sum.depth += aov.depth;
+									}
+								}
+
+								store_pixel(x, y, color, aov_sum);
+							}
+						}
+					}
+
+					// Partial tiles are dropped
+					if (self.is_interrupted())
+						break;
+
+					{
+						RT_PROFILE_ZONE("on_tile_end", int64_t(index));
+						std::lock_guard guard(end_mutex);
+						self.progress = ++completed_tiles / float(tile_count);
+						self.on_tile_end(tile);
+					}
+				}
+
+#if RT_RAY_STATS
+				std::lock_guard guard(stats_mutex);
+				render_stats.merge(ray_stats::local());
+				ray_stats::local() = ray_stats();
+#endif
+			};
+
+			std::vector<std::thread> threads(trace_params.num_threads);
+
+			for (size_t i = 0; i < threads.size(); ++i)
+				threads[i] = std::thread(thread_func);
+
+			for (size_t i = 0; i < threads.size(); ++i)
+				threads[i].join();
+
+			{
+				std::lock_guard guard(self.m_stats_mutex);
+				self.m_ray_stats.merge(render_stats);
+			}
+
+			if (!self.is_interrupted())
+				self.samples_per_pixel = samples;
+
+			{
+				auto stats = scene.get_memory_stats();
+				stats.framebuffers = self.m_framebuffer_bytes;
+				log_memory_stats("render end", stats);
+			}
+
+			{
+				RT_PROFILE_ZONE("on_end");
+				self.on_end(image());
+			}
+		}, trace_params.deferred_start);
+	}
+
+	pathtracer_result::pathtracer_result(const fn& fn, bool deferred_start)
 	{
-		m_thread = std::thread([&, fn] { fn(*this); });
-		m_start_time = std::chrono::system_clock::now();
+		m_thread = std::thread([&, fn, started = m_start_signal.get_future()] {
+			started.wait();
+			fn(*this);
+		});
+
+		if (!deferred_start)
+			start();
 	}
 
 	pathtracer_result::~pathtracer_result()
 	{
 		if (m_thread.joinable())
+		{
+			// A process that was never started is released to end right away
+			std::call_once(m_started, [this] {
+				m_interrupted = true;
+				m_start_signal.set_value();
+			});
+
 			m_thread.join();
+		}
+	}
+
+	void pathtracer_result::start()
+	{
+		std::call_once(m_started, [this] {
+			m_start_time = std::chrono::system_clock::now();
+			m_start_signal.set_value();
+		});
+	}
+
+	const image* pathtracer_result::get_aov(aov channel) const
+	{
+		const auto it = m_aovs.find(channel);
+		return it != m_aovs.end() ? &it->second : nullptr;
+	}
+
+	ray_stats pathtracer_result::get_ray_stats() const
+	{
+		std::lock_guard guard(m_stats_mutex);
+		return m_ray_stats;
 	}
 
 	float pathtracer_result::get_elapsed_time() const
@@ -3,9 +3,12 @@
 #include <cinttypes>
 #include <memory>
 #include <future>
+#include <mutex>
 #include <atomic>
 #include <optional>
 #include <list>
+#include <map>
+#include <vector>
 #include <chrono>
 
 #include <glm/glm.hpp>
@@ -13,11 +16,13 @@
 
 #include "scene.h"
 #include "sampler.h"
+#include "ray_stats.h"
 
 namespace rt {
 
 	class scene;
 	class abstract_pathtracer;
+	struct image_tile;
 
 
 	/// <summary>
@@ -34,6 +39,7 @@ namespace rt {
 		using member_handler_fn = void(T::*)(Args...);
 
 	private:
+		std::mutex m_mutex;
 		std::list<handler_fn> m_handlers;
 	public:
 		/// <summary>
@@ -42,6 +48,7 @@ namespace rt {
 		/// <param name="fn">The handler function</param>
 		void subscribe(const handler_fn& fn)
 		{
+			std::lock_guard guard(m_mutex);
 			m_handlers.push_back(fn);
 		}
 
@@ -60,13 +67,14 @@ namespace rt {
 		}
 
 		/// <summary>
-		/// emit an event
+		/// emit an event. Handlers must not subscribe to the emitter that calls them
 		/// </summary>
 		/// <param name="...evt">The event's parameters</param>
 
 		template<typename... EvtArgs>
 		void emit(EvtArgs&&... evt)
 		{
+			std::lock_guard guard(m_mutex);
 			for (auto& h : m_handlers)
 				h(std::forward<EvtArgs>(evt)...);
 		}
@@ -94,6 +102,28 @@ namespace rt {
 		float fov_y = glm::pi<float>() / 4.0f;
 	};
 
+	/// <summary>
+	/// Auxiliary output channels. They are filled from the first hit of the camera
+	/// rays, in the same pass as the main image
+	/// </summary>
+	enum class aov : uint32_t
+	{
+		albedo,
+		normal,
+		depth
+	};
+
+	/// <summary>
+	/// First hit data for the auxiliary outputs. Tracers fill this when a non-null
+	/// pointer is given to "trace"
+	/// </summary>
+	struct aov_sample
+	{
+		glm::vec3 albedo = { 0.0f, 0.0f, 0.0f };
+		glm::vec3 normal = { 0.0f, 0.0f, 0.0f };
+		float depth = 0.0f;
+	};
+
 	/// <summary>
 	/// Tech parameters for the pathtracer
 	/// </summary>
@@ -102,6 +132,81 @@ namespace rt {
 		uint32_t num_threads = 4;
 		uint64_t iterations = 1;
 		uint64_t samples_per_iteration = 1;
+
+		/// <summary>
+		/// Auxiliary outputs to produce alongside the main image
+		/// </summary>
+		std::vector<rt::aov> aovs = {};
+
+		/// <summary>
+		/// Caches the first hit of the camera rays for a fixed set of subpixel positions, traced
+		/// during the first iteration and reused by the next ones. Only valid while the camera and
+		/// the scene don't change. Antialiasing is limited to these positions
+		/// </summary>
+		bool cache_primary_hits = false;
+
+		/// <summary>
+		/// Subpixel positions per pixel when caching the primary hits, stratified on a grid. Rounded up
+		/// to fill the grid (3 becomes 2x2, 5 becomes 3x2). Each costs about 64 bytes per pixel
+		/// </summary>
+		uint32_t primary_hit_positions = 16;
+
+		/// <summary>
+		/// Traces the camera rays of 4x4 pixel blocks as packets (see scene::cast_packet), then
+		/// shades them one by one with "trace_from_hit". Ignored when the primary hits are cached
+		/// </summary>
+		bool primary_packets = false;
+
+		/// <summary>
+		/// Seeds the render for repeatable runs: each band of lines (or tile) of each iteration
+		/// seeds the generator from it, whichever thread traces it
+		/// </summary>
+		std::optional<uint32_t> seed;
+
+		/// <summary>
+		/// When non-zero, renders the image by square tiles of this size, each with all its samples
+		/// before the next one, instead of iterating over the whole image. The finished tiles are
+		/// handed to pathtracer_result::on_tile_end and not kept, so the framebuffer only holds the
+		/// tiles being rendered. Tiles are traced pixel by pixel with "trace", or by batches with
+		/// "trace_batch" for batched tracers: the primary hit cache and packets are not used.
+		/// "iterations" must not be 0
+		/// </summary>
+		uint32_t tile_size = 0;
+
+		/// <summary>
+		/// Subscribed to pathtracer_result::on_tile_end before the first tile is handed out. Tiles
+		/// can end before "run" returns, handlers subscribed afterwards may miss them
+		/// </summary>
+		std::function<void(const image_tile&)> tile_handler;
+
+		/// <summary>
+		/// When true, the process waits for pathtracer_result::start, so that handlers can be
+		/// subscribed before the first event. Otherwise it starts in "run", and short renders may
+		/// emit their events before the handlers are subscribed
+		/// </summary>
+		bool deferred_start = false;
+	};
+
+	/// <summary>
+	/// A finished tile of a tiled render, see trace_parameters::tile_size
+	/// </summary>
+	struct image_tile
+	{
+		/// <summary>
+		/// Position of the top left pixel of the tile in the image
+		/// </summary>
+		uint32_t x = 0;
+		uint32_t y = 0;
+
+		/// <summary>
+		/// The pixels of the tile, smaller than the tile size on the right and bottom edges of the image
+		/// </summary>
+		image color;
+
+		/// <summary>
+		/// The auxiliary outputs of the tile
+		/// </summary>
+		std::map<aov, image> aovs;
 	};
 
 	/// <summary>
@@ -127,13 +232,18 @@ namespace rt {
 		/// </summary>
 		std::atomic_uint64_t samples_per_pixel = 0;
 
-		pathtracer_result(const fn& fn);
+		pathtracer_result(const fn& fn, bool deferred_start = false);
 		~pathtracer_result();
+
+		/// <summary>
+		/// Starts a process created with trace_parameters::deferred_start. Does nothing if it's already started
+		/// </summary>
+		void start();
 		
 		/// <summary>
-		/// Wait until the end of the process
+		/// Wait until the end of the process, starting it if needed
 		/// </summary>
-		void wait() { m_thread.join(); }
+		void wait() { start(); m_thread.join(); }
 
 		/// <summary>
 		/// Interrupts the process
@@ -151,6 +261,22 @@ namespace rt {
 		/// <returns>Time since start in seconds</returns>
 		float get_elapsed_time() const;
 
+		/// <summary>
+		/// Returns the auxiliary output for the given channel, or nullptr if it wasn't requested or the
+		/// render is tiled. The content is consistent only inside the event handlers or when the process is complete
+		/// </summary>
+		const image* get_aov(aov channel) const;
+
+		/// <summary>
+		/// Returns the ray tracing counters of the completed iterations (all zeros if RT_RAY_STATS is 0)
+		/// </summary>
+		ray_stats get_ray_stats() const;
+
+		/// <summary>
+		/// Returns the memory used by the render target, the auxiliary outputs and the primary hit cache
+		/// </summary>
+		size_t get_framebuffer_size_in_bytes() const { return m_framebuffer_bytes; }
+
 		/// <summary>
 		/// Event: fires when a new iteration starts
 		/// </summary>
@@ -163,14 +289,29 @@ namespace rt {
 		
 
 		/// <summary>
-		/// Event: fires when the process is complete
+		/// Event: fires when a tile of a tiled render is complete, on the render thread that traced it.
+		/// Calls are serialized, tiles come in no particular order. Iteration events don't fire in tiled renders
+		/// </summary>
+		event_emitter<const image_tile&> on_tile_end;
+
+		/// <summary>
+		/// Event: fires when the process is complete. The image is empty in tiled renders
 		/// </summary>
 		event_emitter<const image&> on_end;
 
 	private:
+		friend class abstract_pathtracer;
+
 		std::thread m_thread;
+		std::promise<void> m_start_signal;
+		std::once_flag m_started;
 		std::atomic_bool m_interrupted = false;
 		std::chrono::system_clock::time_point m_start_time;
+		std::map<aov, image> m_aovs;
+		std::atomic<size_t> m_framebuffer_bytes = 0;
+
+		mutable std::mutex m_stats_mutex;
+		ray_stats m_ray_stats;
 	};
 
 	/// <summary>
@@ -190,13 +331,59 @@ namespace rt {
 		std::shared_ptr<pathtracer_result> run(const view_parameters& view_params, const trace_parameters& trace_params, scene& scene);
 		
 		/// <summary>
-		/// Trace a screen ray (ai, a ray cast from the camera through a pixel) and returns its radiance
+		/// Trace a screen ray (ai, a ray cast from the camera through a pixel) and returns its radiance.
+		/// Screen rays are counted in the ray stats by "run", implementations only count the rays they bounce
 		/// </summary>
 		/// <param name="params">The view parameters</param>
 		/// <param name="ray">The ray</param>
 		/// <param name="scene">The scene</param>
+		/// <param name="aov">If not null, must be filled with the first hit data</param>
 		/// <returns>A color representing the radiance</returns>
-		virtual glm::vec3 trace(const view_parameters& params, const ray& ray, const scene& scene) = 0;
+		virtual glm::vec3 trace(const view_parameters& params, const ray& ray, const scene& scene, aov_sample* aov) = 0;
+
+		/// <summary>
+		/// Same as "trace", for a screen ray whose first hit is already known (see trace_parameters::cache_primary_hits).
+		/// The default implementation traces the ray again
+		/// </summary>
+		/// <param name="params">The view parameters</param>
+		/// <param name="ray">The ray</param>
+		/// <param name="hit">The first hit of the ray</param>
+		/// <param name="node">The node hit, nullptr if nothing was hit</param>
+		/// <param name="scene">The scene</param>
+		/// <param name="aov">If not null, must be filled with the first hit data</param>
+		/// <returns>A color representing the radiance</returns>
+		virtual glm::vec3 trace_from_hit(const view_parameters& params, const ray& ray, const raycast_result& hit, const scene_node* node, const scene& scene, aov_sample* aov)
+		{
+			return trace(params, ray, scene, aov);
+		}
+
+		/// <summary>
+		/// Number of screen rays "trace_batch" wants at once. When non-zero, "run" generates the camera
+		/// rays of whole bands of lines and traces them with "trace_batch". Ignored when the primary hits
+		/// are cached or traced as packets, which shade the rays one by one with "trace_from_hit"
+		/// </summary>
+		virtual size_t get_batch_size() const { return 0; }
+
+		/// <summary>
+		/// Traces a batch of screen rays. The default implementation calls "trace" on each ray
+		/// </summary>
+		/// <param name="params">The view parameters</param>
+		/// <param name="rays">The rays</param>
+		/// <param name="count">The number of rays</param>
+		/// <param name="scene">The scene</param>
+		/// <param name="radiance">The radiance of each ray</param>
+		/// <param name="aovs">If not null, the first hit data of each ray</param>
+		virtual void trace_batch(const view_parameters& params, const ray* rays, size_t count, const scene& scene, glm::vec3* radiance, aov_sample* aovs)
+		{
+			for (size_t i = 0; i < count; ++i)
+				radiance[i] = trace(params, rays[i], scene, aovs ? &aovs[i] : nullptr);
+		}
+
+	private:
+		/// <summary>
+		/// Renders tile by tile, see trace_parameters::tile_size. The scene is already compiled
+		/// </summary>
+		std::shared_ptr<pathtracer_result> run_tiled(const view_parameters& view_params, const trace_parameters& trace_params, scene& scene);
 	};
 
 }
\ No newline at end of file
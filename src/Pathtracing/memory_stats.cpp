@@ -0,0 +1,70 @@
+#include "memory_stats.h"
+
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace rt
+{
+	namespace
+	{
+		double to_mb(size_t bytes)
+		{
+			return bytes / (1024.0 * 1024.0);
+		}
+	}
+
+	void log_memory_stats(std::string_view stage, const memory_stats& stats)
+	{
+		spdlog::info("Memory ({0}): {1:.1f} MB meshes, {2:.1f} MB acceleration, {3:.1f} MB textures, {4:.1f} MB texture cache, {5:.1f} MB framebuffers, {6:.1f} MB total",
+			stage, to_mb(stats.meshes), to_mb(stats.acceleration), to_mb(stats.textures), to_mb(stats.texture_cache), to_mb(stats.framebuffers), to_mb(stats.get_total()));
+		spdlog::info("Process memory: {0:.1f} MB resident, {1:.1f} MB peak", to_mb(get_current_rss()), to_mb(get_peak_rss()));
+	}
+
+	size_t get_current_rss()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+		// Second field: resident pages
+		std::ifstream statm("/proc/self/statm");
+		size_t pages = 0, resident = 0;
+
+		if (statm >> pages >> resident)
+			return resident * size_t(sysconf(_SC_PAGESIZE));
+
+		return 0;
+#endif
+	}
+
+	size_t get_peak_rss()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+		rusage usage;
+
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+
+#ifdef __APPLE__
+		return size_t(usage.ru_maxrss);
+#else
+		// In KB on Linux
+		return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace rt
+{
+	/// <summary>
+	/// Memory used by the main data structures, in bytes. Explicit sizes of the containers, not
+	/// allocator measures: the allocation overhead is not included
+	/// </summary>
+	struct memory_stats
+	{
+		/// <summary>
+		/// Vertices, indices and triangle intersection data of the meshes
+		/// </summary>
+		size_t meshes = 0;
+
+		/// <summary>
+		/// KD-tree nodes and triangle references
+		/// </summary>
+		size_t acceleration = 0;
+
+		/// <summary>
+		/// Images of the materials and the background, mipmaps included
+		/// </summary>
+		size_t textures = 0;
+
+		/// <summary>
+		/// Tiles of the streamed textures currently in the texture cache
+		/// </summary>
+		size_t texture_cache = 0;
+
+		/// <summary>
+		/// Render target, auxiliary outputs and primary hit cache
+		/// </summary>
+		size_t framebuffers = 0;
+
+		size_t get_total() const { return meshes + acceleration + textures + texture_cache + framebuffers; }
+	};
+
+	/// <summary>
+	/// Logs the given stats and the resident set size of the process
+	/// </summary>
+	/// <param name="stage">When the stats were taken, e.g. "scene compiled"</param>
+	/// <param name="stats">The stats</param>
+	void log_memory_stats(std::string_view stage, const memory_stats& stats);
+
+	/// <summary>
+	/// Returns the physical memory currently used by the process, 0 if unknown
+	/// </summary>
+	size_t get_current_rss();
+
+	/// <summary>
+	/// Returns the maximum physical memory used by the process so far, 0 if unknown
+	/// </summary>
+	size_t get_peak_rss();
+}
@@ -5,67 +5,103 @@
 #include <glm/gtx/norm.hpp>
 
 #include "scene.h"
+#include "ray_stats.h"
 
 
 namespace rt
 {
 
 
-	glm::vec3 pathtracer::trace(const view_parameters& params, const ray& r, const scene& scene)
+	glm::vec3 pathtracer::trace(const view_parameters& params, const ray& r, const scene& scene, aov_sample* aov)
 	{
-		return trace_recursive(params, r, scene, 5);
+		return trace_recursive(params, r, scene, s_max_recursion, aov);
 	}
 
-	glm::vec3 pathtracer::trace_recursive(const view_parameters& params, const ray& r, const scene& scene, uint32_t recursion)
+	glm::vec3 pathtracer::trace_from_hit(const view_parameters& params, const ray& r, const raycast_result& hit, const scene_node* node, const scene& scene, aov_sample* aov)
+	{
+		return shade(params, r, hit, node, scene, s_max_recursion, aov);
+	}
+
+	glm::vec3 pathtracer::trace_recursive(const view_parameters& params, const ray& r, const scene& scene, uint32_t recursion, aov_sample* aov)
 	{
 		if (recursion == 0)
 		{
+			RT_COUNT(ray_stats::local().add_path(s_max_recursion));
+
 			// Could return the background, but it wouldn't be correct
 			return glm::vec3(0.0f);
 		}
 		else
 		{
+			// Screen rays are counted by run
+			if (recursion != s_max_recursion)
+				RT_COUNT(ray_stats::local().add_rays(ray_type::secondary));
+
 			// Cast the ray on the scene
 			const auto [result, node] = scene.cast_ray(r);
+			return shade(params, r, result, node.get(), scene, recursion, aov);
+		}
+	}
+
+	glm::vec3 pathtracer::shade(const view_parameters& params, const ray& r, const raycast_result& result, const scene_node* node, const scene& scene, uint32_t recursion, aov_sample* aov)
+	{
+		if (result.hit)
+		{
+			// Project the ray cone on the surface to get the texture footprint
+			const float distance = glm::length(result.position - r.origin);
+			const float cone_width = r.cone_width + r.cone_angle * distance;
+			const float cosine = glm::max(glm::abs(glm::dot(r.direction, result.normal)), s_min_cone_cosine);
+			const float footprint = cone_width * result.uv_density / cosine;
+
+			// Gather material properties
+			const auto [albedo, emission, roughness, metallic] = scene.get_material(*node).sample(result.uv, footprint);
 
-			if (result.hit)
+			// Only the first hit is recorded in the auxiliary outputs
+			if (aov)
 			{
-				// Gather material properties
-				const auto albedo = node->material.albedo->sample(result.uv);
-				const auto emission = node->material.emission->sample(result.uv);
-				const float roughness = node->material.roughness->sample(result.uv).r;
-				const float metallic = node->material.metallic->sample(result.uv).r;
+				aov->albedo = albedo;
+				aov->normal = result.normal;
+				aov->depth = distance;
+			}
 
-				// Compute a random ray on the hemisphere + a perfect reflection ray
-				const auto hemi_dir = rng::hemisphere(result.normal);
-				const auto reflect_dir = glm::reflect(r.direction, result.normal);
+			// Compute a random ray on the hemisphere + a perfect reflection ray
+			const auto hemi_dir = rng::hemisphere(result.normal);
+			const auto reflect_dir = glm::reflect(r.direction, result.normal);
 
-				// Mix the perfect reflection and the random ray based on the roughness of the material
-				// This approach is not described anywhere, but works pretty well for handling the roughness
-				const auto dir = glm::normalize(glm::mix(reflect_dir, hemi_dir, roughness));
+			// Mix the perfect reflection and the random ray based on the roughness of the material
+			// This approach is not described anywhere, but works pretty well for handling the roughness
+			const auto dir = glm::normalize(glm::mix(reflect_dir, hemi_dir, roughness));
 
-				ray reflected_ray = {
-					result.position + dir * s_epsilon,
-					dir
+			// Rough bounces widen the ray cone, so the next hits fall back to coarser mip levels
+			ray reflected_ray = {
+				result.position + dir * s_epsilon,
+				dir,
+				cone_width,
+				r.cone_angle + roughness * s_rough_cone_angle
+			};
 
-				};
+			// Compute the lighting (Lambert BRDF)
+			const auto cos_theta = glm::max(0.0f, glm::dot(reflected_ray.direction, result.normal));
 
-				// Compute the lighting (Lambert BRDF)
-				const auto cos_theta = glm::max(0.0f, glm::dot(reflected_ray.direction, result.normal));
+			const auto radiance = trace_recursive(params, reflected_ray, scene, recursion - 1, nullptr);
 
-				const auto radiance = trace_recursive(params, reflected_ray, scene, recursion - 1);
+			// The albedo is mixed with white based on the metalness of the surface. A metallic surface
+			// should only reflect light
+			auto color = emission + glm::mix(albedo, glm::vec3(1.0f), metallic) * radiance * cos_theta * 2.0f;
 
-				// The albedo is mixed with white based on the metalness of the surface. A metallic surface
-				// should only reflect light
-				auto color = emission + glm::mix(albedo, glm::vec3(1.0f), metallic) * radiance * cos_theta * 2.0f;
+			return color;
+		}
+		else
+		{	
+			RT_COUNT(ray_stats::local().add_path(s_max_recursion - recursion + 1));
 
-				return color;
-			}
-			else
-			{	
-				// If nothing is hit, sample the background
-				return scene.background->sample(r.direction);
-			}
+			// If nothing is hit, sample the background
+			const auto background = scene.background->sample(r.direction);
+
+			if (aov)
+				aov->albedo = background;
+
+			return background;
 		}
 	}
 }
\ No newline at end of file
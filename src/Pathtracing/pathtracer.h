@@ -13,11 +13,34 @@ namespace rt
 	class pathtracer : public abstract_pathtracer
 	{
 	public:
-		glm::vec3 trace(const view_parameters& params, const ray& r, const scene& scene) override;
+		glm::vec3 trace(const view_parameters& params, const ray& r, const scene& scene, aov_sample* aov) override;
+		glm::vec3 trace_from_hit(const view_parameters& params, const ray& r, const raycast_result& hit, const scene_node* node, const scene& scene, aov_sample* aov) override;
 	
 	private:
 		static constexpr float s_epsilon = 1e-3f;
-		glm::vec3 trace_recursive(const view_parameters& params, const ray& r, const scene& scene, uint32_t recursion);
+
+		/// <summary>
+		/// Number of bounces of a path, the camera ray included
+		/// </summary>
+		static constexpr uint32_t s_max_recursion = 5;
+
+		/// <summary>
+		/// Spread added to the ray cone by a fully rough bounce. Diffuse bounces are averaged over
+		/// many samples, so a wide cone (ie, coarse mip levels) is enough
+		/// </summary>
+		static constexpr float s_rough_cone_angle = 0.25f;
+
+		/// <summary>
+		/// Minimum cosine used when projecting the ray cone on a surface, to limit the footprint at grazing angles
+		/// </summary>
+		static constexpr float s_min_cone_cosine = 0.1f;
+
+		glm::vec3 trace_recursive(const view_parameters& params, const ray& r, const scene& scene, uint32_t recursion, aov_sample* aov);
+
+		/// <summary>
+		/// Computes the radiance along a ray given its closest hit (node is nullptr if nothing was hit)
+		/// </summary>
+		glm::vec3 shade(const view_parameters& params, const ray& r, const raycast_result& result, const scene_node* node, const scene& scene, uint32_t recursion, aov_sample* aov);
 
 	};
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+namespace rt
+{
+	namespace
+	{
+		/// <summary>
+		/// Writes a string as a JSON string
+		/// </summary>
+		void write_json_string(std::ostream& out, const char* s)
+		{
+			out << '"';
+
+			for (; *s; ++s)
+			{
+				if (*s == '"' || *s == '\\')
+					out << '\\';
+
+				out << *s;
+			}
+
+			out << '"';
+		}
+	}
+
+	profiler& profiler::get_instance()
+	{
+		static profiler s_instance;
+		return s_instance;
+	}
+
+	uint64_t profiler::now() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+	}
+
+	void profiler::record(thread_buffer& buffer, const event& e)
+	{
+		// Single writer: the slot is filled before the count makes it visible
+		const auto count = buffer.count.load(std::memory_order_relaxed);
+		buffer.events[count % s_buffer_size] = e;
+		buffer.count.store(count + 1, std::memory_order_release);
+	}
+
+	profiler::thread_handle::~thread_handle()
+	{
+		if (buffer)
+		{
+			auto& p = profiler::get_instance();
+			std::lock_guard<std::mutex> lock(p.m_mutex);
+			p.m_free_buffers.push_back(buffer);
+		}
+	}
+
+	profiler::thread_buffer& profiler::get_thread_buffer()
+	{
+		static thread_local thread_handle t_handle;
+
+		if (!t_handle.buffer)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (!m_free_buffers.empty())
+			{
+				// The lowest row first, to keep the timeline compact
+				const auto it = std::min_element(m_free_buffers.begin(), m_free_buffers.end(), [](const thread_buffer* a, const thread_buffer* b) {
+					return a->id < b->id;
+				});
+
+				t_handle.buffer = *it;
+				m_free_buffers.erase(it);
+			}
+			else
+			{
+				auto buffer = std::make_unique<thread_buffer>();
+				buffer->id = uint32_t(m_buffers.size() + 1);
+				buffer->events.resize(s_buffer_size);
+				t_handle.buffer = buffer.get();
+				m_buffers.push_back(std::move(buffer));
+			}
+		}
+
+		return *t_handle.buffer;
+	}
+
+	bool profiler::write_chrome_trace(std::string_view file_name) const
+	{
+		std::ofstream out{ std::string(file_name) };
+
+		if (!out)
+			return false;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+
+		for (const auto& buffer : m_buffers)
+		{
+			const auto count = buffer->count.load(std::memory_order_acquire);
+			const auto begin = count > s_buffer_size ? count - s_buffer_size : 0;
+
+			for (auto i = begin; i < count; ++i)
+			{
+				const auto& e = buffer->events[i % s_buffer_size];
+
+				out << (first ? "" : ",\n") << "{\"name\":";
+				write_json_string(out, e.name);
+				out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+					<< ",\"ts\":" << e.start_ns / 1000 << "." << (e.start_ns % 1000) / 100
+					<< ",\"dur\":" << e.duration_ns / 1000 << "." << (e.duration_ns % 1000) / 100;
+
+				if (e.arg != s_no_arg)
+					out << ",\"args\":{\"value\":" << e.arg << "}";
+
+				out << "}";
+				first = false;
+			}
+		}
+
+		out << "\n]}\n";
+		return bool(out);
+	}
+}
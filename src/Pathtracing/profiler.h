@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#define RT_PROFILE_CONCAT_IMPL(a, b) a##b
+#define RT_PROFILE_CONCAT(a, b) RT_PROFILE_CONCAT_IMPL(a, b)
+
+/// <summary>
+/// Profiles the rest of the enclosing scope. The name must be a string literal
+/// </summary>
+#define RT_PROFILE_ZONE(...) ::rt::profile_zone RT_PROFILE_CONCAT(rt_profile_zone_, __LINE__)(__VA_ARGS__)
+
+namespace rt
+{
+	/// <summary>
+	/// Records timed zones of all the threads, to be dumped as a Chrome trace (chrome://tracing, Perfetto).
+	/// Each thread writes to its own ring buffer without locking, the oldest events are overwritten when
+	/// it's full. Buffers of ended threads are reused by new ones, so a timeline row may show several
+	/// successive threads (e.g. the render threads of successive iterations)
+	/// </summary>
+	class profiler
+	{
+	public:
+		/// <summary>
+		/// Events kept per thread
+		/// </summary>
+		static constexpr size_t s_buffer_size = size_t(1) << 15;
+
+		/// <summary>
+		/// Value of event::arg when there's no argument
+		/// </summary>
+		static constexpr int64_t s_no_arg = INT64_MIN;
+
+		/// <summary>
+		/// A completed zone
+		/// </summary>
+		struct event
+		{
+			const char* name;
+			uint64_t start_ns;
+			uint64_t duration_ns;
+			int64_t arg;
+		};
+
+		profiler(const profiler&) = delete;
+		profiler& operator=(const profiler&) = delete;
+
+		/// <summary>
+		/// Returns the profiler of this process
+		/// </summary>
+		static profiler& get_instance();
+
+		/// <summary>
+		/// Starts or stops recording. Disabled zones cost a relaxed atomic load
+		/// </summary>
+		void set_enabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+		bool is_enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+		/// <summary>
+		/// Returns the time since the profiler was created
+		/// </summary>
+		uint64_t now() const;
+
+		/// <summary>
+		/// Writes the recorded events as Chrome trace JSON. Must not be called while zones are being recorded
+		/// </summary>
+		/// <param name="file_name">The output file</param>
+		/// <returns>true on success</returns>
+		bool write_chrome_trace(std::string_view file_name) const;
+
+	private:
+		friend class profile_zone;
+
+		struct thread_buffer
+		{
+			uint32_t id = 0;
+			std::vector<event> events;
+
+			/// <summary>
+			/// Events written so far, only written by the owning thread
+			/// </summary>
+			std::atomic<uint64_t> count{ 0 };
+		};
+
+		/// <summary>
+		/// Gives a buffer back to the profiler when its thread ends
+		/// </summary>
+		struct thread_handle
+		{
+			thread_buffer* buffer = nullptr;
+			~thread_handle();
+		};
+
+		std::atomic<bool> m_enabled{ false };
+		std::chrono::steady_clock::time_point m_epoch = std::chrono::steady_clock::now();
+
+		mutable std::mutex m_mutex;
+		std::vector<std::unique_ptr<thread_buffer>> m_buffers;
+		std::vector<thread_buffer*> m_free_buffers;
+
+		profiler() = default;
+
+		/// <summary>
+		/// Returns the buffer of the calling thread, taking one on first use. A thread takes its
+		/// buffer when it opens its first zone, after the previous owner of the buffer ended
+		/// </summary>
+		thread_buffer& get_thread_buffer();
+
+		static void record(thread_buffer& buffer, const event& e);
+	};
+
+	/// <summary>
+	/// Records the time between its construction and destruction, see RT_PROFILE_ZONE
+	/// </summary>
+	class profile_zone
+	{
+	public:
+		/// <summary>
+		/// Starts a zone
+		/// </summary>
+		/// <param name="name">The name, a string literal</param>
+		/// <param name="arg">A value shown with the zone, e.g. an iteration</param>
+		explicit profile_zone(const char* name, int64_t arg = profiler::s_no_arg) : m_name(name), m_arg(arg)
+		{
+			auto& p = profiler::get_instance();
+
+			if (p.is_enabled())
+			{
+				m_buffer = &p.get_thread_buffer();
+				m_start = p.now();
+			}
+		}
+
+		profile_zone(const profile_zone&) = delete;
+		profile_zone& operator=(const profile_zone&) = delete;
+
+		~profile_zone()
+		{
+			if (m_buffer)
+			{
+				const auto end = profiler::get_instance().now();
+				profiler::record(*m_buffer, { m_name, m_start, end - m_start, m_arg });
+			}
+		}
+
+	private:
+		const char* m_name;
+		int64_t m_arg;
+		profiler::thread_buffer* m_buffer = nullptr;
+		uint64_t m_start = 0;
+	};
+}
@@ -0,0 +1,50 @@
+#include "ray_stats.h"
+
+namespace rt
+{
+	uint64_t ray_stats::get_total_rays() const
+	{
+		uint64_t total = 0;
+
+		for (const auto count : rays)
+			total += count;
+
+		return total;
+	}
+
+	uint64_t ray_stats::get_path_count() const
+	{
+		uint64_t total = 0;
+
+		for (const auto count : path_lengths)
+			total += count;
+
+		return total;
+	}
+
+	double ray_stats::get_average_path_length() const
+	{
+		uint64_t paths = 0, segments = 0;
+
+		for (uint32_t length = 0; length < path_lengths.size(); ++length)
+		{
+			paths += path_lengths[length];
+			segments += path_lengths[length] * length;
+		}
+
+		return paths > 0 ? double(segments) / paths : 0.0;
+	}
+
+	void ray_stats::merge(const ray_stats& other)
+	{
+		for (size_t i = 0; i < rays.size(); ++i)
+			rays[i] += other.rays[i];
+
+		nodes_visited += other.nodes_visited;
+		triangles_tested += other.triangles_tested;
+		hits += other.hits;
+
+		for (size_t i = 0; i < path_lengths.size(); ++i)
+			path_lengths[i] += other.path_lengths[i];
+	}
+}
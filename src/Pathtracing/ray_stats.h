@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+
+// Ray tracing counters, define RT_RAY_STATS as 0 to compile them out
+#ifndef RT_RAY_STATS
+#define RT_RAY_STATS 1
+#endif
+
+#if RT_RAY_STATS
+#define RT_COUNT(expr) (expr)
+#else
+#define RT_COUNT(expr) ((void)0)
+#endif
+
+namespace rt
+{
+	/// <summary>
+	/// Kinds of rays cast on a scene
+	/// </summary>
+	enum class ray_type : uint32_t
+	{
+		/// <summary>
+		/// Camera rays
+		/// </summary>
+		primary,
+
+		/// <summary>
+		/// Rays bounced off a surface
+		/// </summary>
+		secondary,
+
+		count
+	};
+
+	/// <summary>
+	/// Counters of the ray tracing work. Each thread has its own counters (see "local"), increment
+	/// them through RT_COUNT so that they can be compiled out. Traversal counters are accumulated
+	/// in locals and added once per ray, the hot loops don't touch thread local storage
+	/// </summary>
+	struct ray_stats
+	{
+		/// <summary>
+		/// Longest path length tracked by the histogram
+		/// </summary>
+		static constexpr uint32_t s_max_path_length = 15;
+
+		/// <summary>
+		/// Rays cast, by type
+		/// </summary>
+		std::array<uint64_t, size_t(ray_type::count)> rays = {};
+
+		/// <summary>
+		/// Acceleration structure nodes whose bounds were tested. A packet counts once per node
+		/// </summary>
+		uint64_t nodes_visited = 0;
+
+		/// <summary>
+		/// Ray-triangle tests. A packet counts once per triangle
+		/// </summary>
+		uint64_t triangles_tested = 0;
+
+		/// <summary>
+		/// Rays that hit something
+		/// </summary>
+		uint64_t hits = 0;
+
+		/// <summary>
+		/// Paths by number of rays cast, from 0 to s_max_path_length (longer paths included)
+		/// </summary>
+		std::array<uint64_t, s_max_path_length + 1> path_lengths = {};
+
+		void add_rays(ray_type type, uint64_t count = 1) { rays[size_t(type)] += count; }
+		void add_path(uint32_t length) { ++path_lengths[std::min(length, s_max_path_length)]; }
+
+		uint64_t get_total_rays() const;
+		uint64_t get_path_count() const;
+		double get_average_path_length() const;
+
+		/// <summary>
+		/// Adds the given counters to these ones
+		/// </summary>
+		void merge(const ray_stats& other);
+
+		/// <summary>
+		/// Returns the counters of the calling thread
+		/// </summary>
+		static ray_stats& local() { return s_local; }
+
+	private:
+		static thread_local ray_stats s_local;
+	};
+
+	// Defined here so that the counters are accessed directly, not through a TLS wrapper call
+	inline thread_local ray_stats ray_stats::s_local;
+}
@@ -1,15 +1,20 @@
 #include "sampler.h"
+#include "texel.h"
 
 #include <numeric>
+#include <array>
+#include <cstring>
 
 #include <spdlog/spdlog.h>
 
 #include <glm/ext.hpp>
+#include <glm/gtc/packing.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 namespace rt {
+
 	image::image() : image(0, 0)
 	{
 	}
@@ -17,13 +22,14 @@ namespace rt {
 		m_width(width),
 		m_height(height)
 	{
-		m_pixels.resize(width * height);
+		m_texels.resize(storage_size(m_layout, m_width, m_height) * texel_size(m_format));
 	}
 	void image::resize(size_t width, size_t height)
 	{
 		m_width = width;
 		m_height = height;
-		m_pixels.resize(width * height);
+		m_texels.resize(storage_size(m_layout, m_width, m_height) * texel_size(m_format));
+		m_mips.clear();
 	}
 	glm::vec3 image::average() const
 	{
@@ -35,38 +41,161 @@ namespace rt {
 	}
 	glm::vec3 image::sample(const glm::vec2& uv) const
 	{
+		return sample_level(0, uv);
+	}
+
+	glm::vec3 image::sample(const glm::vec2& uv, float footprint) const
+	{
+		if (m_mips.empty() || footprint <= 0.0f)
+			return sample_level(0, uv);
+
+		// Level 0 is selected when the footprint covers at most one texel
+		const float lod = glm::log2(footprint * std::max(m_width, m_height));
+
+		if (lod <= 0.0f)
+			return sample_level(0, uv);
+
+		if (lod >= m_mips.size())
+			return sample_level(m_mips.size(), uv);
+
+		const size_t level = size_t(lod);
+
+		if (sample_mode == sample_mode::nearest)
+			return sample_level(level, uv);
+
+		return glm::mix(sample_level(level, uv), sample_level(level + 1, uv), lod - level);
+	}
+
+	glm::vec3 image::sample_level(size_t level, const glm::vec2& uv) const
+	{
+		// Dispatch once per lookup, so that the texel decoding is inlined
+		switch (m_format)
+		{
+		case texel_format::rgba8_srgb: return sample_level<texel_format::rgba8_srgb>(level, uv);
+		case texel_format::rgb16f: return sample_level<texel_format::rgb16f>(level, uv);
+		case texel_format::rgb9e5: return sample_level<texel_format::rgb9e5>(level, uv);
+		default: return sample_level<texel_format::rgb32f>(level, uv);
+		}
+	}
+
+	template<texel_format Format>
+	glm::vec3 image::sample_level(size_t level, const glm::vec2& uv) const
+	{
+		const uint32_t width = level == 0 ? m_width : m_mips[level - 1].width;
+		const uint32_t height = level == 0 ? m_height : m_mips[level - 1].height;
+		const uint8_t* texels = level == 0 ? m_texels.data() : m_mips[level - 1].texels.data();
+
 		const auto uv0 = glm::fract(uv);
 
-		const float x = uv0.x * m_width;
-		const float y = uv0.y * m_height;
+		const float x = uv0.x * width;
+		const float y = uv0.y * height;
+
+		const auto fetch = [&](uint32_t px, uint32_t py) {
+			return decode<Format>(texels, pixel_index(m_layout, px, py, width));
+		};
 
 		if (sample_mode == sample_mode::linear)
 		{
-			const uint32_t x0 = uint32_t(glm::floor(x)) % m_width;
-			const uint32_t x1 = uint32_t(glm::ceil(x)) % m_width;
-			const uint32_t y0 = uint32_t(glm::floor(y)) % m_height;
-			const uint32_t y1 = uint32_t(glm::ceil(y)) % m_height;
+			const uint32_t x0 = uint32_t(glm::floor(x)) % width;
+			const uint32_t x1 = uint32_t(glm::ceil(x)) % width;
+			const uint32_t y0 = uint32_t(glm::floor(y)) % height;
+			const uint32_t y1 = uint32_t(glm::ceil(y)) % height;
 
-			const auto v0 = glm::mix(get_pixel(x0, y0), get_pixel(x1, y0), x - x0);
-			const auto v1 = glm::mix(get_pixel(x0, y1), get_pixel(x1, y1), x - x0);
+			const auto v0 = glm::mix(fetch(x0, y0), fetch(x1, y0), x - x0);
+			const auto v1 = glm::mix(fetch(x0, y1), fetch(x1, y1), x - x0);
 			return glm::mix(v0, v1, y - y0);
 		}
 		else
 		{
-			const uint32_t ix = uint32_t(glm::round(x)) % m_width;
-			const uint32_t iy = uint32_t(glm::round(y)) % m_height;
-			return get_pixel(ix, iy);
+			const uint32_t ix = uint32_t(glm::round(x)) % width;
+			const uint32_t iy = uint32_t(glm::round(y)) % height;
+			return fetch(ix, iy);
 		}
+	}
+
+	size_t image::pixel_index(pixel_layout layout, uint32_t x, uint32_t y, uint32_t width)
+	{
+		if (layout == pixel_layout::linear)
+			return size_t(y) * width + x;
+
+		// Block index, then interleave the 2 low bits of x and y (Morton order)
+		const size_t blocks_x = (width + 3) >> 2;
+		const size_t block = (y >> 2) * blocks_x + (x >> 2);
+		const uint32_t morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+		return (block << 4) | morton;
+	}
+
+	size_t image::storage_size(pixel_layout layout, uint32_t width, uint32_t height)
+	{
+		if (layout == pixel_layout::linear)
+			return size_t(width) * height;
+
+		// Partial blocks are padded
+		return size_t((width + 3) >> 2) * ((height + 3) >> 2) * 16;
+	}
+
+	void image::set_layout(pixel_layout layout)
+	{
+		if (layout == m_layout)
+			return;
+
+		const auto convert = [src_layout = m_layout, layout, size = texel_size(m_format)](std::vector<uint8_t>& texels, uint32_t width, uint32_t height) {
+			std::vector<uint8_t> src = std::move(texels);
+			texels.resize(storage_size(layout, width, height) * size);
+
+			for (uint32_t y = 0; y < height; ++y)
+				for (uint32_t x = 0; x < width; ++x)
+					std::memcpy(&texels[pixel_index(layout, x, y, width) * size], &src[pixel_index(src_layout, x, y, width) * size], size);
+		};
+
+		convert(m_texels, m_width, m_height);
+
+		for (auto& level : m_mips)
+			convert(level.texels, level.width, level.height);
+
+		m_layout = layout;
+	}
 
+	void image::set_format(texel_format format)
+	{
+		if (format == m_format)
+			return;
+
+		const auto convert = [this, format](std::vector<uint8_t>& texels, uint32_t width, uint32_t height) {
+			std::vector<uint8_t> src = std::move(texels);
+			const size_t count = storage_size(m_layout, width, height);
+			texels.resize(count * texel_size(format));
+
+			for (size_t i = 0; i < count; ++i)
+				encode(format, texels.data(), i, decode(m_format, src.data(), i));
+		};
+
+		convert(m_texels, m_width, m_height);
+
+		for (auto& level : m_mips)
+			convert(level.texels, level.width, level.height);
+
+		m_format = format;
+	}
+
+	size_t image::get_size_in_bytes() const
+	{
+		size_t size = m_texels.size();
+
+		for (const auto& level : m_mips)
+			size += level.texels.size();
+
+		return size;
 	}
+
 	void image::set_pixel(size_t x, size_t y, const glm::vec3& color)
 	{
-		m_pixels[y * m_width + x] = color;
+		encode(m_format, m_texels.data(), pixel_index(m_layout, x, y, m_width), color);
 	}
 	
 	glm::vec3 image::get_pixel(size_t x, size_t y) const
 	{
-		return m_pixels[y * m_width + x];
+		return decode(m_format, m_texels.data(), pixel_index(m_layout, x, y, m_width));
 	}
 
 	glm::vec3 image::get_pixel(const glm::uvec2 xy) const
@@ -74,20 +203,58 @@ namespace rt {
 		return get_pixel(xy.x, xy.y);
 	}
 
+	glm::uvec2 image::get_level_size(size_t level) const
+	{
+		return level == 0 ? glm::uvec2(m_width, m_height) : glm::uvec2(m_mips[level - 1].width, m_mips[level - 1].height);
+	}
+
+	glm::vec3 image::get_level_pixel(size_t level, uint32_t x, uint32_t y) const
+	{
+		if (level == 0)
+			return get_pixel(x, y);
+
+		const auto& mip = m_mips[level - 1];
+		return decode(m_format, mip.texels.data(), pixel_index(m_layout, x, y, mip.width));
+	}
+
 
-	void image::load(std::string_view fileName)
+	void image::load(std::string_view fileName, std::optional<texel_format> format)
 	{
 		int32_t w, h, channels;
 		stbi_set_flip_vertically_on_load_thread(true);
-		float * data = stbi_loadf(fileName.data(), &w, &h, &channels, 3);
+
+		const bool hdr = stbi_is_hdr(fileName.data());
+		const auto target_format = format.value_or(hdr ? texel_format::rgb9e5 : texel_format::rgba8_srgb);
+
+		// 8 bit files are copied as they are, everything else is encoded from floats
+		void* data = !hdr && target_format == texel_format::rgba8_srgb ?
+			static_cast<void*>(stbi_load(fileName.data(), &w, &h, &channels, 4)) :
+			static_cast<void*>(stbi_loadf(fileName.data(), &w, &h, &channels, 3));
 
 		if (data)
 		{
 			m_width = w;
 			m_height = h;
-			m_pixels.resize(size_t(w) * h);
-			std::memcpy(m_pixels.data(), data, sizeof(float) * w * h * 3);
+			m_format = target_format;
+			m_texels.resize(storage_size(m_layout, m_width, m_height) * texel_size(m_format));
+			m_mips.clear();
+
+			for (uint32_t y = 0; y < m_height; ++y)
+			{
+				for (uint32_t x = 0; x < m_width; ++x)
+				{
+					const size_t src_index = size_t(y) * m_width + x;
+					const size_t dst_index = pixel_index(m_layout, x, y, m_width);
+
+					if (!hdr && m_format == texel_format::rgba8_srgb)
+						std::memcpy(&m_texels[dst_index * 4], static_cast<const uint8_t*>(data) + src_index * 4, 4);
+					else
+						encode(m_format, m_texels.data(), dst_index, static_cast<const glm::vec3*>(data)[src_index]);
+				}
+			}
+
 			stbi_image_free(data);
+			generate_mipmaps();
 		}
 		else
 		{
@@ -97,21 +264,69 @@ namespace rt {
 	
 	void image::to_ldr()
 	{
+		const size_t count = storage_size(m_layout, m_width, m_height);
 		float max = 0.0f;
 
-		for (const auto& p : m_pixels)
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto p = decode(m_format, m_texels.data(), i);
 			max = std::max({ max, p.x, p.y, p.z });
+		}
 
 		if (max > 1.0f)
 		{
-			std::for_each(m_pixels.begin(), m_pixels.end(), [](auto& p) { 
-				p = glm::vec3(1.0f) - glm::exp(-p);
-			});
+			for (size_t i = 0; i < count; ++i)
+				encode(m_format, m_texels.data(), i, glm::vec3(1.0f) - glm::exp(-decode(m_format, m_texels.data(), i)));
 
+			if (!m_mips.empty())
+				generate_mipmaps();
 		}
 
 	}
 
+	void image::generate_mipmaps()
+	{
+		m_mips.clear();
+
+		uint32_t width = m_width;
+		uint32_t height = m_height;
+		const uint8_t* src = m_texels.data();
+
+		while (width > 1 || height > 1)
+		{
+			mip_level level;
+			level.width = std::max(width / 2, 1u);
+			level.height = std::max(height / 2, 1u);
+			level.texels.resize(storage_size(m_layout, level.width, level.height) * texel_size(m_format));
+
+			// 2x2 box filter. With odd sizes the last row/column is clamped
+			for (uint32_t y = 0; y < level.height; ++y)
+			{
+				const uint32_t y0 = std::min(y * 2, height - 1);
+				const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+				for (uint32_t x = 0; x < level.width; ++x)
+				{
+					const uint32_t x0 = std::min(x * 2, width - 1);
+					const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+					const auto color = (
+						decode(m_format, src, pixel_index(m_layout, x0, y0, width)) +
+						decode(m_format, src, pixel_index(m_layout, x1, y0, width)) +
+						decode(m_format, src, pixel_index(m_layout, x0, y1, width)) +
+						decode(m_format, src, pixel_index(m_layout, x1, y1, width))) * 0.25f;
+
+					encode(m_format, level.texels.data(), pixel_index(m_layout, x, y, level.width), color);
+				}
+			}
+
+			width = level.width;
+			height = level.height;
+			m_mips.push_back(std::move(level));
+			src = m_mips.back().texels.data();
+		}
+	}
+
 
 	glm::vec3 equirectangular_map::sample(const glm::vec3& uvw) const
 	{
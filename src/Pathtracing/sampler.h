@@ -6,6 +6,7 @@
 #include <cinttypes>
 #include <vector>
 #include <memory>
+#include <optional>
 
 namespace rt {
 
@@ -22,10 +23,29 @@ namespace rt {
 		/// <returns></returns>
 		virtual glm::vec3 sample(const glm::vec2& uv) const = 0;
 
+		/// <summary>
+		/// Samples at the given uv, filtering over the given footprint
+		/// </summary>
+		/// <param name="uv">Uv coordinates</param>
+		/// <param name="footprint">Width of the sampled area in uv units</param>
+		/// <returns></returns>
+		virtual glm::vec3 sample(const glm::vec2& uv, float footprint) const { return sample(uv); }
+
 		/// <summary>
 		/// Returns the average color for this sampler
 		/// </summary>
 		virtual glm::vec3 average() const = 0;
+
+		/// <summary>
+		/// Returns true if this sampler returns the same color everywhere. In this case
+		/// the color is given by "average"
+		/// </summary>
+		virtual bool is_constant() const { return false; }
+
+		/// <summary>
+		/// Returns the memory used by the data of this sampler
+		/// </summary>
+		virtual size_t get_size_in_bytes() const { return 0; }
 	};
 
 	/// <summary>
@@ -40,6 +60,11 @@ namespace rt {
 		/// <param name="uvw">The direction to sample</param>
 		/// <returns></returns>
 		virtual glm::vec3 sample(const glm::vec3& uvw) const = 0;
+
+		/// <summary>
+		/// Returns the memory used by the data of this sampler
+		/// </summary>
+		virtual size_t get_size_in_bytes() const { return 0; }
 	};
 
 	/// <summary>
@@ -56,8 +81,10 @@ namespace rt {
 		color_sampler(const glm::vec3& color) : m_color(color) {}
 
 		glm::vec3 sample(const glm::vec2& uv) const override { return m_color; }
+		glm::vec3 sample(const glm::vec2& uv, float footprint) const override { return m_color; }
 		glm::vec3 sample(const glm::vec3& uvw) const override { return m_color; }
 		glm::vec3 average() const override { return m_color; }
+		bool is_constant() const override { return true; }
 	private:
 		glm::vec3 m_color;
 	};
@@ -67,6 +94,49 @@ namespace rt {
 		linear, nearest
 	};
 
+	/// <summary>
+	/// Memory layout of the pixels of an image
+	/// </summary>
+	enum class pixel_layout
+	{
+		/// <summary>
+		/// Row-major order
+		/// </summary>
+		linear,
+
+		/// <summary>
+		/// 4x4 blocks in row-major order, pixels in Morton order inside each block. All the
+		/// texels of a bilinear lookup are usually in the same block
+		/// </summary>
+		tiled
+	};
+
+	/// <summary>
+	/// Storage format of the pixels of an image. Pixels are decoded on the fly when sampled
+	/// </summary>
+	enum class texel_format
+	{
+		/// <summary>
+		/// 3 floats, 12 bytes per pixel
+		/// </summary>
+		rgb32f,
+
+		/// <summary>
+		/// 8 bits per channel, gamma encoded (2.2, like stbi_loadf). 4 bytes per pixel
+		/// </summary>
+		rgba8_srgb,
+
+		/// <summary>
+		/// 3 half floats, 6 bytes per pixel
+		/// </summary>
+		rgb16f,
+
+		/// <summary>
+		/// 9 bits mantissa per channel with a shared 5 bits exponent (HDR), 4 bytes per pixel
+		/// </summary>
+		rgb9e5
+	};
+
 	/// <summary>
 	/// An image
 	/// </summary>
@@ -99,6 +169,12 @@ namespace rt {
 		glm::vec3 average() const override;
 		glm::vec3 sample(const glm::vec2& uv) const override;
 
+		/// <summary>
+		/// Samples the mip level matching the footprint, blending between the two
+		/// closest levels. Falls back to the full resolution if there are no mipmaps
+		/// </summary>
+		glm::vec3 sample(const glm::vec2& uv, float footprint) const override;
+
 		/// <summary>
 		/// Sets the color of a pixel
 		/// </summary>
@@ -127,16 +203,87 @@ namespace rt {
 		/// <returns></returns>
 		size_t get_height() const { return m_height; }
 
-		void load(std::string_view fileName);
+		/// <summary>
+		/// Loads the image from file and builds its mipmaps
+		/// </summary>
+		/// <param name="fileName">The file</param>
+		/// <param name="format">The storage format. If not given, it's chosen from the file:
+		/// rgb9e5 for HDR files, rgba8_srgb otherwise</param>
+		void load(std::string_view fileName, std::optional<texel_format> format = std::nullopt);
 
 		/// <summary>
 		/// Normalize this image in low dynamic range
 		/// </summary>
 		void to_ldr();
 
+		/// <summary>
+		/// Builds the mip pyramid (box filtered) from the current pixels. Must be
+		/// called again if the pixels are modified
+		/// </summary>
+		void generate_mipmaps();
+
+		/// <summary>
+		/// Returns the number of mip levels, including the full resolution one
+		/// </summary>
+		size_t get_mip_levels() const { return m_mips.size() + 1; }
+
+		/// <summary>
+		/// Returns the size in pixels of a mip level, 0 being the full resolution
+		/// </summary>
+		glm::uvec2 get_level_size(size_t level) const;
+
+		/// <summary>
+		/// Returns the color of a pixel of a mip level, 0 being the full resolution
+		/// </summary>
+		glm::vec3 get_level_pixel(size_t level, uint32_t x, uint32_t y) const;
+
+		/// <summary>
+		/// Changes the memory layout of this image, preserving its content
+		/// </summary>
+		/// <param name="layout">The new layout</param>
+		void set_layout(pixel_layout layout);
+
+		/// <summary>
+		/// Returns the memory layout of this image
+		/// </summary>
+		pixel_layout get_layout() const { return m_layout; }
+
+		/// <summary>
+		/// Changes the storage format of this image, converting its content
+		/// </summary>
+		/// <param name="format">The new format</param>
+		void set_format(texel_format format);
+
+		/// <summary>
+		/// Returns the storage format of this image
+		/// </summary>
+		texel_format get_format() const { return m_format; }
+
+		/// <summary>
+		/// Returns the memory used by the pixels of this image, mipmaps included
+		/// </summary>
+		size_t get_size_in_bytes() const override;
+
 	private:
+		struct mip_level
+		{
+			uint32_t width, height;
+			std::vector<uint8_t> texels;
+		};
+
 		uint32_t m_width, m_height;
-		std::vector<glm::vec3> m_pixels;
+		pixel_layout m_layout = pixel_layout::linear;
+		texel_format m_format = texel_format::rgb32f;
+		std::vector<uint8_t> m_texels;
+		std::vector<mip_level> m_mips;
+
+		glm::vec3 sample_level(size_t level, const glm::vec2& uv) const;
+
+		template<texel_format Format>
+		glm::vec3 sample_level(size_t level, const glm::vec2& uv) const;
+
+		static size_t pixel_index(pixel_layout layout, uint32_t x, uint32_t y, uint32_t width);
+		static size_t storage_size(pixel_layout layout, uint32_t width, uint32_t height);
 	};
 
 	/// <summary>
@@ -149,10 +296,11 @@ namespace rt {
 		/// Constructs a new instance
 		/// </summary>
 		/// <param name="image">The image to sample from</param>
-		equirectangular_map(const std::shared_ptr<image>& image) : m_image(image) {}
+		equirectangular_map(const std::shared_ptr<const image>& image) : m_image(image) {}
 		glm::vec3 sample(const glm::vec3& uvw) const override;
+		size_t get_size_in_bytes() const override { return m_image ? m_image->get_size_in_bytes() : 0; }
 	private:
-		std::shared_ptr<image> m_image;
+		std::shared_ptr<const image> m_image;
 	};
 
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <limits>
 #include <regex>
+#include <unordered_set>
 
 #include <spdlog/spdlog.h>
 
@@ -9,6 +13,9 @@
 #include <glm/gtx/transform.hpp>
 
 #include "sampler.h"
+#include "ray_stats.h"
+#include "profiler.h"
+#include "texture_cache.h"
 
 namespace rt 
 {
@@ -75,11 +82,35 @@ namespace rt
 	}
 
 
+	triangle::triangle(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2,
+		const glm::vec2& uv0, const glm::vec2& uv1, const glm::vec2& uv2) :
+		m_origin(p0)
+	{
+		m_face_normal = glm::normalize(glm::cross(p1 - p0, p2 - p1));
+
+		m_edges = {
+			p1 - p0,
+			p2 - p0
+		};
+
+		m_d00 = glm::dot(m_edges[0], m_edges[0]);
+		m_d01 = glm::dot(m_edges[0], m_edges[1]);
+		m_d11 = glm::dot(m_edges[1], m_edges[1]);
+
+		m_inv_den = 1.0f / (m_d00 * m_d11 - m_d01 * m_d01);
+
+		const glm::vec2 uv_e0 = uv1 - uv0;
+		const glm::vec2 uv_e1 = uv2 - uv0;
+		const float uv_area = glm::abs(uv_e0.x * uv_e1.y - uv_e0.y * uv_e1.x);
+		const float area = glm::length(glm::cross(m_edges[0], m_edges[1]));
+		m_uv_density = area > 0.0f ? glm::sqrt(uv_area / area) : 0.0f;
+	}
+
 	glm::vec3 triangle::baricentric(const glm::vec3& point) const
 	{
 		// Fast baricentric coordinates:
 		// https://gamedev.stackexchange.com/questions/23743/whats-the-most-efficient-way-to-find-barycentric-coordinates
-		const glm::vec3 v2 = point - vertices[0].position;
+		const glm::vec3 v2 = point - m_origin;
 		const float d20 = glm::dot(v2, m_edges[0]);
 		const float d21 = glm::dot(v2, m_edges[1]);
 		const float v = (m_d11 * d20 - m_d01 * d21) * m_inv_den;
@@ -87,215 +118,558 @@ namespace rt
 		const float u = 1.0f - v - w;
 		return { u, v, w };
 	}
+	
 
-	void triangle::update()
+	void triangle::baricentric(const float* x, const float* y, const float* z, size_t count, float* u, float* v, float* w) const
 	{
-		m_face_normal = glm::normalize(glm::cross(vertices[1].position - vertices[0].position,
-			vertices[2].position - vertices[1].position));
+		// Same operations as above, lane by lane
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float v2x = x[i] - m_origin.x;
+			const float v2y = y[i] - m_origin.y;
+			const float v2z = z[i] - m_origin.z;
+			const float d20 = v2x * m_edges[0].x + v2y * m_edges[0].y + v2z * m_edges[0].z;
+			const float d21 = v2x * m_edges[1].x + v2y * m_edges[1].y + v2z * m_edges[1].z;
+			v[i] = (m_d11 * d20 - m_d01 * d21) * m_inv_den;
+			w[i] = (m_d00 * d21 - m_d01 * d20) * m_inv_den;
+			u[i] = 1.0f - v[i] - w[i];
+		}
+	}
 
-		m_edges = {
-			vertices[1].position - vertices[0].position,
-			vertices[2].position - vertices[0].position,
-			vertices[2].position - vertices[1].position
-		};
+	mesh::mesh(data_buffer<glm::vec3> positions, data_buffer<glm::vec3> normals, data_buffer<glm::vec2> uvs,
+		data_buffer<uint32_t> indices, data_buffer<triangle> triangles, kd_tree tree, const bounding_box& bounds) :
+		m_bounds(bounds),
+		m_positions(std::move(positions)),
+		m_normals(std::move(normals)),
+		m_uvs(std::move(uvs)),
+		m_indices(std::move(indices)),
+		m_triangles(std::move(triangles)),
+		m_tree(std::move(tree)),
+		m_compiled(true)
+	{
+	}
 
-		m_d00 = glm::dot(m_edges[0], m_edges[0]);
-		m_d01 = glm::dot(m_edges[0], m_edges[1]);
-		m_d11 = glm::dot(m_edges[1], m_edges[1]);
+	size_t mesh::get_size_in_bytes() const
+	{
+		return m_positions.size() * sizeof(glm::vec3) +
+			m_normals.size() * sizeof(glm::vec3) +
+			m_uvs.size() * sizeof(glm::vec2) +
+			m_indices.size() * sizeof(uint32_t) +
+			m_triangles.size() * sizeof(triangle) +
+			m_tree.get_size_in_bytes();
+	}
 
-		m_inv_den = 1.0f / (m_d00 * m_d11 - m_d01 * m_d01);
+	void mesh::reserve(size_t vertices, size_t triangles)
+	{
+		m_positions.edit().reserve(vertices);
+		m_normals.edit().reserve(vertices);
+		m_uvs.edit().reserve(vertices);
+		m_indices.edit().reserve(triangles * 3);
 	}
-	
 
-	triangle& mesh::add_triangle()
+	uint32_t mesh::add_vertex(const vertex& v)
 	{
-		return m_triangles.emplace_back();
+		m_compiled = false;
+		m_positions.edit().push_back(v.position);
+		m_normals.edit().push_back(v.normal);
+		m_uvs.edit().push_back(v.uv);
+		return static_cast<uint32_t>(m_positions.size() - 1);
+	}
+
+	void mesh::add_triangle(uint32_t i0, uint32_t i1, uint32_t i2)
+	{
+		m_compiled = false;
+		auto& indices = m_indices.edit();
+		indices.push_back(i0);
+		indices.push_back(i1);
+		indices.push_back(i2);
 	}
 	
 	raycast_result mesh::intersect(const ray& ray) const
 	{
 		raycast_result result;
-		float distance = std::numeric_limits<float>::max();
-		intersect_internal(ray, m_tree, result, distance);
-		return result;
-	}
 
-	void mesh::compile()
-	{
-		auto& min = m_bounds.min;
-		auto& max = m_bounds.max;
-
-		for (auto& t : m_triangles) 
-		{
-			t.update();
+		if (m_tree.get_nodes().empty())
+			return result;
 
-			for (auto& v : t.vertices)
-			{
-				min = glm::min(min, v.position);
-				max = glm::max(max, v.position);
-			}
+		const kd_tree_node* nodes = m_tree.get_nodes().data();
+		const uint32_t* indices = m_tree.get_triangle_indices().data();
+		const triangle* triangles = m_triangles.data();
 
-		}
-		m_tree = std::make_unique<kd_tree_node>(m_triangles, m_bounds, 0);
-	}
+		float distance = std::numeric_limits<float>::max();
+		uint32_t closest = 0;
+		glm::vec3 closest_bar;
 
-	raycast_result mesh::intersect_triangle(const ray& ray, const triangle& t) const
-	{
-		raycast_result result;
+		// Depth first, left child before right child. Every level leaves at most one node on the stack
+		uint32_t stack[kd_tree::s_max_depth + 2];
+		uint32_t stack_size = 0;
+		stack[stack_size++] = 0;
 
-		auto l = ray.origin - t.vertices[0].position;
-		float distance = glm::dot(l, t.get_face_normal());
+		[[maybe_unused]] uint64_t nodes_visited = 0, triangles_tested = 0;
 
-		if (distance < 0)
+		while (stack_size > 0)
 		{
-			// Ray origin "behind" the triangle plane
-			return result;
-		}
+			const auto& node = nodes[stack[--stack_size]];
+			RT_COUNT(++nodes_visited);
 
-		float cosine = glm::dot(ray.direction, t.get_face_normal());
+			if (!node.bounds.intersect(ray))
+				continue;
 
-		// Check if the ray is never intersecting the triangle plane
-		if (cosine >= 0)
-		{
-			return result;
-		}
+			RT_COUNT(triangles_tested += node.triangle_count);
 
+			for (uint32_t i = 0; i < node.triangle_count; ++i)
+			{
+				const auto t = indices[node.first_triangle + i];
+				glm::vec3 position, bar;
 
-		// Project the ray on the triangle plane 
-		auto projection = ray.origin + ray.direction * (distance / -cosine);
+				if (intersect_triangle(ray, triangles[t], position, bar))
+				{
+					const auto d = glm::length2(ray.origin - position);
+
+					if (d < distance)
+					{
+						result.hit = true;
+						result.position = position;
+						closest = t;
+						closest_bar = bar;
+						distance = d;
+					}
+				}
+			}
 
-		// Use baricentric coordinates to check if the ray projection
-		// is contained in the triangle
-		auto bar = t.baricentric(projection);
+			if (node.right != kd_tree_node::s_no_child)
+				stack[stack_size++] = node.right;
 
-		if (bar.x >= 0 && bar.y >= 0 && bar.z >= 0)
-		{
-			result.hit = true;
-			result.position = projection;
-			result.normal = glm::normalize(
-				t.vertices[0].normal * bar.x +
-				t.vertices[1].normal * bar.y +
-				t.vertices[2].normal * bar.z);
-			result.uv =
-				bar.x * t.vertices[0].uv +
-				bar.y * t.vertices[1].uv +
-				bar.z * t.vertices[2].uv;
+			if (node.left != kd_tree_node::s_no_child)
+				stack[stack_size++] = node.left;
 		}
 
+		RT_COUNT(ray_stats::local().nodes_visited += nodes_visited);
+		RT_COUNT(ray_stats::local().triangles_tested += triangles_tested);
+
+		// Vertex attributes are only interpolated for the closest hit
+		if (result.hit)
+			interpolate(closest, closest_bar, result);
+
 		return result;
 	}
 
-	void mesh::intersect_internal(const ray& ray, const std::unique_ptr<kd_tree_node>& node, raycast_result& result, float& distance) const
+	namespace
 	{
-		if (node->get_bounds().intersect(ray))
+		/// <summary>
+		/// The rays of a packet in structure of arrays form, so that a node is tested against
+		/// all of them at once
+		/// </summary>
+		struct packet_lanes
 		{
-			for (auto& t : node->get_triangles())
+			alignas(32) float ox[s_max_packet_size], oy[s_max_packet_size], oz[s_max_packet_size];
+			alignas(32) float dx[s_max_packet_size], dy[s_max_packet_size], dz[s_max_packet_size];
+
+			// Results of the last triangle test
+			alignas(32) float px[s_max_packet_size], py[s_max_packet_size], pz[s_max_packet_size];
+			alignas(32) float u[s_max_packet_size], v[s_max_packet_size], w[s_max_packet_size];
+
+			// Frustum of the packet: shared origin and range of the directions. Only used when
+			// all the rays share their origin and the sign of each direction component
+			bool has_frustum = true;
+			glm::vec3 origin, dir_min, dir_max;
+
+			packet_lanes(const ray* rays, size_t count) :
+				origin(rays[0].origin), dir_min(rays[0].direction), dir_max(rays[0].direction)
 			{
-				auto r = intersect_triangle(ray, t);
+				for (size_t i = 0; i < s_max_packet_size; ++i)
+				{
+					// Unused lanes repeat the last ray, they're masked out
+					const auto& r = rays[std::min(i, count - 1)];
+					ox[i] = r.origin.x; oy[i] = r.origin.y; oz[i] = r.origin.z;
+					dx[i] = r.direction.x; dy[i] = r.direction.y; dz[i] = r.direction.z;
+
+					has_frustum = has_frustum && r.origin == origin;
+					dir_min = glm::min(dir_min, r.direction);
+					dir_max = glm::max(dir_max, r.direction);
+				}
+
+				for (int a = 0; a < 3; ++a)
+					has_frustum = has_frustum && (dir_min[a] > 0.0f || dir_max[a] < 0.0f);
+			}
+
+			/// <summary>
+			/// Returns the rays of the mask that intersect the box, same test as bounding_box::intersect
+			/// </summary>
+			uint32_t intersect(const bounding_box& box, uint32_t mask) const
+			{
+				if (has_frustum)
+				{
+					// The slab distances of each ray are between the ones of the extreme directions
+					// (a division is monotonic), so the packet misses the box if these do
+					float near = -std::numeric_limits<float>::max();
+					float far = std::numeric_limits<float>::max();
+
+					for (int a = 0; a < 3; ++a)
+					{
+						const float t1 = (box.min[a] - origin[a]) / dir_min[a];
+						const float t2 = (box.min[a] - origin[a]) / dir_max[a];
+						const float t3 = (box.max[a] - origin[a]) / dir_min[a];
+						const float t4 = (box.max[a] - origin[a]) / dir_max[a];
+						near = std::max(near, std::min({ t1, t2, t3, t4 }));
+						far = std::min(far, std::max({ t1, t2, t3, t4 }));
+					}
+
+					if (far < 0 || near > far)
+						return 0;
+				}
 
-				auto d = glm::length2(ray.origin - r.position);
+				uint32_t hits = 0;
 
-				if (d < distance && r.hit)
+				for (size_t i = 0; i < s_max_packet_size; ++i)
 				{
-					result = r;
-					distance = d;
+					const float t1 = (box.min.x - ox[i]) / dx[i];
+					const float t2 = (box.max.x - ox[i]) / dx[i];
+					const float t3 = (box.min.y - oy[i]) / dy[i];
+					const float t4 = (box.max.y - oy[i]) / dy[i];
+					const float t5 = (box.min.z - oz[i]) / dz[i];
+					const float t6 = (box.max.z - oz[i]) / dz[i];
+					const float t7 = std::fmax(std::fmax(std::fmin(t1, t2), std::fmin(t3, t4)), std::fmin(t5, t6));
+					const float t8 = std::fmin(std::fmin(std::fmax(t1, t2), std::fmax(t3, t4)), std::fmax(t5, t6));
+					const bool hit = !(t8 < 0 || t7 > t8) && t7 != -1;
+					hits |= uint32_t(hit) << i;
 				}
+
+				return hits & mask;
 			}
 
-			if (node->get_left() != nullptr)
-				intersect_internal(ray, node->get_left(), result, distance);
+			/// <summary>
+			/// Returns the rays of the mask that intersect the triangle, same test as mesh::intersect_triangle.
+			/// The hit positions and baricentric coordinates are left in the px/py/pz and u/v/w lanes
+			/// </summary>
+			uint32_t intersect(const triangle& t, uint32_t mask)
+			{
+				const auto& o = t.get_origin();
+				const auto& n = t.get_face_normal();
+				float distance[s_max_packet_size], cosine[s_max_packet_size];
 
-			if (node->get_right() != nullptr)
-				intersect_internal(ray, node->get_right(), result, distance);
+				for (size_t i = 0; i < s_max_packet_size; ++i)
+				{
+					distance[i] = (ox[i] - o.x) * n.x + (oy[i] - o.y) * n.y + (oz[i] - o.z) * n.z;
+					cosine[i] = dx[i] * n.x + dy[i] * n.y + dz[i] * n.z;
+
+					// Projection of the origin on the triangle plane
+					const float s = distance[i] / -cosine[i];
+					px[i] = ox[i] + dx[i] * s;
+					py[i] = oy[i] + dy[i] * s;
+					pz[i] = oz[i] + dz[i] * s;
+				}
 
-		}
+				t.baricentric(px, py, pz, s_max_packet_size, u, v, w);
+
+				uint32_t hits = 0;
+
+				for (size_t i = 0; i < s_max_packet_size; ++i)
+				{
+					const bool hit = distance[i] >= 0 && cosine[i] < 0 && u[i] >= 0 && v[i] >= 0 && w[i] >= 0;
+					hits |= uint32_t(hit) << i;
+				}
+
+				return hits & mask;
+			}
+		};
 	}
 
-	kd_tree_node::kd_tree_node(const std::vector<triangle>& triangles, const bounding_box& bounds, uint32_t depth) :
-		m_bounds(bounds),
-		m_depth(depth)
+	void mesh::intersect(const ray* rays, size_t count, raycast_result* results) const
 	{
+		for (size_t i = 0; i < count; ++i)
+			results[i] = raycast_result();
 
-		// Stop condition
-		if (triangles.size() <= 1 || m_depth == 100)
-		{
-			for (auto& t : triangles)
-				m_triangles.push_back(t);
+		if (m_tree.get_nodes().empty() || count == 0)
 			return;
-		}
 
+		const kd_tree_node* nodes = m_tree.get_nodes().data();
+		const uint32_t* indices = m_tree.get_triangle_indices().data();
+		const triangle* triangles = m_triangles.data();
 
+		packet_lanes lanes(rays, count);
 
-		// Select the split axis (round-robin)
-		uint32_t uAxis = depth % 3;
+		float distance[s_max_packet_size];
+		uint32_t closest[s_max_packet_size];
+		glm::vec3 closest_bar[s_max_packet_size];
+		std::fill(distance, distance + count, std::numeric_limits<float>::max());
 
+		// Same order as the single ray traversal. Each entry keeps the rays that hit its parent
+		struct entry
+		{
+			uint32_t node;
+			uint32_t mask;
+		};
+
+		entry stack[kd_tree::s_max_depth + 2];
+		uint32_t stack_size = 0;
+		stack[stack_size++] = { 0, (1u << count) - 1 };
+
+		[[maybe_unused]] uint64_t nodes_visited = 0, triangles_tested = 0;
 
-		struct
+		while (stack_size > 0)
 		{
-			bounding_box left_bounds, right_bounds;
-			std::vector<triangle> left_tris, right_tris;
-		} result;
+			const auto [index, parent_mask] = stack[--stack_size];
+			const auto& node = nodes[index];
+			const uint32_t mask = lanes.intersect(node.bounds, parent_mask);
+			RT_COUNT(++nodes_visited);
+
+			if (mask == 0)
+				continue;
+
+			RT_COUNT(triangles_tested += node.triangle_count);
 
-		// Take the median of all points as split point
-		float median = 0;
+			for (uint32_t i = 0; i < node.triangle_count; ++i)
+			{
+				const auto t = indices[node.first_triangle + i];
+				const uint32_t hits = lanes.intersect(triangles[t], mask);
+
+				for (uint32_t lane = 0; lane < count; ++lane)
+				{
+					if ((hits & (1u << lane)) == 0)
+						continue;
+
+					const glm::vec3 position(lanes.px[lane], lanes.py[lane], lanes.pz[lane]);
+					const auto d = glm::length2(rays[lane].origin - position);
+
+					if (d < distance[lane])
+					{
+						results[lane].hit = true;
+						results[lane].position = position;
+						closest[lane] = t;
+						closest_bar[lane] = { lanes.u[lane], lanes.v[lane], lanes.w[lane] };
+						distance[lane] = d;
+					}
+				}
+			}
+
+			if (node.right != kd_tree_node::s_no_child)
+				stack[stack_size++] = { node.right, mask };
+
+			if (node.left != kd_tree_node::s_no_child)
+				stack[stack_size++] = { node.left, mask };
+		}
 
-		for (auto& t : triangles)
+		RT_COUNT(ray_stats::local().nodes_visited += nodes_visited);
+		RT_COUNT(ray_stats::local().triangles_tested += triangles_tested);
+
+		for (size_t i = 0; i < count; ++i)
 		{
-			median += t.vertices[0].position[uAxis];
-			median += t.vertices[1].position[uAxis];
-			median += t.vertices[2].position[uAxis];
+			if (results[i].hit)
+				interpolate(closest[i], closest_bar[i], results[i]);
 		}
+	}
 
-		median /= 3 * triangles.size();
+	void mesh::interpolate(uint32_t triangle, const glm::vec3& bar, raycast_result& result) const
+	{
+		const uint32_t* v = m_indices.data() + 3 * triangle;
+		const glm::vec3* normals = m_normals.data();
+		const glm::vec2* uvs = m_uvs.data();
+
+		result.normal = glm::normalize(
+			normals[v[0]] * bar.x +
+			normals[v[1]] * bar.y +
+			normals[v[2]] * bar.z);
+		result.uv =
+			bar.x * uvs[v[0]] +
+			bar.y * uvs[v[1]] +
+			bar.z * uvs[v[2]];
+		result.uv_density = m_triangles[triangle].get_uv_density();
+	}
 
-		m_bounds.split(static_cast<axis>(uAxis), median, result.left_bounds, result.right_bounds);
+	void mesh::compile()
+	{
+		if (m_compiled)
+			return;
 
-		// Test every triangle in both left and right bounding boxes
-		for (auto& t : triangles)
+		RT_PROFILE_ZONE("mesh::compile");
+
+		auto& min = m_bounds.min;
+		auto& max = m_bounds.max;
+
+		const auto& positions = m_positions;
+		const auto& uvs = m_uvs;
+		const auto& indices = m_indices;
+
+		std::vector<triangle> triangles;
+		triangles.reserve(get_triangle_count());
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
 		{
+			const uint32_t v0 = indices[i], v1 = indices[i + 1], v2 = indices[i + 2];
 
-			if (t.vertices[0].position[uAxis] <= median || t.vertices[1].position[uAxis] <= median || t.vertices[2].position[uAxis] <= median)
-			{
-				result.left_tris.push_back(t);
-			}
+			triangles.emplace_back(positions[v0], positions[v1], positions[v2], uvs[v0], uvs[v1], uvs[v2]);
 
-			if (t.vertices[0].position[uAxis] >= median || t.vertices[1].position[uAxis] >= median || t.vertices[2].position[uAxis] >= median)
+			for (const auto v : { v0, v1, v2 })
 			{
-				result.right_tris.push_back(t);
+				min = glm::min(min, positions[v]);
+				max = glm::max(max, positions[v]);
 			}
+
 		}
 
+		m_triangles = std::move(triangles);
+		m_tree = kd_tree(m_positions, m_indices, m_bounds);
+		m_compiled = true;
+	}
 
-		// Check that not too many triangles are in common (> 50%)
-		// between the subdivisions 
-		if (result.left_tris.size() + result.right_tris.size() > 1.5 * triangles.size())
+	bool mesh::intersect_triangle(const ray& ray, const triangle& t, glm::vec3& position, glm::vec3& bar)
+	{
+		auto l = ray.origin - t.get_origin();
+		float distance = glm::dot(l, t.get_face_normal());
+
+		if (distance < 0)
 		{
-			// If so, subdiving is not efficent anymore
-			m_triangles = triangles;
+			// Ray origin "behind" the triangle plane
+			return false;
 		}
-		else
-		{
-			// Subidivide
 
-			if (result.left_tris.size() > 0)
-				m_left = std::make_unique<kd_tree_node>(result.left_tris, result.left_bounds, depth + 1);
+		float cosine = glm::dot(ray.direction, t.get_face_normal());
 
-			if (result.right_tris.size() > 0)
-				m_right = std::make_unique<kd_tree_node>(result.right_tris, result.right_bounds, depth + 1);
+		// Check if the ray is never intersecting the triangle plane
+		if (cosine >= 0)
+		{
+			return false;
 		}
+
+
+		// Project the ray on the triangle plane 
+		position = ray.origin + ray.direction * (distance / -cosine);
+
+		// Use baricentric coordinates to check if the ray projection
+		// is contained in the triangle
+		bar = t.baricentric(position);
+
+		return bar.x >= 0 && bar.y >= 0 && bar.z >= 0;
+	}
+
+	namespace
+	{
+		struct kd_tree_builder
+		{
+			const data_buffer<glm::vec3>& positions;
+			const data_buffer<uint32_t>& indices;
+			std::vector<kd_tree_node> nodes;
+			std::vector<uint32_t> triangle_indices;
+
+			/// <summary>
+			/// Recursively builds a node and its children, returns the index of the node
+			/// </summary>
+			uint32_t build(const std::vector<uint32_t>& node_triangles, const bounding_box& bounds, uint32_t depth)
+			{
+				const auto index = static_cast<uint32_t>(nodes.size());
+				auto& node = nodes.emplace_back();
+				node.bounds = bounds;
+				node.depth = depth;
+
+				const auto make_leaf = [&] {
+					nodes[index].first_triangle = static_cast<uint32_t>(triangle_indices.size());
+					nodes[index].triangle_count = static_cast<uint32_t>(node_triangles.size());
+					triangle_indices.insert(triangle_indices.end(), node_triangles.begin(), node_triangles.end());
+					return index;
+				};
+
+				// Stop condition
+				if (node_triangles.size() <= 1 || depth == kd_tree::s_max_depth)
+					return make_leaf();
+
+				// Select the split axis (round-robin)
+				uint32_t uAxis = depth % 3;
+
+				struct
+				{
+					bounding_box left_bounds, right_bounds;
+					std::vector<uint32_t> left_tris, right_tris;
+				} result;
+
+				// Take the median of all points as split point
+				float median = 0;
+
+				for (auto i : node_triangles)
+				{
+					median += positions[indices[3 * i]][uAxis];
+					median += positions[indices[3 * i + 1]][uAxis];
+					median += positions[indices[3 * i + 2]][uAxis];
+				}
+
+				median /= 3 * node_triangles.size();
+
+				bounds.split(static_cast<axis>(uAxis), median, result.left_bounds, result.right_bounds);
+
+				// Test every triangle in both left and right bounding boxes
+				for (auto i : node_triangles)
+				{
+					const float p0 = positions[indices[3 * i]][uAxis];
+					const float p1 = positions[indices[3 * i + 1]][uAxis];
+					const float p2 = positions[indices[3 * i + 2]][uAxis];
+
+					if (p0 <= median || p1 <= median || p2 <= median)
+					{
+						result.left_tris.push_back(i);
+					}
+
+					if (p0 >= median || p1 >= median || p2 >= median)
+					{
+						result.right_tris.push_back(i);
+					}
+				}
+
+				// Check that not too many triangles are in common (> 50%)
+				// between the subdivisions 
+				if (result.left_tris.size() + result.right_tris.size() > 1.5 * node_triangles.size())
+				{
+					// If so, subdiving is not efficent anymore
+					return make_leaf();
+				}
+
+				// Subidivide (children are built after the node, the node reference can't be kept)
+				if (result.left_tris.size() > 0)
+				{
+					const auto left = build(result.left_tris, result.left_bounds, depth + 1);
+					nodes[index].left = left;
+				}
+
+				if (result.right_tris.size() > 0)
+				{
+					const auto right = build(result.right_tris, result.right_bounds, depth + 1);
+					nodes[index].right = right;
+				}
+
+				return index;
+			}
+		};
+	}
+
+	kd_tree::kd_tree(const data_buffer<glm::vec3>& positions, const data_buffer<uint32_t>& indices, const bounding_box& bounds)
+	{
+		kd_tree_builder builder{ positions, indices };
+
+		std::vector<uint32_t> all(indices.size() / 3);
+		for (uint32_t i = 0; i < all.size(); ++i)
+			all[i] = i;
+
+		builder.build(all, bounds, 0);
+
+		m_nodes = std::move(builder.nodes);
+		m_triangle_indices = std::move(builder.triangle_indices);
 	}
 
-	const uint32_t kd_tree_node::get_max_depth() const
+	uint32_t kd_tree::get_max_depth() const
 	{
-		const auto d0 = m_left ? m_left->get_max_depth() : m_depth;
-		const auto d1 = m_right ? m_left->get_max_depth() : m_depth;
-		return std::max(d0, d1);
+		uint32_t depth = 0;
+		for (const auto& node : m_nodes)
+			depth = std::max(depth, node.depth);
+		return depth;
 	}
 
 	void scene_node::update_matrices()
 	{
 		m_inv_transform = glm::inverse(m_transform);
 		m_normal_transform = glm::transpose(m_inv_transform);
+		m_average_scale = (
+			glm::length(glm::vec3(m_transform[0])) +
+			glm::length(glm::vec3(m_transform[1])) +
+			glm::length(glm::vec3(m_transform[2]))) / 3.0f;
 	}
 
 	void scene_node::load_identity()
@@ -330,16 +704,27 @@ namespace rt
 
 	void scene::compile()
 	{
-
+		RT_PROFILE_ZONE("scene::compile");
 		std::for_each(nodes.begin(), nodes.end(), [](std::shared_ptr<scene_node>& n) {
 			if (n->shape)
 				n->shape->compile();
 		});
 		
 		m_light_sources.clear();
+		m_materials.clear();
+		m_materials.reserve(nodes.size());
+		m_material_nodes.clear();
+		m_material_nodes.reserve(nodes.size());
+		m_material_ids.clear();
 
 		for (auto& n : nodes)
 		{
+			const auto index = static_cast<uint32_t>(m_materials.size());
+			n->m_index = index;
+			m_materials.emplace_back(n->material);
+			m_material_nodes.push_back(n.get());
+			m_material_ids.emplace(n.get(), index);
+
 			const auto avg = n->material.emission->average();
 			if (avg.r + avg.g + avg.b > 0.0f)
 				m_light_sources.push_back(n);
@@ -347,6 +732,35 @@ namespace rt
 
 	}
 
+	memory_stats scene::get_memory_stats() const
+	{
+		memory_stats stats;
+		std::unordered_set<const void*> counted;
+
+		for (const auto& n : nodes)
+		{
+			if (const auto m = dynamic_cast<const mesh*>(n->shape.get()); m && counted.insert(m).second)
+			{
+				const auto tree_size = m->get_kd_tree().get_size_in_bytes();
+				stats.meshes += m->get_size_in_bytes() - tree_size;
+				stats.acceleration += tree_size;
+			}
+
+			for (const auto& sampler : { n->material.albedo, n->material.emission, n->material.roughness, n->material.metallic })
+			{
+				if (sampler && counted.insert(sampler.get()).second)
+					stats.textures += sampler->get_size_in_bytes();
+			}
+		}
+
+		if (background)
+			stats.textures += background->get_size_in_bytes();
+
+		stats.texture_cache = texture_cache::get_instance().get_stats().resident_bytes;
+
+		return stats;
+	}
+
 	scene::scene()
 	{
 		background = std::make_shared<color_sampler>(glm::vec3{ 0.0f, 0.0f, 0.0f });
@@ -376,9 +790,13 @@ namespace rt
 
 				// The vec3 cast is needed otherwise it would normalize as a vec4
 				r0.normal = glm::normalize(glm::vec3(node->get_normal_transform() * glm::vec4(r0.normal, 0.0f)));
+				r0.uv_density /= node->get_average_scale();
 				
 				if (return_on_first_hit)
+				{
+					RT_COUNT(++ray_stats::local().hits);
 					return { r0, node };
+				}
 				
 				float d0 = glm::length2(r0.position - ray.origin);
 
@@ -394,10 +812,59 @@ namespace rt
 
 		}
 
+		RT_COUNT(ray_stats::local().hits += rc_result.hit);
+
 		return { rc_result, std::move(hit_node) };
 
 	}
 
+	void scene::cast_packet(const ray* rays, size_t count, raycast_result* results, const scene_node** hit_nodes) const
+	{
+		float distances[s_max_packet_size];
+		ray local_rays[s_max_packet_size];
+		raycast_result local_results[s_max_packet_size];
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			distances[i] = std::numeric_limits<float>::max();
+			results[i] = raycast_result();
+			hit_nodes[i] = nullptr;
+		}
+
+		for (const auto& node : nodes)
+		{
+			// Same transforms and closest hit selection as cast_ray
+			for (size_t i = 0; i < count; ++i)
+				local_rays[i] = node->get_inverse_transform() * rays[i];
+
+			node->shape->intersect(local_rays, count, local_results);
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto& r0 = local_results[i];
+
+				if (!r0.hit)
+					continue;
+
+				r0.position = node->get_transform() * glm::vec4(r0.position, 1.0f);
+				r0.normal = glm::normalize(glm::vec3(node->get_normal_transform() * glm::vec4(r0.normal, 0.0f)));
+				r0.uv_density /= node->get_average_scale();
+
+				const float d0 = glm::length2(r0.position - rays[i].origin);
+
+				if (d0 < distances[i])
+				{
+					distances[i] = d0;
+					results[i] = r0;
+					hit_nodes[i] = node.get();
+				}
+			}
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			RT_COUNT(ray_stats::local().hits += results[i].hit);
+	}
+
 	raycast_result sphere::intersect(const ray& ray) const
 	{
 		raycast_result result;
@@ -436,10 +903,53 @@ namespace rt
 			result.normal.y * 0.5f + 0.5f
 		};
 
+		// The uv space (area 1) is mapped on the whole unit sphere surface
+		result.uv_density = 1.0f / glm::sqrt(4.0f * glm::pi<float>());
+
 
 		return result;
 	}
 	
+	compiled_material::compiled_material(const rt::material& material)
+	{
+		// Constant samplers are resolved now, textured ones are kept for shading time
+		const auto bake = [this](const std::shared_ptr<const sampler_2d>& sampler, channel ch, const sampler_2d*& target) -> glm::vec3 {
+			if (sampler->is_constant())
+				return sampler->average();
+
+			textured_channels |= ch;
+			target = sampler.get();
+			return glm::vec3(0.0f);
+		};
+
+		constants.albedo = bake(material.albedo, albedo_channel, albedo);
+		constants.emission = bake(material.emission, emission_channel, emission);
+		constants.roughness = bake(material.roughness, roughness_channel, roughness).r;
+		constants.metallic = bake(material.metallic, metallic_channel, metallic).r;
+	}
+
+	material_sample compiled_material::sample(const glm::vec2& uv, float footprint) const
+	{
+		material_sample result = constants;
+
+		if (textured_channels == 0)
+			return result;
+
+		if (textured_channels & albedo_channel)
+			result.albedo = albedo->sample(uv, footprint);
+
+		if (textured_channels & emission_channel)
+			result.emission = emission->sample(uv, footprint);
+
+		if (textured_channels & roughness_channel)
+			result.roughness = roughness->sample(uv, footprint).r;
+
+		if (textured_channels & metallic_channel)
+			result.metallic = metallic->sample(uv, footprint).r;
+
+		return result;
+	}
+
 	material::material()
 	{
 		albedo = std::make_shared<color_sampler>(glm::vec3(1.0f, 1.0f, 1.0f));
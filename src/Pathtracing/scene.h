@@ -4,10 +4,13 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <limits>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include "memory_stats.h"
 
 namespace rt {
 
@@ -20,10 +23,22 @@ namespace rt {
 	{
 		glm::vec3 origin;
 		glm::vec3 direction;
+
+		/// <summary>
+		/// Ray cone used to estimate the texture footprint (a compact form of ray differentials):
+		/// width of the cone at the origin and its spread angle (radians)
+		/// </summary>
+		float cone_width = 0.0f;
+		float cone_angle = 0.0f;
 	};
 
 	ray operator*(const glm::mat4& m, const ray& r);
 
+	/// <summary>
+	/// Maximum number of rays traced together by scene::cast_packet (a 4x4 block of pixels)
+	/// </summary>
+	static constexpr size_t s_max_packet_size = 16;
+
 	struct camera
 	{
 	public:
@@ -50,6 +65,54 @@ namespace rt {
 		glm::vec3 position;
 		glm::vec3 normal;
 		glm::vec2 uv;
+
+		/// <summary>
+		/// Uv units per world unit at the hit point
+		/// </summary>
+		float uv_density = 0.0f;
+	};
+
+	/// <summary>
+	/// A read-only array that either owns its elements or references memory owned by
+	/// someone else (e.g. a memory mapped file), kept alive by a shared owner
+	/// </summary>
+	template<typename T>
+	class data_buffer
+	{
+	public:
+		data_buffer() = default;
+		data_buffer(std::vector<T> elements) : m_elements(std::move(elements)) {}
+		data_buffer(const T* data, size_t size, std::shared_ptr<const void> owner) :
+			m_data(data), m_size(size), m_owner(std::move(owner)) {}
+
+		const T* data() const { return m_owner ? m_data : m_elements.data(); }
+		size_t size() const { return m_owner ? m_size : m_elements.size(); }
+		bool empty() const { return size() == 0; }
+
+		const T* begin() const { return data(); }
+		const T* end() const { return data() + size(); }
+		const T& operator[](size_t i) const { return data()[i]; }
+
+		/// <summary>
+		/// Returns the elements for editing. Referenced elements are copied first
+		/// </summary>
+		std::vector<T>& edit()
+		{
+			if (m_owner)
+			{
+				m_elements.assign(m_data, m_data + m_size);
+				m_owner.reset();
+				m_data = nullptr;
+				m_size = 0;
+			}
+			return m_elements;
+		}
+
+	private:
+		std::vector<T> m_elements;
+		const T* m_data = nullptr;
+		size_t m_size = 0;
+		std::shared_ptr<const void> m_owner;
 	};
 
 	/// <summary>
@@ -90,15 +153,29 @@ namespace rt {
 	};
 
 	/// <summary>
-	/// A triangle
+	/// Intersection data of a triangle, derived from the vertices of a mesh by mesh::compile
 	/// </summary>
 	class triangle
 	{
 	public:
+		triangle() {}
+
+		/// <summary>
+		/// Computes the intersection data of a triangle
+		/// </summary>
+		/// <param name="p0">First vertex position</param>
+		/// <param name="p1">Second vertex position</param>
+		/// <param name="p2">Third vertex position</param>
+		/// <param name="uv0">First vertex uv</param>
+		/// <param name="uv1">Second vertex uv</param>
+		/// <param name="uv2">Third vertex uv</param>
+		triangle(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2,
+			const glm::vec2& uv0, const glm::vec2& uv1, const glm::vec2& uv2);
+
 		/// <summary>
-		/// The vertices
+		/// Get the position of the first vertex
 		/// </summary>
-		std::array<vertex, 3> vertices;
+		const glm::vec3& get_origin() const { return m_origin; }
 
 		/// <summary>
 		/// Get the face normal (ai, cross product between 2 edges)
@@ -106,6 +183,11 @@ namespace rt {
 		/// <returns></returns>
 		const glm::vec3& get_face_normal() const { return m_face_normal; }
 
+		/// <summary>
+		/// Get the uv units per local unit on this triangle (ie, square root of uv area over surface area)
+		/// </summary>
+		float get_uv_density() const { return m_uv_density; }
+
 		/// <summary>
 		/// Compute baricentric coordinates
 		/// </summary>
@@ -114,14 +196,22 @@ namespace rt {
 		glm::vec3 baricentric(const glm::vec3& point) const;
 
 		/// <summary>
-		/// Updates internal values that are used for computing intersection faster.
-		/// Must be called when vertices are updated
+		/// Compute baricentric coordinates of several points at once, given as arrays of coordinates
 		/// </summary>
-		void update();
+		/// <param name="x">X coordinates of the points</param>
+		/// <param name="y">Y coordinates of the points</param>
+		/// <param name="z">Z coordinates of the points</param>
+		/// <param name="count">Number of points</param>
+		/// <param name="u">First coordinates of the result</param>
+		/// <param name="v">Second coordinates of the result</param>
+		/// <param name="w">Third coordinates of the result</param>
+		void baricentric(const float* x, const float* y, const float* z, size_t count, float* u, float* v, float* w) const;
 
 	private:
-		std::array<glm::vec3, 3> m_edges;
+		glm::vec3 m_origin;
+		std::array<glm::vec3, 2> m_edges;
 		glm::vec3 m_face_normal;
+		float m_uv_density;
 		float m_d00, m_d01, m_d11;
 		float m_inv_den;
 	};
@@ -133,62 +223,135 @@ namespace rt {
 	struct material
 	{
 		material();
-		std::shared_ptr<sampler_2d> albedo;
-		std::shared_ptr<sampler_2d> emission;
-		std::shared_ptr<sampler_2d> roughness;
-		std::shared_ptr<sampler_2d> metallic;
+		std::shared_ptr<const sampler_2d> albedo;
+		std::shared_ptr<const sampler_2d> emission;
+		std::shared_ptr<const sampler_2d> roughness;
+		std::shared_ptr<const sampler_2d> metallic;
+	};
+
+	/// <summary>
+	/// Material properties at a given surface point
+	/// </summary>
+	struct material_sample
+	{
+		glm::vec3 albedo;
+		glm::vec3 emission;
+		float roughness;
+		float metallic;
+	};
+
+	/// <summary>
+	/// A material baked by scene::compile for fast shading. Constant channels are stored
+	/// inline, only textured channels keep a pointer to their sampler
+	/// </summary>
+	struct compiled_material
+	{
+		enum channel : uint32_t
+		{
+			albedo_channel = 1 << 0,
+			emission_channel = 1 << 1,
+			roughness_channel = 1 << 2,
+			metallic_channel = 1 << 3
+		};
+
+		material_sample constants;
+		uint32_t textured_channels = 0;
+		const sampler_2d* albedo = nullptr;
+		const sampler_2d* emission = nullptr;
+		const sampler_2d* roughness = nullptr;
+		const sampler_2d* metallic = nullptr;
+
+		/// <summary>
+		/// Bakes the given material. The samplers must outlive the compiled material
+		/// </summary>
+		/// <param name="material">The material</param>
+		compiled_material(const rt::material& material);
+
+		/// <summary>
+		/// Samples the material at the given uv
+		/// </summary>
+		/// <param name="uv">Uv coordinates</param>
+		/// <param name="footprint">Footprint of the sample in uv units</param>
+		material_sample sample(const glm::vec2& uv, float footprint = 0.0f) const;
+	};
+
+	/// <summary>
+	/// A node of a KD-tree. Children are referenced by their index in the node array
+	/// </summary>
+	struct kd_tree_node
+	{
+		static constexpr uint32_t s_no_child = std::numeric_limits<uint32_t>::max();
+
+		bounding_box bounds;
+		uint32_t left = s_no_child;
+		uint32_t right = s_no_child;
+
+		/// <summary>
+		/// Range of this node's triangles in kd_tree::get_triangle_indices()
+		/// </summary>
+		uint32_t first_triangle = 0;
+		uint32_t triangle_count = 0;
+
+		uint32_t depth = 0;
 	};
 
 	/// <summary>
 	/// A KD-tree for triangles. Internally used by Mesh to optimize intersection tests.
+	/// Nodes and triangle references are stored in flat arrays (root first), so a tree can be
+	/// saved and used directly from a file
 	/// </summary>
-	class kd_tree_node
+	class kd_tree
 	{
 	public:
 		/// <summary>
-		/// Constructs and empty node
+		/// Maximum depth of a node
+		/// </summary>
+		static constexpr uint32_t s_max_depth = 100;
+
+		/// <summary>
+		/// Constructs and empty tree
 		/// </summary>
-		kd_tree_node() {}
+		kd_tree() {}
 
 		/// <summary>
-		/// Recursively constructs a tree
+		/// Builds a tree
 		/// </summary>
-		/// <param name="triangles">The triangles</param>
+		/// <param name="positions">The vertex positions</param>
+		/// <param name="indices">The vertex indices, 3 per triangle</param>
 		/// <param name="bounds">A bounding box that contains all the triangles</param>
-		/// <param name="depth">The depth of this node</param>
-		kd_tree_node(const std::vector<triangle>& triangles, const bounding_box& bounds, uint32_t depth);
+		kd_tree(const data_buffer<glm::vec3>& positions, const data_buffer<uint32_t>& indices, const bounding_box& bounds);
 
 		/// <summary>
-		/// Returns the maximum depth of the tree
+		/// Wraps an already built tree
 		/// </summary>
-		const uint32_t get_max_depth() const;
+		/// <param name="nodes">The nodes</param>
+		/// <param name="triangle_indices">The triangle indices referenced by the nodes</param>
+		kd_tree(data_buffer<kd_tree_node> nodes, data_buffer<uint32_t> triangle_indices) :
+			m_nodes(std::move(nodes)), m_triangle_indices(std::move(triangle_indices)) {}
 
 		/// <summary>
-		/// Returns the triangles contained in this node
+		/// Returns the maximum depth of the tree
 		/// </summary>
-		const std::vector<triangle>& get_triangles() const { return m_triangles; }
-		
+		uint32_t get_max_depth() const;
+
 		/// <summary>
-		/// Returns the bounds of this node
+		/// Returns the memory used by the nodes and the triangle references
 		/// </summary>
-		const bounding_box& get_bounds() const { return m_bounds; }
+		size_t get_size_in_bytes() const { return m_nodes.size() * sizeof(kd_tree_node) + m_triangle_indices.size() * sizeof(uint32_t); }
 
 		/// <summary>
-		/// Returns the left child, or nullptr if this node is a leaf
+		/// Returns the nodes, the root being the first one
 		/// </summary>
-		const std::unique_ptr<kd_tree_node>& get_left() const { return m_left; }
-		
+		const data_buffer<kd_tree_node>& get_nodes() const { return m_nodes; }
+
 		/// <summary>
-		/// Returns the right child, or nullptr if this node is a leaf
+		/// Returns the triangle indices referenced by the nodes
 		/// </summary>
-		const std::unique_ptr<kd_tree_node>& get_right() const { return  m_right; }
+		const data_buffer<uint32_t>& get_triangle_indices() const { return m_triangle_indices; }
 
 	private:
-		uint32_t m_depth = 0;
-		bounding_box m_bounds;
-		std::vector<triangle> m_triangles;
-		std::unique_ptr<kd_tree_node> m_left = nullptr;
-		std::unique_ptr<kd_tree_node> m_right = nullptr;
+		data_buffer<kd_tree_node> m_nodes;
+		data_buffer<uint32_t> m_triangle_indices;
 	};
 
 	class object_id
@@ -218,6 +381,19 @@ namespace rt {
 		/// <returns>The result of the intersection</returns>
 		virtual raycast_result intersect(const ray& ray) const = 0;
 
+		/// <summary>
+		/// Intersection test of a packet of coherent rays with this shape. The default
+		/// implementation tests the rays one by one
+		/// </summary>
+		/// <param name="rays">The rays, in local coordinates</param>
+		/// <param name="count">The number of rays, at most s_max_packet_size</param>
+		/// <param name="results">The results of the intersections, one per ray</param>
+		virtual void intersect(const ray* rays, size_t count, raycast_result* results) const
+		{
+			for (size_t i = 0; i < count; ++i)
+				results[i] = intersect(rays[i]);
+		}
+
 		/// <summary>
 		/// Get the local bounds of this shape
 		/// </summary>
@@ -231,6 +407,8 @@ namespace rt {
 	class sphere : public shape
 	{
 	public:
+		using shape::intersect;
+
 		void compile() override {}
 		raycast_result intersect(const ray& ray) const override;
 		const bounding_box& get_bounds() const override { return m_Bounds; }
@@ -239,43 +417,136 @@ namespace rt {
 	};
 
 	/// <summary>
-	/// A triangle mesh
+	/// A triangle mesh. Vertices are stored as separate position, normal and uv streams
+	/// (of the same size) indexed by a triangle list
 	/// </summary>
 	class mesh: public shape, public object_id
 	{
 	private:
-		
-
-		raycast_result intersect_triangle(const ray& ray, const triangle& triangle) const;
-		void intersect_internal(const ray& ray, const std::unique_ptr<kd_tree_node>& node, raycast_result& result, float& distance) const;
+		/// <summary>
+		/// Interpolates the vertex attributes of the closest hit
+		/// </summary>
+		void interpolate(uint32_t triangle, const glm::vec3& bar, raycast_result& result) const;
 
 		bounding_box m_bounds;
-		std::vector<triangle> m_triangles;
-		std::unique_ptr<kd_tree_node> m_tree;
+		data_buffer<glm::vec3> m_positions;
+		data_buffer<glm::vec3> m_normals;
+		data_buffer<glm::vec2> m_uvs;
+		data_buffer<uint32_t> m_indices;
+		data_buffer<triangle> m_triangles;
+		kd_tree m_tree;
+		bool m_compiled = false;
 	
 	public:
+		mesh() {}
+
+		/// <summary>
+		/// Constructs an already compiled mesh (e.g. loaded from a cache)
+		/// </summary>
+		/// <param name="positions">The vertex positions</param>
+		/// <param name="normals">The vertex normals</param>
+		/// <param name="uvs">The vertex uvs</param>
+		/// <param name="indices">The vertex indices, 3 per triangle</param>
+		/// <param name="triangles">The intersection data of the triangles</param>
+		/// <param name="tree">The KD-tree built for the triangles</param>
+		/// <param name="bounds">The bounds of the triangles</param>
+		mesh(data_buffer<glm::vec3> positions, data_buffer<glm::vec3> normals, data_buffer<glm::vec2> uvs,
+			data_buffer<uint32_t> indices, data_buffer<triangle> triangles, kd_tree tree, const bounding_box& bounds);
+
 		const bounding_box& get_bounds() const override { return m_bounds; }
+
+		/// <summary>
+		/// Returns the vertex positions
+		/// </summary>
+		const data_buffer<glm::vec3>& get_positions() const { return m_positions; }
+
+		/// <summary>
+		/// Returns the vertex normals
+		/// </summary>
+		const data_buffer<glm::vec3>& get_normals() const { return m_normals; }
+
+		/// <summary>
+		/// Returns the vertex uvs
+		/// </summary>
+		const data_buffer<glm::vec2>& get_uvs() const { return m_uvs; }
+
+		/// <summary>
+		/// Returns the vertex indices, 3 per triangle
+		/// </summary>
+		const data_buffer<uint32_t>& get_indices() const { return m_indices; }
 		
 		/// <summary>
-		/// Returns the triangles of this mesh
+		/// Returns the intersection data of the triangles, available once the mesh is compiled
+		/// </summary>
+		const data_buffer<triangle>& get_triangles() const { return m_triangles; }
+
+		/// <summary>
+		/// Returns the number of vertices
+		/// </summary>
+		size_t get_vertex_count() const { return m_positions.size(); }
+
+		/// <summary>
+		/// Returns the number of triangles
+		/// </summary>
+		size_t get_triangle_count() const { return m_indices.size() / 3; }
+
+		/// <summary>
+		/// Returns the memory used by the vertices, the triangles and the KD-tree
+		/// </summary>
+		size_t get_size_in_bytes() const;
+
+		/// <summary>
+		/// Reserves memory for the given number of vertices and triangles
 		/// </summary>
-		const std::vector<triangle>& get_triangles() const { return m_triangles; }
+		void reserve(size_t vertices, size_t triangles);
+
+		/// <summary>
+		/// Adds a new vertex
+		/// </summary>
+		/// <returns>The index of the new vertex</returns>
+		uint32_t add_vertex(const vertex& v);
 
 		/// <summary>
 		/// Adds a new triangle
 		/// </summary>
-		/// <returns>A reference to the new triangle</returns>
-		triangle& add_triangle();
+		/// <param name="i0">Index of the first vertex</param>
+		/// <param name="i1">Index of the second vertex</param>
+		/// <param name="i2">Index of the third vertex</param>
+		void add_triangle(uint32_t i0, uint32_t i1, uint32_t i2);
 
+		/// <summary>
+		/// Intersection test of a ray with a single triangle, from its front side
+		/// </summary>
+		/// <param name="ray">The ray</param>
+		/// <param name="triangle">The triangle</param>
+		/// <param name="position">The hit position, if any</param>
+		/// <param name="bar">The baricentric coordinates of the hit, if any</param>
+		/// <returns>true if the ray hits the triangle</returns>
+		static bool intersect_triangle(const ray& ray, const triangle& triangle, glm::vec3& position, glm::vec3& bar);
 
 		raycast_result intersect(const ray& ray) const override;
+
+		/// <summary>
+		/// Traverses the KD-tree once for the whole packet. Nodes are tested against the
+		/// packet bounds first, then against each ray. Gives the same results as "intersect"
+		/// </summary>
+		void intersect(const ray* rays, size_t count, raycast_result* results) const override;
 		
+		/// <summary>
+		/// Computes the intersection data of the triangles and builds the KD-tree.
+		/// Does nothing if the mesh hasn't changed since the last call
+		/// </summary>
 		void compile() override;
+
+		/// <summary>
+		/// Returns true if the mesh is compiled
+		/// </summary>
+		bool is_compiled() const { return m_compiled; }
 		
 		/// <summary>
 		/// Returns the current KD-tree for this mesh
 		/// </summary>
-		const std::unique_ptr<kd_tree_node>& get_kd_tree() const { return m_tree; }
+		const kd_tree& get_kd_tree() const { return m_tree; }
 	};
 
 	/// <summary>
@@ -285,9 +556,17 @@ namespace rt {
 	{
 
 	private:
+		friend class scene;
+
+		/// <summary>
+		/// Index of the material in the last scene compiled with this node. Nodes can be shared by
+		/// several scenes, the scene checks that the index is its own (see scene::get_material_id)
+		/// </summary>
+		uint32_t m_index = 0;
 		glm::mat4 m_transform = glm::identity<glm::mat4>();
 		glm::mat4 m_inv_transform = glm::identity<glm::mat4>();
 		glm::mat4 m_normal_transform = glm::identity<glm::mat4>();
+		float m_average_scale = 1.0f;
 		void update_matrices();
 
 	public:
@@ -347,6 +626,11 @@ namespace rt {
 		/// </summary>
 		/// <returns></returns>
 		const glm::mat4& get_normal_transform() const { return m_normal_transform; }
+
+		/// <summary>
+		/// Returns the average scale factor of the current transform
+		/// </summary>
+		float get_average_scale() const { return m_average_scale; }
 	};
 
 	/// <summary>
@@ -366,7 +650,7 @@ namespace rt {
 		/// <summary>
 		/// The scene's background
 		/// </summary>
-		std::shared_ptr<sampler_3d> background = nullptr;
+		std::shared_ptr<const sampler_3d> background = nullptr;
 
 		/// <summary>
 		/// The scene's nodes
@@ -381,15 +665,50 @@ namespace rt {
 		/// <param name="avoid_nodes">If non-emtpy, this nodes will not be considered for intersection tests</param>
 		/// <returns>The closest intersection</returns>
 		std::tuple<raycast_result, std::shared_ptr<scene_node>> cast_ray(const ray& ray, bool return_on_first_hit = false, const std::vector<std::shared_ptr<scene_node>>& avoid_nodes = {}) const;
+
+		/// <summary>
+		/// Cast a packet of coherent rays (e.g. camera rays of neighbour pixels) on the scene.
+		/// Gives the same results as "cast_ray" for each ray
+		/// </summary>
+		/// <param name="rays">The rays</param>
+		/// <param name="count">The number of rays, at most s_max_packet_size</param>
+		/// <param name="results">The closest intersection of each ray</param>
+		/// <param name="hit_nodes">The node hit by each ray, nullptr if nothing was hit</param>
+		void cast_packet(const ray* rays, size_t count, raycast_result* results, const scene_node** hit_nodes) const;
 		
 		/// <summary>
 		/// Get all the nodes that emit light. This takes into account the Emission property of the material
 		/// </summary>
 		const std::vector<std::shared_ptr<scene_node>>& get_light_sources() const { return m_light_sources; }
 
+		/// <summary>
+		/// Returns the compiled material of the given node. Only valid after "compile"
+		/// </summary>
+		const compiled_material& get_material(const scene_node& node) const { return m_materials[get_material_id(node)]; }
+
+		/// <summary>
+		/// Returns the index of the compiled material of the given node, less than the number of nodes. Only valid after
+		/// "compile", for a node of this scene. The index kept by the node is used when it's the one of this scene, nodes
+		/// also compiled by another scene since are looked up
+		/// </summary>
+		uint32_t get_material_id(const scene_node& node) const
+		{
+			const uint32_t index = node.m_index;
+			return index < m_material_nodes.size() && m_material_nodes[index] == &node ? index : m_material_ids.at(&node);
+		}
+
+		/// <summary>
+		/// Returns the memory used by the meshes, their KD-trees, the textures and the texture cache.
+		/// Shared meshes and samplers are counted once. Framebuffers are left to the renderer
+		/// </summary>
+		memory_stats get_memory_stats() const;
+
 		void compile();
 
 	private:
 		std::vector<std::shared_ptr<scene_node>> m_light_sources;
+		std::vector<compiled_material> m_materials;
+		std::vector<const scene_node*> m_material_nodes;
+		std::unordered_map<const scene_node*, uint32_t> m_material_ids;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "temp_file.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace rt
+{
+	namespace
+	{
+		uint64_t get_process_id()
+		{
+#ifdef _WIN32
+			return uint64_t(GetCurrentProcessId());
+#else
+			return uint64_t(getpid());
+#endif
+		}
+
+		std::atomic<uint64_t> s_next_temp_file{ 0 };
+	}
+
+	std::string get_temp_file_name(std::string_view file_name)
+	{
+		const size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+		return fmt::format("{0}.{1}.{2:x}.{3}.tmp", file_name, get_process_id(), thread, s_next_temp_file++);
+	}
+}
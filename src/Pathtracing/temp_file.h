@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace rt
+{
+	/// <summary>
+	/// Returns a name for a temporary file next to the given one, unique to the calling process and
+	/// thread, ie "file.<pid>.<thread>.<n>.tmp". Files are written there, then renamed to their
+	/// final name, so that concurrent writers never write into the same file
+	/// </summary>
+	/// <param name="file_name">The final file</param>
+	std::string get_temp_file_name(std::string_view file_name);
+}
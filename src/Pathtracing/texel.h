@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "sampler.h"
+
+// Encoding and decoding of the texel formats, shared by the image samplers
+
+namespace rt {
+
+	// Decode table for gamma encoded 8 bit channels (same curve as stbi_loadf)
+	inline const std::array<float, 256> s_srgb_to_linear = [] {
+		std::array<float, 256> table;
+		for (size_t i = 0; i < table.size(); ++i)
+			table[i] = std::pow(i / 255.0f, 2.2f);
+		return table;
+	}();
+
+	inline size_t texel_size(texel_format format)
+	{
+		switch (format)
+		{
+		case texel_format::rgba8_srgb: return 4;
+		case texel_format::rgb16f: return 6;
+		case texel_format::rgb9e5: return 4;
+		default: return sizeof(glm::vec3);
+		}
+	}
+
+	template<texel_format Format>
+	inline glm::vec3 decode(const uint8_t* texels, size_t index)
+	{
+		if constexpr (Format == texel_format::rgba8_srgb)
+		{
+			const uint8_t* t = texels + index * 4;
+			return { s_srgb_to_linear[t[0]], s_srgb_to_linear[t[1]], s_srgb_to_linear[t[2]] };
+		}
+		else if constexpr (Format == texel_format::rgb16f)
+		{
+			uint16_t t[3];
+			std::memcpy(t, texels + index * 6, sizeof(t));
+			return { glm::unpackHalf1x16(t[0]), glm::unpackHalf1x16(t[1]), glm::unpackHalf1x16(t[2]) };
+		}
+		else if constexpr (Format == texel_format::rgb9e5)
+		{
+			uint32_t t;
+			std::memcpy(&t, texels + index * 4, sizeof(t));
+			return glm::unpackF3x9_E1x5(t);
+		}
+		else
+		{
+			glm::vec3 t;
+			std::memcpy(&t, texels + index * sizeof(glm::vec3), sizeof(t));
+			return t;
+		}
+	}
+
+	inline glm::vec3 decode(texel_format format, const uint8_t* texels, size_t index)
+	{
+		switch (format)
+		{
+		case texel_format::rgba8_srgb: return decode<texel_format::rgba8_srgb>(texels, index);
+		case texel_format::rgb16f: return decode<texel_format::rgb16f>(texels, index);
+		case texel_format::rgb9e5: return decode<texel_format::rgb9e5>(texels, index);
+		default: return decode<texel_format::rgb32f>(texels, index);
+		}
+	}
+
+	inline void encode(texel_format format, uint8_t* texels, size_t index, const glm::vec3& color)
+	{
+		switch (format)
+		{
+		case texel_format::rgba8_srgb:
+		{
+			const auto c = glm::round(glm::pow(glm::clamp(color, 0.0f, 1.0f), glm::vec3(1.0f / 2.2f)) * 255.0f);
+			const uint8_t t[4] = { uint8_t(c.r), uint8_t(c.g), uint8_t(c.b), 255 };
+			std::memcpy(texels + index * 4, t, sizeof(t));
+			break;
+		}
+		case texel_format::rgb16f:
+		{
+			const uint16_t t[3] = { glm::packHalf1x16(color.r), glm::packHalf1x16(color.g), glm::packHalf1x16(color.b) };
+			std::memcpy(texels + index * 6, t, sizeof(t));
+			break;
+		}
+		case texel_format::rgb9e5:
+		{
+			const uint32_t t = glm::packF3x9_E1x5(color);
+			std::memcpy(texels + index * 4, &t, sizeof(t));
+			break;
+		}
+		default:
+			std::memcpy(texels + index * sizeof(glm::vec3), &color, sizeof(color));
+			break;
+		}
+	}
+}
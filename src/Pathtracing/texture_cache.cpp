@@ -0,0 +1,503 @@
+#include "texture_cache.h"
+#include "texel.h"
+#include "temp_file.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+namespace rt {
+
+	namespace
+	{
+		// Bump when the layout of the file changes
+		static constexpr uint32_t s_version = 1;
+		static constexpr char s_magic[8] = { 'R', 'T', 'T', 'E', 'X', '\0', '\0', '\0' };
+		static constexpr uint64_t s_empty_key = UINT64_MAX;
+		static constexpr uint64_t s_mix = 0x9e3779b97f4a7c15ull;
+
+		struct tiled_header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t format;
+			uint32_t tile_size;
+			uint32_t level_count;
+			uint64_t source;
+			float average[3];
+			uint32_t reserved = 0;
+		};
+
+		struct tiled_level
+		{
+			uint32_t width, height;
+			uint64_t offset;
+		};
+
+		std::atomic<uint32_t> s_next_image_id = 0;
+
+		/// <summary>
+		/// Increments a counter only written by the calling thread, without a locked instruction
+		/// </summary>
+		inline void bump(std::atomic<uint64_t>& counter)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		/// <summary>
+		/// Mixes the bits of a tile key, image and level are in the high bits
+		/// </summary>
+		inline uint64_t hash_key(uint64_t key)
+		{
+			const uint64_t h = (key ^ (key >> 32) ^ (key >> 40)) * s_mix;
+			return h ^ (h >> 29);
+		}
+
+		inline uint32_t tiles_for(uint32_t size, uint32_t tile_shift)
+		{
+			return (size + (1u << tile_shift) - 1) >> tile_shift;
+		}
+	}
+
+	/// <summary>
+	/// The last tiles used by a thread, 2-way set associative so that the two mip levels of
+	/// a filtered lookup don't evict each other
+	/// </summary>
+	struct texture_cache::local_cache
+	{
+		static constexpr size_t s_set_count = 32;
+
+		struct slot
+		{
+			uint64_t key = s_empty_key;
+			std::shared_ptr<const tile> texels;
+		};
+
+		texture_cache& cache;
+		// The most recently used slot of each set first
+		std::array<std::array<slot, 2>, s_set_count> sets;
+		std::atomic<uint64_t> lookups{ 0 };
+		std::atomic<uint64_t> hits{ 0 };
+
+		local_cache(texture_cache& cache) : cache(cache)
+		{
+			std::lock_guard<std::mutex> lock(cache.m_local_mutex);
+			cache.m_local_caches.push_back(this);
+		}
+
+		~local_cache()
+		{
+			std::lock_guard<std::mutex> lock(cache.m_local_mutex);
+			cache.m_retired_lookups += lookups;
+			cache.m_retired_hits += hits;
+			cache.m_local_caches.erase(std::find(cache.m_local_caches.begin(), cache.m_local_caches.end(), this));
+		}
+	};
+
+	texture_cache& texture_cache::get_instance()
+	{
+		static texture_cache s_instance;
+		return s_instance;
+	}
+
+	texture_cache::local_cache& texture_cache::get_local_cache()
+	{
+		thread_local local_cache s_local(get_instance());
+		return s_local;
+	}
+
+	const texture_cache::tile& texture_cache::get_tile(const tiled_image& image, uint32_t level, uint32_t index)
+	{
+		const uint64_t key = (uint64_t(image.m_id) << 40) | (uint64_t(level) << 32) | index;
+		auto& local = get_local_cache();
+		auto& set = local.sets[hash_key(key) >> 59];
+
+		bump(local.lookups);
+
+		if (set[0].key == key)
+		{
+			bump(local.hits);
+			return *set[0].texels;
+		}
+
+		if (set[1].key != key)
+			set[1] = { key, get_shared_tile(image, level, index, key) };
+		else
+			bump(local.hits);
+
+		std::swap(set[0], set[1]);
+		return *set[0].texels;
+	}
+
+	std::shared_ptr<const texture_cache::tile> texture_cache::get_shared_tile(const tiled_image& image, uint32_t level, uint32_t index, uint64_t key)
+	{
+		auto& s = m_shards[(hash_key(key) >> 55) & (s_shard_count - 1)];
+
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			const auto it = s.tiles.find(key);
+
+			if (it != s.tiles.end())
+			{
+				s.lru.splice(s.lru.begin(), s.lru, it->second.second);
+				++m_shared_hits;
+				return it->second.first;
+			}
+		}
+
+		// Read outside of the lock. Threads missing the same tile at the same time all read
+		// it, the first one inserted is kept
+		auto texels = std::make_shared<const tile>(image.read_tile(level, index));
+
+		++m_loads;
+		m_bytes_loaded += texels->size();
+
+		std::lock_guard<std::mutex> lock(s.mutex);
+		const auto it = s.tiles.find(key);
+
+		if (it != s.tiles.end())
+			return it->second.first;
+
+		s.lru.push_front(key);
+		s.tiles.emplace(key, std::make_pair(texels, s.lru.begin()));
+		s.size += texels->size();
+		evict(s);
+
+		return texels;
+	}
+
+	void texture_cache::evict(shard& s)
+	{
+		const size_t budget = m_budget / s_shard_count;
+
+		// The most recent tile is kept, it's being returned
+		while (s.size > budget && s.lru.size() > 1)
+		{
+			const auto it = s.tiles.find(s.lru.back());
+			s.size -= it->second.first->size();
+			s.tiles.erase(it);
+			s.lru.pop_back();
+			++m_evictions;
+		}
+	}
+
+	void texture_cache::set_memory_budget(size_t bytes)
+	{
+		m_budget = bytes;
+
+		for (auto& s : m_shards)
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			evict(s);
+		}
+	}
+
+	texture_cache_stats texture_cache::get_stats() const
+	{
+		texture_cache_stats stats;
+
+		{
+			std::lock_guard<std::mutex> lock(m_local_mutex);
+			stats.lookups = m_retired_lookups;
+			stats.local_hits = m_retired_hits;
+
+			for (const auto* local : m_local_caches)
+			{
+				stats.lookups += local->lookups.load(std::memory_order_relaxed);
+				stats.local_hits += local->hits.load(std::memory_order_relaxed);
+			}
+		}
+
+		stats.shared_hits = m_shared_hits;
+		stats.loads = m_loads;
+		stats.bytes_loaded = m_bytes_loaded;
+		stats.evictions = m_evictions;
+
+		for (auto& s : m_shards)
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			stats.resident_bytes += s.size;
+		}
+
+		return stats;
+	}
+
+	void texture_cache::clear()
+	{
+		for (auto& s : m_shards)
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			s.tiles.clear();
+			s.lru.clear();
+			s.size = 0;
+		}
+	}
+
+	tiled_image::tiled_image() :
+		m_id(s_next_image_id++ & 0xffffff)
+	{
+	}
+
+	bool tiled_image::write(const image& image, std::string_view file_name, uint64_t source, uint32_t tile_size)
+	{
+		if (tile_size < 4 || (tile_size & (tile_size - 1)) != 0)
+		{
+			spdlog::error("Invalid tile size: {0}", tile_size);
+			return false;
+		}
+
+		uint32_t tile_shift = 0;
+
+		while ((1u << tile_shift) < tile_size)
+			++tile_shift;
+
+		const auto format = image.get_format();
+		const size_t tile_bytes = size_t(tile_size) * tile_size * texel_size(format);
+		const auto average = image.average();
+
+		tiled_header header;
+		std::memcpy(header.magic, s_magic, sizeof(s_magic));
+		header.version = s_version;
+		header.format = uint32_t(format);
+		header.tile_size = tile_size;
+		header.level_count = uint32_t(image.get_mip_levels());
+		header.source = source;
+		header.average[0] = average.x;
+		header.average[1] = average.y;
+		header.average[2] = average.z;
+
+		std::vector<tiled_level> levels(header.level_count);
+		uint64_t offset = sizeof(tiled_header) + levels.size() * sizeof(tiled_level);
+
+		for (size_t i = 0; i < levels.size(); ++i)
+		{
+			const auto size = image.get_level_size(i);
+			levels[i] = { size.x, size.y, offset };
+			offset += uint64_t(tiles_for(size.x, tile_shift)) * tiles_for(size.y, tile_shift) * tile_bytes;
+		}
+
+		// Write to a temporary file first, so that a partial file is never picked up
+		const std::string temp_file = get_temp_file_name(file_name);
+		std::ofstream os(temp_file, std::ios::binary | std::ios::trunc);
+
+		if (!os.good())
+			return false;
+
+		os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		os.write(reinterpret_cast<const char*>(levels.data()), std::streamsize(levels.size() * sizeof(tiled_level)));
+
+		std::vector<uint8_t> texels(tile_bytes);
+
+		for (size_t i = 0; i < levels.size() && os.good(); ++i)
+		{
+			const uint32_t width = levels[i].width;
+			const uint32_t height = levels[i].height;
+
+			for (uint32_t ty = 0; ty < tiles_for(height, tile_shift); ++ty)
+			{
+				for (uint32_t tx = 0; tx < tiles_for(width, tile_shift); ++tx)
+				{
+					// Tiles are full, texels past the edges repeat the last row/column
+					for (uint32_t y = 0; y < tile_size; ++y)
+					{
+						for (uint32_t x = 0; x < tile_size; ++x)
+						{
+							const uint32_t px = std::min((tx << tile_shift) + x, width - 1);
+							const uint32_t py = std::min((ty << tile_shift) + y, height - 1);
+							encode(format, texels.data(), (y << tile_shift) | x, image.get_level_pixel(i, px, py));
+						}
+					}
+
+					os.write(reinterpret_cast<const char*>(texels.data()), std::streamsize(texels.size()));
+				}
+			}
+		}
+
+		os.close();
+
+		std::error_code error;
+
+		if (!os.good())
+		{
+			std::filesystem::remove(temp_file, error);
+			return false;
+		}
+
+		std::filesystem::rename(temp_file, std::filesystem::path(file_name), error);
+		return !error;
+	}
+
+	bool tiled_image::open(std::string_view file_name)
+	{
+		std::lock_guard<std::mutex> lock(m_file_mutex);
+
+		m_file.close();
+		m_levels.clear();
+		m_file.open(std::string(file_name), std::ios::binary);
+
+		if (!m_file.good())
+			return false;
+
+		m_file.seekg(0, std::ios::end);
+		const uint64_t file_size = uint64_t(m_file.tellg());
+		m_file.seekg(0);
+
+		tiled_header header;
+
+		if (!m_file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+			std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 ||
+			header.version != s_version ||
+			header.format > uint32_t(texel_format::rgb9e5) ||
+			header.tile_size < 4 || header.tile_size > 4096 || (header.tile_size & (header.tile_size - 1)) != 0 ||
+			header.level_count == 0 || header.level_count > 32)
+			return false;
+
+		std::vector<tiled_level> levels(header.level_count);
+
+		if (!m_file.read(reinterpret_cast<char*>(levels.data()), std::streamsize(levels.size() * sizeof(tiled_level))))
+			return false;
+
+		m_format = texel_format(header.format);
+		m_tile_shift = 0;
+
+		while ((1u << m_tile_shift) < header.tile_size)
+			++m_tile_shift;
+
+		m_tile_bytes = size_t(header.tile_size) * header.tile_size * texel_size(m_format);
+
+		for (const auto& l : levels)
+		{
+			const uint64_t tile_count = uint64_t(tiles_for(l.width, m_tile_shift)) * tiles_for(l.height, m_tile_shift);
+
+			if (l.width == 0 || l.height == 0 || l.offset > file_size || tile_count > (file_size - l.offset) / m_tile_bytes)
+			{
+				m_levels.clear();
+				return false;
+			}
+
+			m_levels.push_back({ l.width, l.height, tiles_for(l.width, m_tile_shift), l.offset });
+		}
+
+		m_source = header.source;
+		m_average = { header.average[0], header.average[1], header.average[2] };
+		return true;
+	}
+
+	texture_cache::tile tiled_image::read_tile(uint32_t level, uint32_t index) const
+	{
+		texture_cache::tile texels(m_tile_bytes);
+
+		std::lock_guard<std::mutex> lock(m_file_mutex);
+		m_file.seekg(std::streamoff(m_levels[level].offset + uint64_t(index) * m_tile_bytes));
+
+		if (!m_file.read(reinterpret_cast<char*>(texels.data()), std::streamsize(texels.size())))
+		{
+			spdlog::error("Can't read tile {0} of level {1}", index, level);
+			m_file.clear();
+			std::fill(texels.begin(), texels.end(), uint8_t(0));
+		}
+
+		return texels;
+	}
+
+	glm::vec3 tiled_image::sample(const glm::vec2& uv) const
+	{
+		return sample(uv, sample_mode);
+	}
+
+	glm::vec3 tiled_image::sample(const glm::vec2& uv, float footprint) const
+	{
+		return sample(uv, footprint, sample_mode);
+	}
+
+	glm::vec3 tiled_image::sample(const glm::vec2& uv, rt::sample_mode mode) const
+	{
+		return sample_level(0, uv, mode);
+	}
+
+	glm::vec3 tiled_image::sample(const glm::vec2& uv, float footprint, rt::sample_mode mode) const
+	{
+		const size_t mips = m_levels.size() - 1;
+
+		if (mips == 0 || footprint <= 0.0f)
+			return sample_level(0, uv, mode);
+
+		// Same level selection as rt::image
+		const float lod = glm::log2(footprint * std::max(m_levels[0].width, m_levels[0].height));
+
+		if (lod <= 0.0f)
+			return sample_level(0, uv, mode);
+
+		if (lod >= mips)
+			return sample_level(mips, uv, mode);
+
+		const size_t level = size_t(lod);
+
+		if (mode == sample_mode::nearest)
+			return sample_level(level, uv, mode);
+
+		return glm::mix(sample_level(level, uv, mode), sample_level(level + 1, uv, mode), lod - level);
+	}
+
+	glm::vec3 tiled_image::sample_level(size_t level, const glm::vec2& uv, rt::sample_mode mode) const
+	{
+		if (m_levels.empty())
+			return glm::vec3(0.0f);
+
+		switch (m_format)
+		{
+		case texel_format::rgba8_srgb: return sample_level<texel_format::rgba8_srgb>(level, uv, mode);
+		case texel_format::rgb16f: return sample_level<texel_format::rgb16f>(level, uv, mode);
+		case texel_format::rgb9e5: return sample_level<texel_format::rgb9e5>(level, uv, mode);
+		default: return sample_level<texel_format::rgb32f>(level, uv, mode);
+		}
+	}
+
+	template<texel_format Format>
+	glm::vec3 tiled_image::sample_level(size_t level, const glm::vec2& uv, rt::sample_mode mode) const
+	{
+		const auto& l = m_levels[level];
+		auto& cache = texture_cache::get_instance();
+
+		const auto uv0 = glm::fract(uv);
+
+		const float x = uv0.x * l.width;
+		const float y = uv0.y * l.height;
+
+		// The texels of a lookup are usually in the same tile, it's only fetched once
+		const uint32_t mask = (1u << m_tile_shift) - 1;
+		uint32_t current = UINT32_MAX;
+		const uint8_t* texels = nullptr;
+
+		const auto fetch = [&](uint32_t px, uint32_t py) {
+			const uint32_t index = (py >> m_tile_shift) * l.tiles_x + (px >> m_tile_shift);
+
+			if (index != current)
+			{
+				texels = cache.get_tile(*this, uint32_t(level), index).data();
+				current = index;
+			}
+
+			return decode<Format>(texels, ((py & mask) << m_tile_shift) | (px & mask));
+		};
+
+		if (mode == sample_mode::linear)
+		{
+			const uint32_t x0 = uint32_t(glm::floor(x)) % l.width;
+			const uint32_t x1 = uint32_t(glm::ceil(x)) % l.width;
+			const uint32_t y0 = uint32_t(glm::floor(y)) % l.height;
+			const uint32_t y1 = uint32_t(glm::ceil(y)) % l.height;
+
+			const auto v0 = glm::mix(fetch(x0, y0), fetch(x1, y0), x - x0);
+			const auto v1 = glm::mix(fetch(x0, y1), fetch(x1, y1), x - x0);
+			return glm::mix(v0, v1, y - y0);
+		}
+		else
+		{
+			const uint32_t ix = uint32_t(glm::round(x)) % l.width;
+			const uint32_t iy = uint32_t(glm::round(y)) % l.height;
+			return fetch(ix, iy);
+		}
+	}
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "sampler.h"
+
+namespace rt {
+
+	class tiled_image;
+
+	/// <summary>
+	/// Counters of a texture cache
+	/// </summary>
+	struct texture_cache_stats
+	{
+		/// <summary>
+		/// Tile lookups
+		/// </summary>
+		uint64_t lookups = 0;
+
+		/// <summary>
+		/// Lookups served by the cache of the calling thread
+		/// </summary>
+		uint64_t local_hits = 0;
+
+		/// <summary>
+		/// Lookups served by the shared cache
+		/// </summary>
+		uint64_t shared_hits = 0;
+
+		/// <summary>
+		/// Tiles read from file
+		/// </summary>
+		uint64_t loads = 0;
+		uint64_t bytes_loaded = 0;
+		uint64_t evictions = 0;
+
+		/// <summary>
+		/// Memory used by the tiles in the shared cache
+		/// </summary>
+		size_t resident_bytes = 0;
+
+		/// <summary>
+		/// Returns the fraction of the lookups that didn't read from file
+		/// </summary>
+		double get_hit_rate() const { return lookups > 0 ? double(lookups - loads) / lookups : 0.0; }
+	};
+
+	/// <summary>
+	/// The process-wide cache of the tiles of the tiled images. Tiles are loaded on first
+	/// access and evicted least recently used first when the cache is over its memory budget.
+	/// Each thread keeps the last tiles it used in a small lookup cache in front of the shared
+	/// one: these stay valid after eviction, so the actual memory may exceed the budget by
+	/// a few tiles per rendering thread
+	/// </summary>
+	class texture_cache
+	{
+	public:
+		using tile = std::vector<uint8_t>;
+
+		static constexpr size_t s_default_budget = size_t(256) << 20;
+
+		texture_cache(const texture_cache&) = delete;
+		texture_cache& operator=(const texture_cache&) = delete;
+
+		/// <summary>
+		/// Returns the cache of this process
+		/// </summary>
+		static texture_cache& get_instance();
+
+		/// <summary>
+		/// Returns a tile of an image, reading it from file if it's not in the cache
+		/// </summary>
+		/// <param name="image">The image</param>
+		/// <param name="level">The mip level</param>
+		/// <param name="index">The index of the tile in its level</param>
+		/// <returns>The texels of the tile, valid until the calling thread looks up other tiles</returns>
+		const tile& get_tile(const tiled_image& image, uint32_t level, uint32_t index);
+
+		/// <summary>
+		/// Sets the memory the shared cache may use, evicting tiles if needed
+		/// </summary>
+		/// <param name="bytes">The budget in bytes</param>
+		void set_memory_budget(size_t bytes);
+
+		/// <summary>
+		/// Returns the memory the shared cache may use
+		/// </summary>
+		size_t get_memory_budget() const { return m_budget; }
+
+		/// <summary>
+		/// Returns the counters of this cache
+		/// </summary>
+		texture_cache_stats get_stats() const;
+
+		/// <summary>
+		/// Drops all the tiles of the shared cache
+		/// </summary>
+		void clear();
+
+	private:
+		static constexpr size_t s_shard_count = 16;
+
+		/// <summary>
+		/// A part of the shared cache, tiles are distributed by key to limit contention
+		/// </summary>
+		struct shard
+		{
+			using lru_list = std::list<uint64_t>;
+
+			mutable std::mutex mutex;
+			lru_list lru;
+			std::unordered_map<uint64_t, std::pair<std::shared_ptr<const tile>, lru_list::iterator>> tiles;
+			size_t size = 0;
+		};
+
+		struct local_cache;
+
+		std::array<shard, s_shard_count> m_shards;
+		std::atomic<size_t> m_budget{ s_default_budget };
+
+		std::atomic<uint64_t> m_shared_hits{ 0 };
+		std::atomic<uint64_t> m_loads{ 0 };
+		std::atomic<uint64_t> m_bytes_loaded{ 0 };
+		std::atomic<uint64_t> m_evictions{ 0 };
+
+		// Per-thread caches, and the counters of the ones whose thread is gone
+		mutable std::mutex m_local_mutex;
+		std::vector<const local_cache*> m_local_caches;
+		uint64_t m_retired_lookups = 0;
+		uint64_t m_retired_hits = 0;
+
+		texture_cache() = default;
+
+		std::shared_ptr<const tile> get_shared_tile(const tiled_image& image, uint32_t level, uint32_t index, uint64_t key);
+
+		/// <summary>
+		/// Evicts tiles until the shard fits its part of the budget. Must be called with the shard mutex held
+		/// </summary>
+		void evict(shard& s);
+
+		static local_cache& get_local_cache();
+	};
+
+	/// <summary>
+	/// An image streamed from a tiled file (see write): only the tiles that are sampled are
+	/// loaded, through the texture cache. Samples like rt::image
+	/// </summary>
+	class tiled_image : public sampler_2d
+	{
+	public:
+		static constexpr uint32_t s_default_tile_size = 64;
+
+		rt::sample_mode sample_mode = rt::sample_mode::linear;
+
+		tiled_image();
+
+		tiled_image(const tiled_image&) = delete;
+		tiled_image& operator=(const tiled_image&) = delete;
+
+		/// <summary>
+		/// Writes an image and its mipmaps to a tiled file
+		/// </summary>
+		/// <param name="image">The image, texels are stored in its format</param>
+		/// <param name="file_name">The tiled file</param>
+		/// <param name="source">Identifies what the image was made from, see get_source</param>
+		/// <param name="tile_size">Width and height of the tiles, a power of 2</param>
+		/// <returns>true on success</returns>
+		static bool write(const image& image, std::string_view file_name, uint64_t source, uint32_t tile_size = s_default_tile_size);
+
+		/// <summary>
+		/// Opens a tiled file. Only its header is read
+		/// </summary>
+		/// <param name="file_name">The tiled file</param>
+		/// <returns>true if the file exists and is valid</returns>
+		bool open(std::string_view file_name);
+
+		/// <summary>
+		/// Returns the value given to write
+		/// </summary>
+		uint64_t get_source() const { return m_source; }
+
+		size_t get_width() const { return m_levels.empty() ? 0 : m_levels[0].width; }
+		size_t get_height() const { return m_levels.empty() ? 0 : m_levels[0].height; }
+		size_t get_mip_levels() const { return m_levels.size(); }
+
+		glm::vec3 average() const override { return m_average; }
+		glm::vec3 sample(const glm::vec2& uv) const override;
+		glm::vec3 sample(const glm::vec2& uv, float footprint) const override;
+
+		/// <summary>
+		/// Samples with the given mode instead of "sample_mode"
+		/// </summary>
+		glm::vec3 sample(const glm::vec2& uv, rt::sample_mode mode) const;
+		glm::vec3 sample(const glm::vec2& uv, float footprint, rt::sample_mode mode) const;
+
+	private:
+		friend class texture_cache;
+
+		struct level
+		{
+			uint32_t width, height;
+			uint32_t tiles_x;
+			uint64_t offset;
+		};
+
+		uint32_t m_id;
+		uint64_t m_source = 0;
+		texel_format m_format = texel_format::rgb32f;
+		uint32_t m_tile_shift = 0;
+		size_t m_tile_bytes = 0;
+		glm::vec3 m_average = glm::vec3(0.0f);
+		std::vector<level> m_levels;
+
+		mutable std::mutex m_file_mutex;
+		mutable std::ifstream m_file;
+
+		/// <summary>
+		/// Reads a tile from file, called by the cache
+		/// </summary>
+		texture_cache::tile read_tile(uint32_t level, uint32_t index) const;
+
+		glm::vec3 sample_level(size_t level, const glm::vec2& uv, rt::sample_mode mode) const;
+
+		template<texel_format Format>
+		glm::vec3 sample_level(size_t level, const glm::vec2& uv, rt::sample_mode mode) const;
+	};
+
+	/// <summary>
+	/// A tiled image sampled with its own mode. Samplers of the same file that only differ by
+	/// their mode share the image, its file and its tiles
+	/// </summary>
+	class tiled_image_view : public sampler_2d
+	{
+	public:
+		rt::sample_mode sample_mode;
+
+		tiled_image_view(const std::shared_ptr<const tiled_image>& image, rt::sample_mode mode) : sample_mode(mode), m_image(image) {}
+
+		const tiled_image& get_image() const { return *m_image; }
+
+		glm::vec3 average() const override { return m_image->average(); }
+		glm::vec3 sample(const glm::vec2& uv) const override { return m_image->sample(uv, sample_mode); }
+		glm::vec3 sample(const glm::vec2& uv, float footprint) const override { return m_image->sample(uv, footprint, sample_mode); }
+
+	private:
+		std::shared_ptr<const tiled_image> m_image;
+	};
+}
@@ -0,0 +1,210 @@
+#include "wavefront_pathtracer.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "scene.h"
+#include "ray_stats.h"
+
+namespace rt
+{
+	namespace
+	{
+		/// <summary>
+		/// Inserts two zero bits between each of the low 10 bits of a value
+		/// </summary>
+		uint32_t spread_bits(uint32_t v)
+		{
+			v &= 0x3ff;
+			v = (v | (v << 16)) & 0x030000ff;
+			v = (v | (v << 8)) & 0x0300f00f;
+			v = (v | (v << 4)) & 0x030c30c3;
+			v = (v | (v << 2)) & 0x09249249;
+			return v;
+		}
+
+		constexpr uint32_t s_no_material = std::numeric_limits<uint32_t>::max();
+	}
+
+	glm::vec3 wavefront_pathtracer::trace(const view_parameters& params, const ray& r, const scene& scene, aov_sample* aov)
+	{
+		glm::vec3 radiance;
+		trace_batch(params, &r, 1, scene, &radiance, aov);
+		return radiance;
+	}
+
+	glm::vec3 wavefront_pathtracer::trace_from_hit(const view_parameters& params, const ray& r, const raycast_result& hit, const scene_node* node, const scene& scene, aov_sample* aov)
+	{
+		const path_hit first_hit = { hit, node };
+
+		glm::vec3 radiance;
+		trace_paths(params, &r, &first_hit, 1, scene, &radiance, aov);
+		return radiance;
+	}
+
+	void wavefront_pathtracer::trace_batch(const view_parameters& params, const ray* rays, size_t count, const scene& scene, glm::vec3* radiance, aov_sample* aovs)
+	{
+		trace_paths(params, rays, nullptr, count, scene, radiance, aovs);
+	}
+
+	void wavefront_pathtracer::trace_paths(const view_parameters& params, const ray* rays, const path_hit* first_hits, size_t count, const scene& scene, glm::vec3* radiance, aov_sample* aovs)
+	{
+		std::vector<path> paths(count), next;
+		std::vector<path_hit> hits;
+		std::vector<sort_key> keys;
+
+		// Ray generation: the screen rays start the paths
+		for (size_t i = 0; i < count; ++i)
+		{
+			paths[i] = { rays[i], glm::vec3(1.0f), uint32_t(i) };
+			radiance[i] = glm::vec3(0.0f);
+		}
+
+		for (uint32_t bounce = 0; bounce < s_max_bounces && !paths.empty(); ++bounce)
+		{
+			sort_paths(paths, next, keys);
+
+			// Traversal, the known first hits are taken as is
+			hits.resize(paths.size());
+
+			if (bounce == 0 && first_hits)
+			{
+				for (size_t i = 0; i < paths.size(); ++i)
+					hits[i] = first_hits[paths[i].index];
+			}
+			else
+			{
+				// Screen rays are counted by run
+				if (bounce > 0)
+					RT_COUNT(ray_stats::local().add_rays(ray_type::secondary, paths.size()));
+
+				for (size_t i = 0; i < paths.size(); ++i)
+				{
+					const auto [result, node] = scene.cast_ray(paths[i].r);
+					hits[i] = { result, node.get() };
+				}
+			}
+
+			// Material evaluation, grouped by material. Misses (the background) come last
+			keys.resize(paths.size());
+
+			for (size_t i = 0; i < paths.size(); ++i)
+			{
+				const uint32_t material = hits[i].node ? scene.get_material_id(*hits[i].node) : s_no_material;
+				keys[i] = (sort_key(material) << 32) | i;
+			}
+
+			std::sort(keys.begin(), keys.end());
+			next.clear();
+
+			for (const auto key : keys)
+			{
+				const auto& p = paths[uint32_t(key)];
+				const auto& [result, node] = hits[uint32_t(key)];
+				aov_sample* aov = (bounce == 0 && aovs) ? &aovs[p.index] : nullptr;
+
+				if (!result.hit)
+				{
+					RT_COUNT(ray_stats::local().add_path(bounce + 1));
+
+					const auto background = scene.background->sample(p.r.direction);
+					radiance[p.index] += p.throughput * background;
+
+					if (aov)
+						aov->albedo = background;
+
+					continue;
+				}
+
+				// Same shading as pathtracer::shade, the recursion being replaced by the throughput
+				const float distance = glm::length(result.position - p.r.origin);
+				const float cone_width = p.r.cone_width + p.r.cone_angle * distance;
+				const float cosine = glm::max(glm::abs(glm::dot(p.r.direction, result.normal)), s_min_cone_cosine);
+				const float footprint = cone_width * result.uv_density / cosine;
+
+				const auto [albedo, emission, roughness, metallic] = scene.get_material(*node).sample(result.uv, footprint);
+
+				if (aov)
+				{
+					aov->albedo = albedo;
+					aov->normal = result.normal;
+					aov->depth = distance;
+				}
+
+				radiance[p.index] += p.throughput * emission;
+
+				// The next ray would be traced with no bounce left, it brings no light
+				if (bounce + 1 == s_max_bounces)
+				{
+					RT_COUNT(ray_stats::local().add_path(s_max_bounces));
+					continue;
+				}
+
+				const auto hemi_dir = rng::hemisphere(result.normal);
+				const auto reflect_dir = glm::reflect(p.r.direction, result.normal);
+				const auto dir = glm::normalize(glm::mix(reflect_dir, hemi_dir, roughness));
+
+				const auto cos_theta = glm::max(0.0f, glm::dot(dir, result.normal));
+				const auto throughput = p.throughput * glm::mix(albedo, glm::vec3(1.0f), metallic) * cos_theta * 2.0f;
+
+				// Paths that can't bring light anymore are dropped
+				if (throughput == glm::vec3(0.0f))
+				{
+					RT_COUNT(ray_stats::local().add_path(bounce + 1));
+					continue;
+				}
+
+				next.push_back({
+					{ result.position + dir * s_epsilon, dir, cone_width, p.r.cone_angle + roughness * s_rough_cone_angle },
+					throughput,
+					p.index
+				});
+			}
+
+			std::swap(paths, next);
+		}
+	}
+
+	void wavefront_pathtracer::sort_paths(std::vector<path>& paths, std::vector<path>& sorted, std::vector<sort_key>& keys)
+	{
+		if (paths.size() < 2)
+			return;
+
+		glm::vec3 min_origin = paths[0].r.origin;
+		glm::vec3 max_origin = paths[0].r.origin;
+
+		for (const auto& p : paths)
+		{
+			min_origin = glm::min(min_origin, p.r.origin);
+			max_origin = glm::max(max_origin, p.r.origin);
+		}
+
+		const float cells = float(1u << s_cell_bits);
+		const auto extent = max_origin - min_origin;
+		const auto scale = glm::vec3(
+			extent.x > 0.0f ? (cells - 1.0f) / extent.x : 0.0f,
+			extent.y > 0.0f ? (cells - 1.0f) / extent.y : 0.0f,
+			extent.z > 0.0f ? (cells - 1.0f) / extent.z : 0.0f);
+
+		keys.resize(paths.size());
+
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			const auto& r = paths[i].r;
+			const auto cell = glm::uvec3((r.origin - min_origin) * scale);
+			const uint32_t morton = spread_bits(cell.x) | (spread_bits(cell.y) << 1) | (spread_bits(cell.z) << 2);
+			const uint32_t octant = uint32_t(r.direction.x < 0.0f) | (uint32_t(r.direction.y < 0.0f) << 1) | (uint32_t(r.direction.z < 0.0f) << 2);
+
+			keys[i] = (sort_key((octant << (3 * s_cell_bits)) | morton) << 32) | i;
+		}
+
+		std::sort(keys.begin(), keys.end());
+
+		sorted.resize(paths.size());
+
+		for (size_t i = 0; i < keys.size(); ++i)
+			sorted[i] = paths[uint32_t(keys[i])];
+
+		std::swap(paths, sorted);
+	}
+}
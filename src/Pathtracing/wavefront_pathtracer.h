@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+
+#include "rng.h"
+#include "abstract_pathtracer.h"
+
+namespace rt
+{
+	/// <summary>
+	/// Breadth-first version of the pathtracer: instead of following each path to its end, it
+	/// advances a whole batch of paths by one bounce at a time. Each bounce is split in stages
+	/// (sorting, traversal, material evaluation) run over all the paths, so that neighbour rays
+	/// visit the same nodes and the same materials one after the other. Renders the same image
+	/// as "pathtracer", up to noise
+	/// </summary>
+	class wavefront_pathtracer : public abstract_pathtracer
+	{
+	public:
+		glm::vec3 trace(const view_parameters& params, const ray& r, const scene& scene, aov_sample* aov) override;
+		glm::vec3 trace_from_hit(const view_parameters& params, const ray& r, const raycast_result& hit, const scene_node* node, const scene& scene, aov_sample* aov) override;
+
+		size_t get_batch_size() const override { return s_batch_size; }
+		void trace_batch(const view_parameters& params, const ray* rays, size_t count, const scene& scene, glm::vec3* radiance, aov_sample* aovs) override;
+
+	private:
+		static constexpr float s_epsilon = 1e-3f;
+
+		/// <summary>
+		/// Screen rays per batch, each path takes about 80 bytes per stage
+		/// </summary>
+		static constexpr size_t s_batch_size = size_t(1) << 14;
+
+		/// <summary>
+		/// Rays cast per path, the camera ray included. Same as pathtracer::s_max_recursion
+		/// </summary>
+		static constexpr uint32_t s_max_bounces = 5;
+
+		/// <summary>
+		/// Ray origins are sorted on a grid of 2^s_cell_bits cells per axis, over the bounds of the batch
+		/// </summary>
+		static constexpr uint32_t s_cell_bits = 7;
+
+		static constexpr float s_rough_cone_angle = 0.25f;
+		static constexpr float s_min_cone_cosine = 0.1f;
+
+		/// <summary>
+		/// A path in flight
+		/// </summary>
+		struct path
+		{
+			ray r;
+
+			/// <summary>
+			/// Fraction of the radiance along the ray that reaches the camera
+			/// </summary>
+			glm::vec3 throughput;
+
+			/// <summary>
+			/// The screen ray this path started from
+			/// </summary>
+			uint32_t index;
+		};
+
+		/// <summary>
+		/// The closest hit of the ray of a path
+		/// </summary>
+		struct path_hit
+		{
+			raycast_result result;
+			const scene_node* node;
+		};
+
+		/// <summary>
+		/// Traces a batch of screen rays, see trace_batch
+		/// </summary>
+		/// <param name="first_hits">If not null, the first hit of each screen ray, which isn't cast again</param>
+		void trace_paths(const view_parameters& params, const ray* rays, const path_hit* first_hits, size_t count, const scene& scene, glm::vec3* radiance, aov_sample* aovs);
+
+		/// <summary>
+		/// Sort keys with the index of the element in the low bits
+		/// </summary>
+		using sort_key = uint64_t;
+
+		/// <summary>
+		/// Orders the paths by direction octant, then by the cell of their origin (Morton order)
+		/// </summary>
+		static void sort_paths(std::vector<path>& paths, std::vector<path>& sorted, std::vector<sort_key>& keys);
+	};
+}
@@ -0,0 +1,166 @@
+#include "accel_report.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "scene.h"
+
+namespace rt::utility
+{
+	namespace
+	{
+		bool contains(const bounding_box& outer, const bounding_box& inner, float tolerance)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				if (inner.min[i] < outer.min[i] - tolerance || inner.max[i] > outer.max[i] + tolerance)
+					return false;
+			}
+
+			return true;
+		}
+
+		bool overlaps(const bounding_box& a, const bounding_box& b, float tolerance)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				if (b.max[i] < a.min[i] - tolerance || b.min[i] > a.max[i] + tolerance)
+					return false;
+			}
+
+			return true;
+		}
+	}
+
+	kd_tree_report analyze_kd_tree(const mesh& mesh, const sah_costs& costs)
+	{
+		kd_tree_report report;
+
+		const auto& tree = mesh.get_kd_tree();
+		const auto& nodes = tree.get_nodes();
+		const auto& references = tree.get_triangle_indices();
+		const auto& positions = mesh.get_positions();
+		const auto& indices = mesh.get_indices();
+
+		report.triangle_count = mesh.get_triangle_count();
+		report.node_count = nodes.size();
+		report.memory_bytes = nodes.size() * sizeof(kd_tree_node) + references.size() * sizeof(uint32_t);
+
+		if (nodes.empty())
+		{
+			report.missing_triangles = report.triangle_count;
+			return report;
+		}
+
+		const auto& root_bounds = nodes[0].bounds;
+		const float root_surface = root_bounds.surface();
+		const auto extent = root_bounds.max - root_bounds.min;
+		const float tolerance = 1e-4f * std::max({ 1.0f, extent.x, extent.y, extent.z });
+
+		std::vector<bounding_box> triangle_bounds(report.triangle_count);
+
+		for (size_t t = 0; t < report.triangle_count; ++t)
+		{
+			const auto& p0 = positions[indices[3 * t]];
+			const auto& p1 = positions[indices[3 * t + 1]];
+			const auto& p2 = positions[indices[3 * t + 2]];
+			triangle_bounds[t] = { glm::min(p0, glm::min(p1, p2)), glm::max(p0, glm::max(p1, p2)) };
+
+			if (!contains(root_bounds, triangle_bounds[t], tolerance))
+				++report.triangle_bounds_errors;
+		}
+
+		std::vector<bool> referenced(report.triangle_count, false);
+		std::vector<bool> reached(nodes.size(), false);
+		uint64_t leaf_depths = 0;
+
+		struct entry
+		{
+			uint32_t node;
+			uint32_t parent;
+			uint32_t depth;
+		};
+
+		// Depth first from the root, following the children like the traversal does
+		std::vector<entry> stack = { { 0, kd_tree_node::s_no_child, 0 } };
+		reached[0] = true;
+
+		while (!stack.empty())
+		{
+			const auto [index, parent, depth] = stack.back();
+			stack.pop_back();
+
+			const auto& node = nodes[index];
+
+			// The traversal stack holds at most one node per level
+			if (node.depth != depth || depth > kd_tree::s_max_depth)
+				++report.structure_errors;
+
+			if (parent != kd_tree_node::s_no_child && !contains(nodes[parent].bounds, node.bounds, tolerance))
+				++report.bounds_errors;
+
+			report.max_depth = std::max(report.max_depth, depth);
+
+			const double relative_surface = root_surface > 0.0f ? double(node.bounds.surface()) / root_surface : 1.0;
+			report.sah_cost += relative_surface * (costs.traversal + double(costs.intersection) * node.triangle_count);
+
+			if (uint64_t(node.first_triangle) + node.triangle_count > references.size())
+			{
+				++report.structure_errors;
+			}
+			else
+			{
+				report.triangle_references += node.triangle_count;
+
+				for (uint32_t i = 0; i < node.triangle_count; ++i)
+				{
+					const auto t = references[node.first_triangle + i];
+
+					if (t >= report.triangle_count)
+					{
+						++report.structure_errors;
+						continue;
+					}
+
+					referenced[t] = true;
+
+					if (!overlaps(node.bounds, triangle_bounds[t], tolerance))
+						++report.triangle_bounds_errors;
+				}
+			}
+
+			if (node.left == kd_tree_node::s_no_child && node.right == kd_tree_node::s_no_child)
+			{
+				++report.leaf_count;
+				++report.leaf_sizes[std::min(node.triangle_count, kd_tree_report::s_max_leaf_size)];
+				leaf_depths += depth;
+				continue;
+			}
+
+			for (const auto child : { node.right, node.left })
+			{
+				if (child == kd_tree_node::s_no_child)
+					continue;
+
+				// A child must exist and belong to a single parent, or the traversal could loop
+				if (child >= nodes.size() || reached[child])
+				{
+					++report.structure_errors;
+					continue;
+				}
+
+				reached[child] = true;
+				stack.push_back({ child, index, depth + 1 });
+			}
+		}
+
+		// Nodes that can't be reached from the root
+		report.structure_errors += std::count(reached.begin(), reached.end(), false);
+		report.missing_triangles = std::count(referenced.begin(), referenced.end(), false);
+
+		if (report.leaf_count > 0)
+			report.average_leaf_depth = double(leaf_depths) / report.leaf_count;
+
+		return report;
+	}
+}
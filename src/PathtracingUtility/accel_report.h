@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+
+namespace rt
+{
+	class mesh;
+
+	namespace utility
+	{
+		/// <summary>
+		/// Relative costs used to compute the SAH cost of a tree
+		/// </summary>
+		struct sah_costs
+		{
+			/// <summary>
+			/// Cost of testing the bounds of a node
+			/// </summary>
+			float traversal = 1.0f;
+
+			/// <summary>
+			/// Cost of a ray-triangle test
+			/// </summary>
+			float intersection = 1.0f;
+		};
+
+		/// <summary>
+		/// Quality measures and validation results of the KD-tree of a mesh, see analyze_kd_tree
+		/// </summary>
+		struct kd_tree_report
+		{
+			/// <summary>
+			/// Largest leaf size tracked by the histogram
+			/// </summary>
+			static constexpr uint32_t s_max_leaf_size = 16;
+
+			size_t triangle_count = 0;
+			size_t node_count = 0;
+			size_t leaf_count = 0;
+
+			/// <summary>
+			/// Leaves by number of triangles, from 0 to s_max_leaf_size (larger leaves included)
+			/// </summary>
+			std::array<size_t, s_max_leaf_size + 1> leaf_sizes = {};
+
+			uint32_t max_depth = 0;
+
+			/// <summary>
+			/// Average depth of the leaves
+			/// </summary>
+			double average_leaf_depth = 0.0;
+
+			/// <summary>
+			/// Triangle references stored in the leaves, a triangle straddling a split is referenced more than once
+			/// </summary>
+			size_t triangle_references = 0;
+
+			/// <summary>
+			/// Memory used by the nodes and the triangle references
+			/// </summary>
+			size_t memory_bytes = 0;
+
+			/// <summary>
+			/// Expected cost of a ray going through the root bounds: every node's bounds are tested,
+			/// every leaf's triangles are tested, each weighted by its surface relative to the root
+			/// </summary>
+			double sah_cost = 0.0;
+
+			/// <summary>
+			/// Nodes whose bounds aren't contained in their parent's bounds
+			/// </summary>
+			size_t bounds_errors = 0;
+
+			/// <summary>
+			/// Leaf triangles whose bounds don't overlap the leaf bounds, or not contained in the root bounds
+			/// </summary>
+			size_t triangle_bounds_errors = 0;
+
+			/// <summary>
+			/// Triangles not referenced by any leaf
+			/// </summary>
+			size_t missing_triangles = 0;
+
+			/// <summary>
+			/// Out of range or shared children, out of range triangle references, wrong depths and nodes
+			/// deeper than the traversal stack allows
+			/// </summary>
+			size_t structure_errors = 0;
+
+			/// <summary>
+			/// Returns the average number of references per triangle
+			/// </summary>
+			double get_duplication() const { return triangle_count > 0 ? double(triangle_references) / triangle_count : 0.0; }
+
+			/// <summary>
+			/// Returns true if no error was found
+			/// </summary>
+			bool is_valid() const { return bounds_errors == 0 && triangle_bounds_errors == 0 && missing_triangles == 0 && structure_errors == 0; }
+		};
+
+		/// <summary>
+		/// Measures the quality of the KD-tree of a mesh and validates it
+		/// </summary>
+		/// <param name="mesh">The mesh, must be compiled</param>
+		/// <param name="costs">The costs used for the SAH cost</param>
+		/// <returns>The report</returns>
+		kd_tree_report analyze_kd_tree(const mesh& mesh, const sah_costs& costs = {});
+	}
+}
@@ -0,0 +1,286 @@
+#include "asset_cache.h"
+
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+#include "scene.h"
+#include "profiler.h"
+#include "mesh_cache.h"
+#include "mesh_loader.h"
+
+namespace rt::utility
+{
+	namespace
+	{
+		/// <summary>
+		/// Returns "file|mtime", the part of the key identifying the content of a file
+		/// </summary>
+		std::string get_file_key(std::string_view file_name)
+		{
+			std::error_code error;
+			const auto mtime = std::filesystem::last_write_time(std::filesystem::path(file_name), error);
+
+			return std::string(file_name) + "|" + std::to_string(error ? 0 : int64_t(mtime.time_since_epoch().count()));
+		}
+
+		int to_key(const std::optional<rt::texel_format>& format) { return format ? int(*format) : -1; }
+		int to_key(const std::optional<rt::sample_mode>& mode) { return mode ? int(*mode) : -1; }
+	}
+
+	asset_cache& asset_cache::get_instance()
+	{
+		static asset_cache s_instance;
+		return s_instance;
+	}
+
+	std::shared_ptr<const asset_cache::mesh_map> asset_cache::load_meshes(std::string_view file_name, bool use_cache)
+	{
+		const std::string key = "mesh|" + get_file_key(file_name) + "|" + (use_cache ? "cached" : "direct");
+
+		auto meshes = std::static_pointer_cast<const mesh_map>(get_or_load(key, [&](size_t& size) -> std::shared_ptr<const void> {
+			RT_PROFILE_ZONE("load_meshes");
+
+			auto result = std::make_shared<mesh_map>(use_cache ? load_meshes_cached(file_name) : load_meshes_from_wavefront(file_name));
+
+			if (result->empty())
+				return nullptr;
+
+			// Compiled before being shared, they're never modified afterwards
+			for (auto& [name, mesh] : *result)
+			{
+				mesh->compile();
+				size += mesh->get_size_in_bytes();
+			}
+
+			return result;
+		}));
+
+		return meshes ? meshes : std::make_shared<const mesh_map>();
+	}
+
+	std::shared_ptr<const rt::image> asset_cache::load_image(std::string_view file_name, const image_options& options)
+	{
+		const std::string key = "image|" + get_file_key(file_name) + "|" +
+			std::to_string(int(options.layout)) + "|" + std::to_string(to_key(options.format)) + "|" +
+			std::to_string(int(options.ldr)) + "|" + std::to_string(to_key(options.mode));
+
+		auto image = get_or_load(key, [&](size_t& size) -> std::shared_ptr<const void> {
+			RT_PROFILE_ZONE("load_image");
+
+			auto result = std::make_shared<rt::image>();
+			result->set_layout(options.layout);
+			result->load(file_name, options.format);
+
+			if (result->get_width() == 0 || result->get_height() == 0)
+				return nullptr;
+
+			if (options.ldr)
+				result->to_ldr();
+
+			if (options.mode)
+				result->sample_mode = *options.mode;
+
+			size = result->get_size_in_bytes();
+			return result;
+		});
+
+		if (!image)
+			return std::make_shared<const rt::image>();
+
+		return std::static_pointer_cast<const rt::image>(image);
+	}
+
+	std::shared_ptr<const rt::tiled_image_view> asset_cache::load_tiled_image(std::string_view file_name, const image_options& options)
+	{
+		// The mode doesn't change the texels: the tiled file is loaded once for every mode, each mode has its own view
+		const std::string image_key = "tiled|" + get_file_key(file_name) + "|" +
+			std::to_string(to_key(options.format)) + "|" + std::to_string(int(options.ldr));
+		const std::string view_key = image_key + "|" + std::to_string(to_key(options.mode));
+
+		auto image = get_or_load(image_key, [&](size_t& size) -> std::shared_ptr<const void> {
+			RT_PROFILE_ZONE("load_tiled_image");
+
+			// Each set of options has its own file, ie "file.jpg.<hash>.rttex": samplers loading the same
+			// image differently neither overwrite nor invalidate each other's file
+			const std::string options_key = std::to_string(to_key(options.format)) + "|" + std::to_string(int(options.ldr));
+			const std::string tiled_file = fmt::format("{0}.{1:016x}.rttex", file_name, hash_bytes(options_key.data(), options_key.size()));
+
+			std::error_code error;
+			const auto file_size = std::filesystem::file_size(std::filesystem::path(file_name), error);
+
+			if (error)
+			{
+				spdlog::error("Can't open file: {0}", file_name);
+				return nullptr;
+			}
+
+			// Anything that changes the texels invalidates the tiled file
+			const std::string source_key = get_file_key(file_name) + "|" + std::to_string(file_size) + "|" + options_key;
+			const uint64_t source = hash_bytes(source_key.data(), source_key.size());
+
+			auto result = std::make_shared<rt::tiled_image>();
+
+			if (!result->open(tiled_file) || result->get_source() != source)
+			{
+				// Decoded in full once, then only streamed
+				rt::image full;
+				full.load(file_name, options.format);
+
+				if (full.get_width() == 0 || full.get_height() == 0)
+					return nullptr;
+
+				if (options.ldr)
+					full.to_ldr();
+
+				if (!rt::tiled_image::write(full, tiled_file, source) || !result->open(tiled_file))
+				{
+					spdlog::error("Can't write tiled image: {0}", tiled_file);
+					return nullptr;
+				}
+
+				spdlog::info("Tiled image written: {0}", tiled_file);
+			}
+
+			// The tiles are accounted by the texture cache
+			size = sizeof(rt::tiled_image);
+			return result;
+		});
+
+		if (!image)
+			return nullptr;
+
+		auto view = get_or_load(view_key, [&](size_t& size) -> std::shared_ptr<const void> {
+			size = sizeof(rt::tiled_image_view);
+			return std::make_shared<rt::tiled_image_view>(std::static_pointer_cast<const rt::tiled_image>(image), options.mode.value_or(rt::sample_mode::linear));
+		});
+
+		return std::static_pointer_cast<const rt::tiled_image_view>(view);
+	}
+
+	void asset_cache::set_memory_budget(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget = bytes;
+		evict();
+	}
+
+	size_t asset_cache::get_memory_budget() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_budget;
+	}
+
+	size_t asset_cache::get_size_in_bytes() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_size;
+	}
+
+	void asset_cache::clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (auto it = m_entries.begin(); it != m_entries.end();)
+		{
+			if (it->second.loaded)
+			{
+				m_size -= it->second.size;
+				m_lru.erase(it->second.lru);
+				it = m_entries.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	std::shared_ptr<const void> asset_cache::get_or_load(const std::string& key, const std::function<std::shared_ptr<const void>(size_t&)>& load)
+	{
+		std::promise<std::shared_ptr<const void>> promise;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			const auto it = m_entries.find(key);
+
+			if (it != m_entries.end())
+			{
+				// Most recently used first
+				m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+				const auto value = it->second.value;
+
+				// Waits outside of the lock if another thread is loading it
+				lock.unlock();
+				return value.get();
+			}
+
+			m_lru.push_front(key);
+			m_entries.emplace(key, entry{ promise.get_future().share(), 0, false, m_lru.begin() });
+		}
+
+		size_t size = 0;
+		std::shared_ptr<const void> result;
+
+		const auto remove = [this, &key] {
+			const auto it = m_entries.find(key);
+			m_lru.erase(it->second.lru);
+			m_entries.erase(it);
+		};
+
+		try
+		{
+			result = load(size);
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				remove();
+			}
+
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+
+		promise.set_value(result);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (result)
+		{
+			auto& loaded = m_entries.at(key);
+			loaded.size = size;
+			loaded.loaded = true;
+			m_size += size;
+			evict();
+		}
+		else
+		{
+			// Failures are reported by the loaders, the next request tries again
+			remove();
+		}
+
+		return result;
+	}
+
+	void asset_cache::evict()
+	{
+		auto it = m_lru.end();
+
+		while (m_size > m_budget && it != m_lru.begin())
+		{
+			--it;
+			const auto entry = m_entries.find(*it);
+
+			if (!entry->second.loaded)
+				continue;
+
+			spdlog::info("Asset cache: evicting {0} ({1:.1f} MB)", *it, entry->second.size / (1024.0 * 1024.0));
+
+			m_size -= entry->second.size;
+			m_entries.erase(entry);
+			it = m_lru.erase(it);
+		}
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <sampler.h>
+#include <texture_cache.h>
+
+namespace rt
+{
+	class mesh;
+
+	namespace utility
+	{
+		/// <summary>
+		/// How an image is loaded, part of its key in the asset cache
+		/// </summary>
+		struct image_options
+		{
+			rt::pixel_layout layout = rt::pixel_layout::linear;
+			std::optional<rt::texel_format> format;
+			bool ldr = false;
+			std::optional<rt::sample_mode> mode;
+		};
+
+		/// <summary>
+		/// A process-wide cache of loaded meshes and images, shared between scene loads.
+		/// Assets are keyed by file, modification time and load options: an edited file is loaded
+		/// again. When the cache grows over its memory budget, the least recently used assets are
+		/// dropped. Assets are handed out as shared, immutable instances
+		/// </summary>
+		class asset_cache
+		{
+		public:
+			using mesh_map = std::map<std::string, std::shared_ptr<rt::mesh>>;
+
+			static constexpr size_t s_default_budget = size_t(1) << 30;
+
+			asset_cache(const asset_cache&) = delete;
+			asset_cache& operator=(const asset_cache&) = delete;
+
+			/// <summary>
+			/// Returns the cache of this process
+			/// </summary>
+			static asset_cache& get_instance();
+
+			/// <summary>
+			/// Returns the compiled meshes of a Wavefront file, loading them on first use.
+			/// Concurrent requests for the same file wait for a single load. The meshes themselves
+			/// aren't const since scene nodes hold mutable shapes for scene::compile, which does
+			/// nothing on these already compiled meshes: they must not be modified
+			/// </summary>
+			/// <param name="file_name">The Wavefront file</param>
+			/// <param name="use_cache">Whether to go through the binary mesh cache, see load_meshes_cached</param>
+			/// <returns>The meshes by name, empty if the file can't be loaded</returns>
+			std::shared_ptr<const mesh_map> load_meshes(std::string_view file_name, bool use_cache);
+
+			/// <summary>
+			/// Returns an image, loading it on first use
+			/// </summary>
+			/// <param name="file_name">The image file</param>
+			/// <param name="options">How the image is loaded</param>
+			/// <returns>The image, empty if the file can't be loaded</returns>
+			std::shared_ptr<const rt::image> load_image(std::string_view file_name, const image_options& options);
+
+			/// <summary>
+			/// Returns an image streamed through the texture cache. The image is converted to a
+			/// tiled file stored next to it on first use, and again when the file changes. The file
+			/// is named after a hash of the options but the mode, ie "file.jpg.0123456789abcdef.rttex".
+			/// Loads that only differ by their mode share the tiled image
+			/// </summary>
+			/// <param name="file_name">The image file</param>
+			/// <param name="options">How the image is loaded, the layout is ignored</param>
+			/// <returns>The image, nullptr if the file can't be loaded</returns>
+			std::shared_ptr<const rt::tiled_image_view> load_tiled_image(std::string_view file_name, const image_options& options);
+
+			/// <summary>
+			/// Sets the memory the cache may keep, evicting assets if needed. Assets still used by
+			/// a scene stay alive until released, they're only dropped from the cache
+			/// </summary>
+			/// <param name="bytes">The budget in bytes</param>
+			void set_memory_budget(size_t bytes);
+
+			/// <summary>
+			/// Returns the memory the cache may keep
+			/// </summary>
+			size_t get_memory_budget() const;
+
+			/// <summary>
+			/// Returns the memory used by the cached assets
+			/// </summary>
+			size_t get_size_in_bytes() const;
+
+			/// <summary>
+			/// Drops all the assets that are not being loaded
+			/// </summary>
+			void clear();
+
+		private:
+			struct entry
+			{
+				std::shared_future<std::shared_ptr<const void>> value;
+				size_t size = 0;
+				bool loaded = false;
+				std::list<std::string>::iterator lru;
+			};
+
+			mutable std::mutex m_mutex;
+			std::unordered_map<std::string, entry> m_entries;
+			std::list<std::string> m_lru;
+			size_t m_size = 0;
+			size_t m_budget = s_default_budget;
+
+			asset_cache() = default;
+
+			/// <summary>
+			/// Returns the asset with the given key, calling load if it's not in the cache
+			/// </summary>
+			/// <param name="key">The key</param>
+			/// <param name="load">Loads the asset and returns its size. Failures return nullptr and are not cached</param>
+			std::shared_ptr<const void> get_or_load(const std::string& key, const std::function<std::shared_ptr<const void>(size_t&)>& load);
+
+			/// <summary>
+			/// Evicts least recently used assets until the cache fits its budget. Must be called with the mutex held
+			/// </summary>
+			void evict();
+		};
+	}
+}
@@ -1,16 +1,132 @@
 #include "debug_pathtracer.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
 #include "scene.h"
 #include "sampler.h"
+#include "ray_stats.h"
 
 namespace rt::utility
 {
-	glm::vec3 debug_pathtracer::trace(const view_parameters& params, const ray& ray, const scene& scene)
+	debug_pathtracer::heatmap_scale debug_pathtracer::get_default_scale(mode m)
+	{
+		switch (m)
+		{
+		case mode::node_visits: return { 0.0f, 200.0f, false };
+		case mode::triangle_tests: return { 0.0f, 200.0f, false };
+		case mode::cast_time: return { 100.0f, 100000.0f, true };
+		default: return {};
+		}
+	}
+
+	glm::vec3 debug_pathtracer::false_color(float t)
+	{
+		static const std::array<glm::vec3, 5> s_stops = {
+			glm::vec3(0.0f, 0.0f, 1.0f),
+			glm::vec3(0.0f, 1.0f, 1.0f),
+			glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::vec3(1.0f, 1.0f, 0.0f),
+			glm::vec3(1.0f, 0.0f, 0.0f),
+		};
+
+		const float x = glm::clamp(t, 0.0f, 1.0f) * (s_stops.size() - 1);
+		const size_t i = std::min(size_t(x), s_stops.size() - 2);
+
+		return glm::mix(s_stops[i], s_stops[i + 1], x - i);
+	}
+
+	glm::vec3 debug_pathtracer::heatmap_color(float cost, const heatmap_scale& scale)
+	{
+		float t;
+
+		if (scale.logarithmic)
+		{
+			const float min = std::max(scale.min, 1.0f);
+			t = std::log(std::max(cost, min) / min) / std::log(std::max(scale.max, min * 2.0f) / min);
+		}
+		else
+		{
+			t = (cost - scale.min) / std::max(scale.max - scale.min, 1e-6f);
+		}
+
+		return false_color(t);
+	}
+
+	void debug_pathtracer::apply_heatmap(rt::image& image, const heatmap_scale& scale)
 	{
-		auto [result, node] = scene.cast_ray(ray);
+		for (size_t y = 0; y < image.get_height(); ++y)
+			for (size_t x = 0; x < image.get_width(); ++x)
+				image.set_pixel(x, y, heatmap_color(image.get_pixel(x, y).r, scale));
+	}
+
+	glm::vec3 debug_pathtracer::trace(const view_parameters& params, const ray& ray, const scene& scene, aov_sample* aov)
+	{
+		if (is_heatmap(current_mode))
+		{
+			RT_COUNT(ray_stats::local().add_path(1));
+
+			// The cost of this ray only, from the counters of this thread
+			const auto before = ray_stats::local();
+			const auto start = std::chrono::steady_clock::now();
+
+			const auto [result, node] = scene.cast_ray(ray);
+
+			const auto end = std::chrono::steady_clock::now();
+			const auto& after = ray_stats::local();
+
+			float value = 0.0f;
+
+			switch (current_mode)
+			{
+			case mode::node_visits: value = float(after.nodes_visited - before.nodes_visited); break;
+			case mode::triangle_tests: value = float(after.triangles_tested - before.triangles_tested); break;
+			default: value = float(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()); break;
+			}
+
+			if (aov && result.hit)
+			{
+				aov->albedo = node->material.albedo->sample(result.uv);
+				aov->normal = result.normal;
+				aov->depth = glm::length(result.position - ray.origin);
+			}
+			else if (aov && scene.background)
+			{
+				aov->albedo = scene.background->sample(ray.direction);
+			}
+
+			// Mapped to a color once averaged: the mean of two colors isn't on the scale
+			return glm::vec3(value);
+		}
+
+		const auto [result, node] = scene.cast_ray(ray);
+		return shade(ray, result, node.get(), scene, aov);
+	}
+
+	glm::vec3 debug_pathtracer::trace_from_hit(const view_parameters& params, const ray& ray, const raycast_result& hit, const scene_node* node, const scene& scene, aov_sample* aov)
+	{
+		// Heatmaps measure a cast of their own
+		if (is_heatmap(current_mode))
+			return trace(params, ray, scene, aov);
+
+		return shade(ray, hit, node, scene, aov);
+	}
+
+	glm::vec3 debug_pathtracer::shade(const ray& ray, const raycast_result& result, const scene_node* node, const scene& scene, aov_sample* aov)
+	{
+		RT_COUNT(ray_stats::local().add_path(1));
 
 		if (result.hit)
 		{
+			if (aov)
+			{
+				aov->albedo = node->material.albedo->sample(result.uv);
+				aov->normal = result.normal;
+				aov->depth = glm::length(result.position - ray.origin);
+			}
+
 			switch (current_mode)
 			{
 			case debug_pathtracer::mode::albedo:
@@ -23,12 +139,22 @@ namespace rt::utility
 				return node->material.roughness->sample(result.uv);
 			case debug_pathtracer::mode::normal:
 				return result.normal * 0.5f + 0.5f;
-
+			default:
+				// Heatmaps are traced by "trace"
+				break;
 			}
 		}
 		else
 		{
-			return scene.background ? scene.background->sample(ray.direction) : glm::vec3(0.0f);
+			// Same albedo as the other tracers on a miss
+			const auto background = scene.background ? scene.background->sample(ray.direction) : glm::vec3(0.0f);
+
+			if (aov)
+				aov->albedo = background;
+
+			return background;
 		}
+
+		return glm::vec3(0.0f);
 	}
 }
\ No newline at end of file
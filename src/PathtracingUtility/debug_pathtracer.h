@@ -19,12 +19,79 @@ namespace rt::utility
 			roughness,
 			metallic,
 			normal,
+
+			/// <summary>
+			/// Heatmap of the kd nodes visited by the primary ray (needs RT_RAY_STATS)
+			/// </summary>
+			node_visits,
+
+			/// <summary>
+			/// Heatmap of the triangles tested by the primary ray (needs RT_RAY_STATS)
+			/// </summary>
+			triangle_tests,
+
+			/// <summary>
+			/// Heatmap of the nanoseconds spent in scene::cast_ray by the primary ray
+			/// </summary>
+			cast_time,
+		};
+
+		/// <summary>
+		/// Maps the heatmap costs to colors, from blue (min) to red (max)
+		/// </summary>
+		struct heatmap_scale
+		{
+			float min = 0.0f;
+			float max = 100.0f;
+
+			/// <summary>
+			/// Spreads the colors logarithmically between max(min, 1) and max
+			/// </summary>
+			bool logarithmic = false;
 		};
 
 		mode current_mode = mode::albedo;
 
-		glm::vec3 trace(const view_parameters& params, const ray& ray, const scene& scene) override;
+		/// <summary>
+		/// Returns whether the given mode is a heatmap. Heatmaps output the cost of the rays (in all
+		/// three channels), averaged over the samples like colors. They're mapped to colors once
+		/// rendered, with heatmap_color or apply_heatmap, and displayed as is (no tone mapping)
+		/// </summary>
+		static bool is_heatmap(mode m) { return m == mode::node_visits || m == mode::triangle_tests || m == mode::cast_time; }
+
+		/// <summary>
+		/// Returns whether the given mode works in this build: node and triangle heatmaps read the
+		/// ray stats counters, they would be all zeros without RT_RAY_STATS
+		/// </summary>
+		static bool is_supported(mode m) { return RT_RAY_STATS || (m != mode::node_visits && m != mode::triangle_tests); }
+
+		/// <summary>
+		/// Returns a scale suited to the given heatmap mode
+		/// </summary>
+		static heatmap_scale get_default_scale(mode m);
+
+		/// <summary>
+		/// Maps a value in [0, 1] to a false color, blue - cyan - green - yellow - red
+		/// </summary>
+		static glm::vec3 false_color(float t);
+
+		/// <summary>
+		/// Returns the color of a heatmap cost
+		/// </summary>
+		static glm::vec3 heatmap_color(float cost, const heatmap_scale& scale);
+
+		/// <summary>
+		/// Replaces the costs of a rendered heatmap by their colors
+		/// </summary>
+		static void apply_heatmap(rt::image& image, const heatmap_scale& scale);
+
+		glm::vec3 trace(const view_parameters& params, const ray& ray, const scene& scene, aov_sample* aov) override;
+		glm::vec3 trace_from_hit(const view_parameters& params, const ray& ray, const raycast_result& hit, const scene_node* node, const scene& scene, aov_sample* aov) override;
 
-		
+	private:
+		/// <summary>
+		/// Returns the debug value of the first hit of a screen ray, for the modes other than heatmaps
+		/// </summary>
+		glm::vec3 shade(const ray& ray, const raycast_result& result, const scene_node* node, const scene& scene, aov_sample* aov);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,816 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+// Implemented in Pathtracing (sampler.cpp), for the zlib decoder
+#include <stb_image.h>
+
+#include "sampler.h"
+
+namespace rt::utility
+{
+	namespace
+	{
+		bool is_little_endian()
+		{
+			const uint16_t value = 1;
+			uint8_t first;
+			std::memcpy(&first, &value, 1);
+			return first == 1;
+		}
+
+		/// <summary>
+		/// Returns the pixels of an image as floats, 3 per pixel, first row at the top
+		/// </summary>
+		std::vector<float> get_rgb(const rt::image& image)
+		{
+			std::vector<float> rgb(3 * image.get_width() * image.get_height());
+
+			for (size_t y = 0; y < image.get_height(); ++y)
+			{
+				for (size_t x = 0; x < image.get_width(); ++x)
+				{
+					const auto color = image.get_pixel(x, y);
+					float* pixel = &rgb[3 * (y * image.get_width() + x)];
+					pixel[0] = color.r;
+					pixel[1] = color.g;
+					pixel[2] = color.b;
+				}
+			}
+
+			return rgb;
+		}
+
+		/// <summary>
+		/// Appends values to a buffer in little endian order, as EXR files store them
+		/// </summary>
+		class exr_buffer
+		{
+		public:
+			std::vector<uint8_t> bytes;
+
+			template<typename T>
+			void put(T value)
+			{
+				uint8_t raw[sizeof(T)];
+				std::memcpy(raw, &value, sizeof(T));
+
+				if (!is_little_endian())
+					std::reverse(raw, raw + sizeof(T));
+
+				bytes.insert(bytes.end(), raw, raw + sizeof(T));
+			}
+
+			void put(const char* s)
+			{
+				bytes.insert(bytes.end(), s, s + std::strlen(s) + 1);
+			}
+
+			void put_attribute(const char* name, const char* type, int32_t size)
+			{
+				put(name);
+				put(type);
+				put(size);
+			}
+		};
+
+		template<typename T>
+		T load_little_endian(const uint8_t* data)
+		{
+			uint8_t raw[sizeof(T)];
+			std::memcpy(raw, data, sizeof(T));
+
+			if (!is_little_endian())
+				std::reverse(raw, raw + sizeof(T));
+
+			T value;
+			std::memcpy(&value, raw, sizeof(T));
+			return value;
+		}
+
+		/// <summary>
+		/// Reads little endian values from the bytes of an EXR file. Reading past the end sets
+		/// "failed" and returns zeros
+		/// </summary>
+		class exr_reader
+		{
+		public:
+			const std::vector<uint8_t>& bytes;
+			size_t position = 0;
+			bool failed = false;
+
+			exr_reader(const std::vector<uint8_t>& bytes) : bytes(bytes) {}
+
+			template<typename T>
+			T get()
+			{
+				if (position + sizeof(T) > bytes.size())
+				{
+					failed = true;
+					return T{};
+				}
+
+				position += sizeof(T);
+				return load_little_endian<T>(&bytes[position - sizeof(T)]);
+			}
+
+			std::string get_string()
+			{
+				const auto end = std::find(bytes.begin() + std::min(position, bytes.size()), bytes.end(), uint8_t(0));
+
+				if (end == bytes.end())
+				{
+					failed = true;
+					return {};
+				}
+
+				std::string s(bytes.begin() + position, end);
+				position = size_t(end - bytes.begin()) + 1;
+				return s;
+			}
+		};
+
+		float half_to_float(uint16_t h)
+		{
+			const uint32_t sign = uint32_t(h >> 15) << 31;
+			uint32_t exponent = (h >> 10) & 0x1f;
+			uint32_t mantissa = h & 0x3ff;
+			uint32_t bits;
+
+			if (exponent == 0x1f)
+			{
+				// Infinity or NaN
+				bits = sign | 0x7f800000 | (mantissa << 13);
+			}
+			else if (exponent != 0)
+			{
+				bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+			}
+			else if (mantissa == 0)
+			{
+				bits = sign;
+			}
+			else
+			{
+				// Subnormal, normalized for the float
+				exponent = 113;
+
+				while ((mantissa & 0x400) == 0)
+				{
+					mantissa <<= 1;
+					--exponent;
+				}
+
+				bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+			}
+
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		/// <summary>
+		/// Reverses zip_block. Returns false if the data doesn't inflate to the expected size
+		/// </summary>
+		bool unzip_block(const uint8_t* data, size_t size, std::vector<uint8_t>& raw)
+		{
+			std::vector<uint8_t> reordered(raw.size());
+
+			if (stbi_zlib_decode_buffer(reinterpret_cast<char*>(reordered.data()), int(reordered.size()),
+				reinterpret_cast<const char*>(data), int(size)) != int(raw.size()))
+				return false;
+
+			for (size_t i = 1; i < reordered.size(); ++i)
+				reordered[i] = uint8_t(int(reordered[i]) + int(reordered[i - 1]) - 128);
+
+			const size_t half = (raw.size() + 1) / 2;
+
+			for (size_t i = 0; i < raw.size(); ++i)
+				raw[i] = reordered[(i % 2 == 0 ? 0 : half) + i / 2];
+
+			return true;
+		}
+
+		/// <summary>
+		/// ZIP compression of an EXR block: bytes are split in two halves (even and odd positions),
+		/// delta encoded, then deflated. Returns the raw block when it doesn't get smaller
+		/// </summary>
+		std::vector<uint8_t> zip_block(const std::vector<uint8_t>& raw)
+		{
+			std::vector<uint8_t> reordered(raw.size());
+			const size_t half = (raw.size() + 1) / 2;
+
+			for (size_t i = 0; i < raw.size(); ++i)
+				reordered[(i % 2 == 0 ? 0 : half) + i / 2] = raw[i];
+
+			for (size_t i = reordered.size(); i-- > 1;)
+				reordered[i] = uint8_t(int(reordered[i]) - int(reordered[i - 1]) + 128);
+
+			int size = 0;
+			unsigned char* compressed = stbi_zlib_compress(reordered.data(), int(reordered.size()), &size, 8);
+
+			std::vector<uint8_t> result;
+
+			if (compressed && size_t(size) < raw.size())
+				result.assign(compressed, compressed + size);
+			else
+				result = raw;
+
+			STBIW_FREE(compressed);
+			return result;
+		}
+
+		/// <summary>
+		/// Builds the header of a single part EXR file with 32 bit float R, G and B channels. The
+		/// file is tiled when tile_size isn't 0, made of scanline blocks otherwise
+		/// </summary>
+		exr_buffer make_exr_header(size_t width, size_t height, exr_compression compression, uint32_t tile_size)
+		{
+			exr_buffer header;
+
+			// Magic number and version 2, single part file, flagged as tiled if needed
+			header.put<uint32_t>(20000630);
+			header.put<uint32_t>(tile_size > 0 ? 2 | 0x200 : 2);
+
+			// Channels are stored in alphabetical order
+			const char* channels[] = { "B", "G", "R" };
+			header.put_attribute("channels", "chlist", 3 * (2 + 16) + 1);
+
+			for (const auto name : channels)
+			{
+				header.put(name);
+				header.put<int32_t>(2); // FLOAT
+				header.put<uint8_t>(0); // pLinear
+				header.put<uint8_t>(0);
+				header.put<uint8_t>(0);
+				header.put<uint8_t>(0);
+				header.put<int32_t>(1); // x sampling
+				header.put<int32_t>(1); // y sampling
+			}
+
+			header.put<uint8_t>(0);
+
+			header.put_attribute("compression", "compression", 1);
+			header.put<uint8_t>(compression == exr_compression::zip ? 3 : 0);
+
+			for (const auto window : { "dataWindow", "displayWindow" })
+			{
+				header.put_attribute(window, "box2i", 16);
+				header.put<int32_t>(0);
+				header.put<int32_t>(0);
+				header.put<int32_t>(int32_t(width - 1));
+				header.put<int32_t>(int32_t(height - 1));
+			}
+
+			// Tiles are written in the order they are finished
+			header.put_attribute("lineOrder", "lineOrder", 1);
+			header.put<uint8_t>(tile_size > 0 ? 2 : 0); // random y : increasing y
+
+			header.put_attribute("pixelAspectRatio", "float", 4);
+			header.put(1.0f);
+
+			header.put_attribute("screenWindowCenter", "v2f", 8);
+			header.put(0.0f);
+			header.put(0.0f);
+
+			header.put_attribute("screenWindowWidth", "float", 4);
+			header.put(1.0f);
+
+			if (tile_size > 0)
+			{
+				header.put_attribute("tiles", "tiledesc", 9);
+				header.put<uint32_t>(tile_size);
+				header.put<uint32_t>(tile_size);
+				header.put<uint8_t>(0); // one level, rounded down
+			}
+
+			header.put<uint8_t>(0);
+			return header;
+		}
+
+		/// <summary>
+		/// Encodes a region of an image as the data of an EXR block (scanlines or tile): each line
+		/// holds the B, G then R values of its pixels
+		/// </summary>
+		std::vector<uint8_t> encode_exr_block(const rt::image& image, size_t x0, size_t y0, size_t width, size_t height, exr_compression compression)
+		{
+			exr_buffer data;
+			data.bytes.reserve(width * height * 3 * sizeof(float));
+
+			for (size_t y = y0; y < y0 + height; ++y)
+			{
+				for (int c = 2; c >= 0; --c)
+				{
+					for (size_t x = x0; x < x0 + width; ++x)
+						data.put(image.get_pixel(x, y)[c]);
+				}
+			}
+
+			return compression == exr_compression::zip ? zip_block(data.bytes) : data.bytes;
+		}
+	}
+
+	bool write_pfm(std::string_view file_name, const rt::image& image)
+	{
+		std::ofstream out{ std::string(file_name), std::ios::binary };
+
+		if (!out)
+			return false;
+
+		const auto width = image.get_width();
+		const auto height = image.get_height();
+
+		// A negative scale means little endian data
+		out << "PF\n" << width << " " << height << "\n" << (is_little_endian() ? "-1.0" : "1.0") << "\n";
+
+		// Rows are stored from the bottom of the picture to the top
+		std::vector<float> row(3 * width);
+
+		for (size_t y = height; y-- > 0;)
+		{
+			for (size_t x = 0; x < width; ++x)
+			{
+				const auto color = image.get_pixel(x, y);
+				row[3 * x] = color.r;
+				row[3 * x + 1] = color.g;
+				row[3 * x + 2] = color.b;
+			}
+
+			out.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+		}
+
+		return bool(out);
+	}
+
+	bool read_pfm(std::string_view file_name, rt::image& image)
+	{
+		std::ifstream in{ std::string(file_name), std::ios::binary };
+
+		if (!in)
+		{
+			spdlog::error("Can't open file: {0}", file_name);
+			return false;
+		}
+
+		std::string magic;
+		size_t width = 0, height = 0;
+		float scale = 0.0f;
+		in >> magic >> width >> height >> scale;
+
+		// A single whitespace separates the header from the data
+		in.get();
+
+		if (!in || (magic != "PF" && magic != "Pf") || width == 0 || height == 0 || scale == 0.0f)
+		{
+			spdlog::error("Invalid PFM file: {0}", file_name);
+			return false;
+		}
+
+		const size_t channels = magic == "PF" ? 3 : 1;
+		const bool swap = (scale < 0.0f) != is_little_endian();
+
+		std::vector<float> data(width * height * channels);
+		in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+
+		if (!in)
+		{
+			spdlog::error("Truncated PFM file: {0}", file_name);
+			return false;
+		}
+
+		if (swap)
+		{
+			for (auto& value : data)
+			{
+				uint8_t bytes[4];
+				std::memcpy(bytes, &value, 4);
+				std::swap(bytes[0], bytes[3]);
+				std::swap(bytes[1], bytes[2]);
+				std::memcpy(&value, bytes, 4);
+			}
+		}
+
+		image.set_format(texel_format::rgb32f);
+		image.resize(width, height);
+
+		for (size_t y = 0; y < height; ++y)
+		{
+			const float* row = &data[(height - 1 - y) * width * channels];
+
+			for (size_t x = 0; x < width; ++x)
+			{
+				const float* pixel = &row[x * channels];
+				image.set_pixel(x, y, channels == 3 ? glm::vec3(pixel[0], pixel[1], pixel[2]) : glm::vec3(pixel[0]));
+			}
+		}
+
+		return true;
+	}
+
+	bool write_hdr(std::string_view file_name, const rt::image& image)
+	{
+		const auto rgb = get_rgb(image);
+		return stbi_write_hdr(std::string(file_name).c_str(), int(image.get_width()), int(image.get_height()), 3, rgb.data()) != 0;
+	}
+
+	bool write_exr(std::string_view file_name, const rt::image& image, exr_compression compression)
+	{
+		const auto width = image.get_width();
+		const auto height = image.get_height();
+
+		if (width == 0 || height == 0)
+			return false;
+
+		const size_t block_lines = compression == exr_compression::zip ? 16 : 1;
+		const size_t blocks = (height + block_lines - 1) / block_lines;
+
+		const auto header = make_exr_header(width, height, compression, 0);
+
+		std::vector<exr_buffer> chunks(blocks);
+
+		for (size_t block = 0; block < blocks; ++block)
+		{
+			const size_t first = block * block_lines;
+			const size_t last = std::min(first + block_lines, height);
+			const auto payload = encode_exr_block(image, 0, first, width, last - first, compression);
+
+			chunks[block].put<int32_t>(int32_t(first));
+			chunks[block].put<int32_t>(int32_t(payload.size()));
+			chunks[block].bytes.insert(chunks[block].bytes.end(), payload.begin(), payload.end());
+		}
+
+		// Offset table, from the start of the file
+		exr_buffer offsets;
+		uint64_t offset = header.bytes.size() + blocks * sizeof(uint64_t);
+
+		for (const auto& chunk : chunks)
+		{
+			offsets.put<uint64_t>(offset);
+			offset += chunk.bytes.size();
+		}
+
+		std::ofstream out{ std::string(file_name), std::ios::binary };
+
+		if (!out)
+			return false;
+
+		out.write(reinterpret_cast<const char*>(header.bytes.data()), header.bytes.size());
+		out.write(reinterpret_cast<const char*>(offsets.bytes.data()), offsets.bytes.size());
+
+		for (const auto& chunk : chunks)
+			out.write(reinterpret_cast<const char*>(chunk.bytes.data()), chunk.bytes.size());
+
+		return bool(out);
+	}
+
+	bool read_exr(std::string_view file_name, rt::image& image)
+	{
+		std::ifstream in{ std::string(file_name), std::ios::binary };
+
+		if (!in)
+		{
+			spdlog::error("Can't open file: {0}", file_name);
+			return false;
+		}
+
+		const std::vector<uint8_t> bytes{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+		exr_reader reader(bytes);
+
+		const auto magic = reader.get<uint32_t>();
+		const auto version = reader.get<uint32_t>();
+
+		// Deep data (0x800) and multiple parts (0x1000) aren't supported
+		if (reader.failed || magic != 20000630 || (version & 0xff) != 2 || (version & 0x1800) != 0)
+		{
+			spdlog::error("Invalid or unsupported EXR file: {0}", file_name);
+			return false;
+		}
+
+		const bool tiled = (version & 0x200) != 0;
+
+		struct channel
+		{
+			std::string name;
+			int32_t type;
+			size_t offset;
+		};
+
+		std::vector<channel> channels;
+		size_t pixel_size = 0;
+		int32_t compression = -1;
+		int32_t x_min = 0, y_min = 0, x_max = -1, y_max = -1;
+		uint32_t tile_width = 0, tile_height = 0;
+		uint8_t tile_mode = 0;
+
+		for (auto name = reader.get_string(); !name.empty() && !reader.failed; name = reader.get_string())
+		{
+			const auto type = reader.get_string();
+			const auto size = reader.get<int32_t>();
+			const auto end = reader.position + size_t(std::max(size, 0));
+
+			if (name == "channels")
+			{
+				for (auto channel_name = reader.get_string(); !channel_name.empty() && !reader.failed; channel_name = reader.get_string())
+				{
+					const auto pixel_type = reader.get<int32_t>();
+					reader.position += 4; // pLinear, reserved
+					const auto x_sampling = reader.get<int32_t>();
+					const auto y_sampling = reader.get<int32_t>();
+
+					if (x_sampling != 1 || y_sampling != 1 || pixel_type < 0 || pixel_type > 2)
+					{
+						spdlog::error("Unsupported EXR channel {0} in {1}", channel_name, file_name);
+						return false;
+					}
+
+					// UINT (0) and FLOAT (2) are 4 bytes, HALF (1) 2 bytes
+					channels.push_back({ channel_name, pixel_type, pixel_size });
+					pixel_size += pixel_type == 1 ? 2 : 4;
+				}
+			}
+			else if (name == "compression")
+			{
+				compression = reader.get<uint8_t>();
+			}
+			else if (name == "dataWindow")
+			{
+				x_min = reader.get<int32_t>();
+				y_min = reader.get<int32_t>();
+				x_max = reader.get<int32_t>();
+				y_max = reader.get<int32_t>();
+			}
+			else if (name == "tiles")
+			{
+				tile_width = reader.get<uint32_t>();
+				tile_height = reader.get<uint32_t>();
+				tile_mode = reader.get<uint8_t>();
+			}
+
+			reader.position = end;
+		}
+
+		if (reader.failed || x_max < x_min || y_max < y_min || channels.empty())
+		{
+			spdlog::error("Invalid EXR file: {0}", file_name);
+			return false;
+		}
+
+		// 0: none, 2: ZIPS (1 line), 3: ZIP (16 lines)
+		if (compression != 0 && compression != 2 && compression != 3)
+		{
+			spdlog::error("Unsupported EXR compression ({0}) in {1}, only none and ZIP are read", compression, file_name);
+			return false;
+		}
+
+		if (tiled && (tile_width == 0 || tile_height == 0 || (tile_mode & 0xf) != 0))
+		{
+			spdlog::error("Unsupported EXR tiles in {0}, only single level files are read", file_name);
+			return false;
+		}
+
+		const auto find_channel = [&](const char* name) -> const channel* {
+			const auto it = std::find_if(channels.begin(), channels.end(), [&](const channel& c) { return c.name == name; });
+			return it != channels.end() ? &*it : nullptr;
+		};
+
+		const channel* rgb[3] = { find_channel("R"), find_channel("G"), find_channel("B") };
+
+		if (!rgb[0] || !rgb[1] || !rgb[2])
+		{
+			if (const auto y = find_channel("Y"))
+			{
+				rgb[0] = rgb[1] = rgb[2] = y;
+			}
+			else
+			{
+				spdlog::error("No RGB or Y channels in EXR file: {0}", file_name);
+				return false;
+			}
+		}
+
+		// The window spans up to 2^32 pixels per side, the extents don't fit 32 bits
+		const size_t width = size_t(int64_t(x_max) - x_min + 1);
+		const size_t height = size_t(int64_t(y_max) - y_min + 1);
+
+		// Scanline blocks are as wide as the image
+		const size_t block_width = tiled ? tile_width : width;
+		const size_t block_height = tiled ? tile_height : (compression == 3 ? 16 : 1);
+		const size_t blocks_x = (width + block_width - 1) / block_width;
+		const size_t blocks = blocks_x * ((height + block_height - 1) / block_height);
+
+		// The pixels must fit the file before allocating them: stored as is, or deflated, which
+		// shrinks the data by at most 1032:1. The offset table takes 8 bytes per block
+		const size_t bytes_left = bytes.size() - std::min(reader.position, bytes.size());
+		const size_t max_pixel_bytes = compression == 0 ? bytes_left : bytes_left * 1032;
+
+		if (blocks > bytes_left / 8 || width > max_pixel_bytes / pixel_size / height)
+		{
+			spdlog::error("Invalid EXR file: {0}", file_name);
+			return false;
+		}
+
+		std::vector<uint64_t> offsets(blocks);
+
+		for (auto& offset : offsets)
+			offset = reader.get<uint64_t>();
+
+		image.set_format(texel_format::rgb32f);
+		image.resize(width, height);
+
+		std::vector<uint8_t> raw;
+
+		for (size_t block = 0; block < blocks && !reader.failed; ++block)
+		{
+			reader.position = size_t(offsets[block]);
+
+			size_t x0 = 0, y0;
+
+			if (tiled)
+			{
+				const auto tile_x = reader.get<int32_t>();
+				const auto tile_y = reader.get<int32_t>();
+				reader.position += 8; // levels
+
+				x0 = size_t(tile_x) * tile_width;
+				y0 = size_t(tile_y) * tile_height;
+			}
+			else
+			{
+				y0 = size_t(int64_t(reader.get<int32_t>()) - y_min);
+			}
+
+			const auto stored_size = reader.get<int32_t>();
+
+			// Compared to the bytes left, the sum could wrap around
+			if (reader.failed || stored_size < 0 || x0 >= width || y0 >= height || size_t(stored_size) > bytes.size() - reader.position)
+			{
+				reader.failed = true;
+				break;
+			}
+
+			const auto size = size_t(stored_size);
+
+			const size_t w = std::min(block_width, width - x0);
+			const size_t h = std::min(block_height, height - y0);
+			const uint8_t* data = &bytes[reader.position];
+
+			raw.resize(w * h * pixel_size);
+
+			// Blocks that don't get smaller are stored uncompressed
+			if (size == raw.size())
+				std::memcpy(raw.data(), data, size);
+			else if (compression == 0 || !unzip_block(data, size, raw))
+			{
+				reader.failed = true;
+				break;
+			}
+
+			// Each line holds the values of its pixels channel by channel
+			for (size_t y = 0; y < h; ++y)
+			{
+				const uint8_t* line = &raw[y * w * pixel_size];
+
+				for (size_t x = 0; x < w; ++x)
+				{
+					glm::vec3 color;
+
+					for (int c = 0; c < 3; ++c)
+					{
+						const auto& ch = *rgb[c];
+						const uint8_t* value = line + ch.offset * w + x * (ch.type == 1 ? 2 : 4);
+
+						switch (ch.type)
+						{
+						case 0: color[c] = float(load_little_endian<uint32_t>(value)); break;
+						case 1: color[c] = half_to_float(load_little_endian<uint16_t>(value)); break;
+						default: color[c] = load_little_endian<float>(value); break;
+						}
+					}
+
+					image.set_pixel(x0 + x, y0 + y, color);
+				}
+			}
+		}
+
+		if (reader.failed)
+		{
+			spdlog::error("Invalid or truncated EXR file: {0}", file_name);
+			return false;
+		}
+
+		return true;
+	}
+
+	exr_tile_writer::~exr_tile_writer()
+	{
+		if (m_out.is_open())
+			close();
+	}
+
+	bool exr_tile_writer::open(std::string_view file_name, size_t width, size_t height, uint32_t tile_size, exr_compression compression)
+	{
+		if (width == 0 || height == 0 || tile_size == 0)
+			return false;
+
+		m_out.open(std::string(file_name), std::ios::binary | std::ios::trunc);
+
+		if (!m_out)
+			return false;
+
+		m_file_name = file_name;
+		m_width = width;
+		m_height = height;
+		m_tile_size = tile_size;
+		m_compression = compression;
+		m_tiles_x = (width + tile_size - 1) / tile_size;
+		m_offsets.assign(m_tiles_x * ((height + tile_size - 1) / tile_size), 0);
+
+		const auto header = make_exr_header(width, height, compression, tile_size);
+		m_out.write(reinterpret_cast<const char*>(header.bytes.data()), header.bytes.size());
+
+		// The offset table is filled on close, tiles are appended after it as they come
+		m_table_position = header.bytes.size();
+		exr_buffer table;
+
+		for (size_t i = 0; i < m_offsets.size(); ++i)
+			table.put<uint64_t>(0);
+
+		m_out.write(reinterpret_cast<const char*>(table.bytes.data()), table.bytes.size());
+		return bool(m_out);
+	}
+
+	bool exr_tile_writer::write_tile(size_t x, size_t y, const rt::image& tile)
+	{
+		if (x % m_tile_size != 0 || y % m_tile_size != 0 || x >= m_width || y >= m_height ||
+			tile.get_width() != std::min<size_t>(m_tile_size, m_width - x) || tile.get_height() != std::min<size_t>(m_tile_size, m_height - y))
+		{
+			spdlog::error("Invalid tile at {0}, {1} in {2}", x, y, m_file_name);
+			return false;
+		}
+
+		const size_t tile_x = x / m_tile_size;
+		const size_t tile_y = y / m_tile_size;
+
+		// Encoded before locking, tiles of several threads are compressed at the same time
+		const auto payload = encode_exr_block(tile, 0, 0, tile.get_width(), tile.get_height(), m_compression);
+
+		exr_buffer chunk;
+		chunk.put<int32_t>(int32_t(tile_x));
+		chunk.put<int32_t>(int32_t(tile_y));
+		chunk.put<int32_t>(0); // level x
+		chunk.put<int32_t>(0); // level y
+		chunk.put<int32_t>(int32_t(payload.size()));
+		chunk.bytes.insert(chunk.bytes.end(), payload.begin(), payload.end());
+
+		std::lock_guard guard(m_mutex);
+
+		if (!m_out.is_open())
+			return false;
+
+		m_out.seekp(0, std::ios::end);
+		m_offsets[tile_y * m_tiles_x + tile_x] = uint64_t(m_out.tellp());
+		m_out.write(reinterpret_cast<const char*>(chunk.bytes.data()), chunk.bytes.size());
+
+		return bool(m_out);
+	}
+
+	bool exr_tile_writer::close()
+	{
+		std::lock_guard guard(m_mutex);
+
+		if (!m_out.is_open())
+			return false;
+
+		const auto missing = std::count(m_offsets.begin(), m_offsets.end(), uint64_t(0));
+
+		if (missing > 0)
+			spdlog::warn("{0} tiles of {1} missing in {2}", missing, m_offsets.size(), m_file_name);
+
+		exr_buffer table;
+
+		for (const auto offset : m_offsets)
+			table.put<uint64_t>(offset);
+
+		m_out.seekp(std::streamoff(m_table_position));
+		m_out.write(reinterpret_cast<const char*>(table.bytes.data()), table.bytes.size());
+		m_out.close();
+
+		return bool(m_out);
+	}
+
+	bool write_png(std::string_view file_name, const uint8_t* pixels, size_t width, size_t height)
+	{
+		return stbi_write_png(std::string(file_name).c_str(), int(width), int(height), 3, pixels, int(width * 3)) != 0;
+	}
+}
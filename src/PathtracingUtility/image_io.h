@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rt
+{
+	class image;
+
+	namespace utility
+	{
+		/// <summary>
+		/// Compression of the EXR files
+		/// </summary>
+		enum class exr_compression
+		{
+			none,
+
+			/// <summary>
+			/// Deflate, by blocks of 16 lines (lossless)
+			/// </summary>
+			zip
+		};
+
+		/// <summary>
+		/// Writes an image as a color PFM file (32 bit floats, no tone mapping). The first row of
+		/// the image is the top of the picture, like in the rendered images
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="image">The image</param>
+		/// <returns>true on success</returns>
+		bool write_pfm(std::string_view file_name, const rt::image& image);
+
+		/// <summary>
+		/// Reads a color or grayscale PFM file, in either byte order, into an rgb32f image
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="image">The result, first row at the top of the picture</param>
+		/// <returns>true on success</returns>
+		bool read_pfm(std::string_view file_name, rt::image& image);
+
+		/// <summary>
+		/// Writes an image as a Radiance HDR file (RGBE, run length encoded)
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="image">The image</param>
+		/// <returns>true on success</returns>
+		bool write_hdr(std::string_view file_name, const rt::image& image);
+
+		/// <summary>
+		/// Writes an image as a scanline OpenEXR file with 32 bit float R, G and B channels
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="image">The image</param>
+		/// <param name="compression">The compression</param>
+		/// <returns>true on success</returns>
+		bool write_exr(std::string_view file_name, const rt::image& image, exr_compression compression = exr_compression::zip);
+
+		/// <summary>
+		/// Reads a single part OpenEXR file, scanline or tiled (one level), into an rgb32f image.
+		/// Channels may be half, float or uint; R, G and B are read, or Y for grayscale files.
+		/// Only uncompressed and ZIP (ZIPS) files are supported
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="image">The result, the data window of the file</param>
+		/// <returns>true on success</returns>
+		bool read_exr(std::string_view file_name, rt::image& image);
+
+		/// <summary>
+		/// Writes 8 bit RGB pixels as a PNG file
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="pixels">The pixels, 3 bytes each, first row at the top</param>
+		/// <param name="width">The width in pixels</param>
+		/// <param name="height">The height in pixels</param>
+		/// <returns>true on success</returns>
+		bool write_png(std::string_view file_name, const uint8_t* pixels, size_t width, size_t height);
+
+		/// <summary>
+		/// Writes a tiled OpenEXR file (32 bit float R, G and B channels) tile by tile, in any order,
+		/// for images too large to be held in memory: each tile is appended to the file as soon as
+		/// it's given. The offset table is written on close. Tiles can be written from several threads
+		/// </summary>
+		class exr_tile_writer
+		{
+		public:
+			exr_tile_writer() = default;
+			exr_tile_writer(const exr_tile_writer&) = delete;
+			exr_tile_writer& operator=(const exr_tile_writer&) = delete;
+
+			/// <summary>
+			/// Closes the file if still open
+			/// </summary>
+			~exr_tile_writer();
+
+			/// <summary>
+			/// Creates the file and writes its header
+			/// </summary>
+			/// <param name="file_name">The file</param>
+			/// <param name="width">The width of the image in pixels</param>
+			/// <param name="height">The height of the image in pixels</param>
+			/// <param name="tile_size">The width and height of the tiles in pixels</param>
+			/// <param name="compression">The compression of each tile</param>
+			/// <returns>true on success</returns>
+			bool open(std::string_view file_name, size_t width, size_t height, uint32_t tile_size, exr_compression compression = exr_compression::zip);
+
+			/// <summary>
+			/// Appends a tile to the file
+			/// </summary>
+			/// <param name="x">X position of the top left pixel of the tile, a multiple of the tile size</param>
+			/// <param name="y">Y position of the top left pixel of the tile, a multiple of the tile size</param>
+			/// <param name="tile">The pixels, cropped by the right and bottom edges of the image</param>
+			/// <returns>true on success</returns>
+			bool write_tile(size_t x, size_t y, const rt::image& tile);
+
+			/// <summary>
+			/// Writes the offset table and closes the file. Missing tiles are logged, the file is then incomplete
+			/// </summary>
+			/// <returns>true on success</returns>
+			bool close();
+
+		private:
+			std::mutex m_mutex;
+			std::ofstream m_out;
+			std::string m_file_name;
+			size_t m_width = 0;
+			size_t m_height = 0;
+			uint32_t m_tile_size = 0;
+			exr_compression m_compression = exr_compression::zip;
+			size_t m_tiles_x = 0;
+			uint64_t m_table_position = 0;
+
+			/// <summary>
+			/// Position of each tile in the file, by line of tiles, 0 until written
+			/// </summary>
+			std::vector<uint64_t> m_offsets;
+		};
+	}
+}
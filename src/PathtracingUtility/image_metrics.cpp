@@ -0,0 +1,93 @@
+#include "image_metrics.h"
+
+#include <cmath>
+
+#include "sampler.h"
+
+namespace rt::utility
+{
+	namespace
+	{
+		// Same operator as the saved images, before gamma correction
+		glm::vec3 tone_map(const glm::vec3& color)
+		{
+			return glm::vec3(1.0f) - glm::exp(-glm::max(color, glm::vec3(0.0f)));
+		}
+
+		float lab_f(float t)
+		{
+			constexpr float delta = 6.0f / 29.0f;
+			return t > delta * delta * delta ? std::cbrt(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+		}
+
+		/// <summary>
+		/// Converts linear sRGB to L*a*b*, white being (1, 1, 1)
+		/// </summary>
+		glm::vec3 to_lab(const glm::vec3& rgb)
+		{
+			const float x = 0.4124f * rgb.r + 0.3576f * rgb.g + 0.1805f * rgb.b;
+			const float y = 0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b;
+			const float z = 0.0193f * rgb.r + 0.1192f * rgb.g + 0.9505f * rgb.b;
+
+			// D65 white point
+			const float fx = lab_f(x / 0.9505f);
+			const float fy = lab_f(y);
+			const float fz = lab_f(z / 1.0890f);
+
+			return { 116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz) };
+		}
+
+		/// <summary>
+		/// Distance used by FLIP: absolute lightness difference plus euclidean chroma difference
+		/// </summary>
+		float hyab(const glm::vec3& lab0, const glm::vec3& lab1)
+		{
+			const auto d = lab0 - lab1;
+			return std::abs(d.x) + std::sqrt(d.y * d.y + d.z * d.z);
+		}
+	}
+
+	image_error compare_images(const rt::image& image, const rt::image& reference)
+	{
+		image_error error;
+
+		const auto width = reference.get_width();
+		const auto height = reference.get_height();
+
+		if (image.get_width() != width || image.get_height() != height || width == 0 || height == 0)
+			return error;
+
+		// Like FLIP, distances are compressed and normalized by the one between green and blue
+		constexpr float exponent = 0.7f;
+		const float max_distance = std::pow(hyab(to_lab({ 0.0f, 1.0f, 0.0f }), to_lab({ 0.0f, 0.0f, 1.0f })), exponent);
+
+		double squared = 0.0, relative = 0.0, perceptual = 0.0;
+
+		for (size_t y = 0; y < height; ++y)
+		{
+			for (size_t x = 0; x < width; ++x)
+			{
+				const auto value = image.get_pixel(x, y);
+				const auto ref = reference.get_pixel(x, y);
+
+				for (int c = 0; c < 3; ++c)
+				{
+					const double d = double(value[c]) - ref[c];
+					squared += d * d;
+					relative += d * d / (double(ref[c]) * ref[c] + 0.01);
+				}
+
+				const float distance = std::pow(hyab(to_lab(tone_map(value)), to_lab(tone_map(ref))), exponent);
+				perceptual += std::fmin(distance / max_distance, 1.0f);
+			}
+		}
+
+		const double pixels = double(width) * height;
+
+		error.rmse = std::sqrt(squared / (3.0 * pixels));
+		error.relmse = relative / (3.0 * pixels);
+		error.flip = perceptual / pixels;
+
+		return error;
+	}
+}
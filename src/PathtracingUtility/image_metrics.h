@@ -0,0 +1,41 @@
+#pragma once
+
+namespace rt
+{
+	class image;
+
+	namespace utility
+	{
+		/// <summary>
+		/// Differences between an image and a reference, see compare_images
+		/// </summary>
+		struct image_error
+		{
+			/// <summary>
+			/// Root mean square error of the linear values, over all channels
+			/// </summary>
+			double rmse = 0.0;
+
+			/// <summary>
+			/// Mean of (image - reference)^2 / (reference^2 + 0.01), over all channels. Weighs errors
+			/// in the dark areas like errors in the bright ones
+			/// </summary>
+			double relmse = 0.0;
+
+			/// <summary>
+			/// FLIP-like perceptual error, from 0 to 1. Only the color part of FLIP: both images are
+			/// tone mapped like the output images and compared in L*a*b* (HyAB distance). There's no
+			/// contrast sensitivity filtering nor edge and point detection
+			/// </summary>
+			double flip = 0.0;
+		};
+
+		/// <summary>
+		/// Compares an image to a reference of the same size
+		/// </summary>
+		/// <param name="image">The image</param>
+		/// <param name="reference">The reference</param>
+		/// <returns>The errors, zero if the sizes don't match</returns>
+		image_error compare_images(const rt::image& image, const rt::image& reference);
+	}
+}
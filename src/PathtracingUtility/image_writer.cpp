@@ -0,0 +1,172 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cctype>
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+#include "sampler.h"
+#include "profiler.h"
+
+namespace rt::utility
+{
+	namespace
+	{
+		/// <summary>
+		/// Lines converted by a task
+		/// </summary>
+		constexpr size_t s_band_height = 16;
+
+		/// <summary>
+		/// Gamma correction and quantization of tone mapped values, indexed by value * (size - 1)
+		/// </summary>
+		constexpr size_t s_gamma_table_size = 1 << 16;
+
+		const std::array<uint8_t, s_gamma_table_size>& get_gamma_table()
+		{
+			static const auto s_table = [] {
+				std::array<uint8_t, s_gamma_table_size> table;
+
+				for (size_t i = 0; i < table.size(); ++i)
+					table[i] = uint8_t(std::pow(i / float(table.size() - 1), 1.0f / 2.2f) * 255.0f);
+
+				return table;
+			}();
+
+			return s_table;
+		}
+
+		std::string get_extension(std::string_view file_name)
+		{
+			auto extension = std::filesystem::path(file_name).extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(std::tolower(c)); });
+			return extension;
+		}
+	}
+
+	image_writer::image_writer(size_t num_threads) : m_converters(num_threads)
+	{
+	}
+
+	image_writer::~image_writer()
+	{
+		wait();
+	}
+
+	bool image_writer::is_supported(std::string_view file_name)
+	{
+		const auto extension = get_extension(file_name);
+		return extension == ".png" || extension == ".pfm" || extension == ".hdr" || extension == ".exr";
+	}
+
+	void image_writer::write(const rt::image& image, const std::string& file_name, const image_output_options& options)
+	{
+		// The copy is the only work done by the caller
+		auto copy = std::make_shared<rt::image>(image);
+
+		m_writer.submit([this, copy, file_name, options] {
+			RT_PROFILE_ZONE("write_image");
+
+			if (options.convert)
+				options.convert(*copy);
+
+			if (write_now(*copy, file_name, options))
+				spdlog::info("image saved: {0}", file_name);
+			else
+				spdlog::error("Can't write file: {0}", file_name);
+		});
+	}
+
+	void image_writer::wait()
+	{
+		// Tasks run in order on a single thread: the previous ones are done when this one is
+		m_writer.submit([] {}).wait();
+	}
+
+	bool image_writer::write_now(const rt::image& image, const std::string& file_name, const image_output_options& options)
+	{
+		const auto extension = get_extension(file_name);
+
+		if (extension == ".pfm")
+			return write_pfm(file_name, image);
+
+		if (extension == ".hdr")
+			return write_hdr(file_name, image);
+
+		if (extension == ".exr")
+			return write_exr(file_name, image, options.compression);
+
+		if (extension != ".png")
+			spdlog::warn("Unknown image format: {0}, saved as PNG", file_name);
+
+		const auto pixels = to_display(image, options.tone_mapping);
+		return write_png(file_name, pixels.data(), image.get_width(), image.get_height());
+	}
+
+	std::vector<uint8_t> image_writer::to_display(const rt::image& image, bool tone_mapping)
+	{
+		const size_t width = image.get_width();
+		const size_t height = image.get_height();
+		std::vector<uint8_t> pixels(3 * width * height);
+
+		const auto& gamma_table = get_gamma_table();
+		const float table_scale = float(s_gamma_table_size - 1);
+
+		const auto convert_band = [&](size_t first, size_t last) {
+			RT_PROFILE_ZONE("convert_band", int64_t(first));
+
+			std::vector<float> row(3 * width);
+
+			for (size_t y = first; y < last; ++y)
+			{
+				for (size_t x = 0; x < width; ++x)
+				{
+					const auto color = image.get_pixel(x, y);
+					row[3 * x] = color.r;
+					row[3 * x + 1] = color.g;
+					row[3 * x + 2] = color.b;
+				}
+
+				// Straight loops over the channels of the line, for the compiler to vectorize
+				uint8_t* out = &pixels[3 * width * y];
+
+				if (tone_mapping)
+				{
+					for (size_t i = 0; i < row.size(); ++i)
+					{
+						// NaNs and negative values become 0
+						const float v = row[i] > 0.0f ? row[i] : 0.0f;
+						row[i] = 1.0f - std::exp(-v);
+					}
+
+					for (size_t i = 0; i < row.size(); ++i)
+						out[i] = gamma_table[size_t(std::min(row[i], 1.0f) * table_scale)];
+				}
+				else
+				{
+					for (size_t i = 0; i < row.size(); ++i)
+					{
+						const float v = row[i] > 0.0f ? row[i] : 0.0f;
+						out[i] = uint8_t(std::min(v, 1.0f) * 255.0f);
+					}
+				}
+			}
+		};
+
+		std::vector<std::shared_future<void>> bands;
+
+		for (size_t first = 0; first < height; first += s_band_height)
+		{
+			const size_t last = std::min(first + s_band_height, height);
+			bands.push_back(m_converters.submit([&convert_band, first, last] { convert_band(first, last); }));
+		}
+
+		for (const auto& band : bands)
+			band.wait();
+
+		return pixels;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "image_io.h"
+#include "task_pool.h"
+
+namespace rt
+{
+	class image;
+
+	namespace utility
+	{
+		/// <summary>
+		/// How images are converted when saved, see image_writer
+		/// </summary>
+		struct image_output_options
+		{
+			/// <summary>
+			/// Tone mapping (1 - e^-x) and gamma correction (2.2) of the 8 bit formats. When off, the
+			/// values are only clamped, for images already in display colors (e.g. heatmaps)
+			/// </summary>
+			bool tone_mapping = true;
+
+			exr_compression compression = exr_compression::zip;
+
+			/// <summary>
+			/// If set, called on the copy of the image before it's saved, on the writer thread: work
+			/// that doesn't need to hold up the caller (e.g. normalization, false colors)
+			/// </summary>
+			std::function<void(rt::image&)> convert;
+		};
+
+		/// <summary>
+		/// Saves images in the background, the format being chosen from the extension: PNG (8 bit,
+		/// tone mapped), PFM, Radiance HDR or OpenEXR (linear values). Images are copied, the caller
+		/// can go on rendering right away. Files are written one at a time, in order; the conversion
+		/// to 8 bits is split by bands of lines across threads
+		/// </summary>
+		class image_writer
+		{
+		public:
+			/// <summary>
+			/// Starts the threads
+			/// </summary>
+			/// <param name="num_threads">Threads converting the images, 0 means one per hardware thread</param>
+			image_writer(size_t num_threads = 0);
+
+			image_writer(const image_writer&) = delete;
+			image_writer& operator=(const image_writer&) = delete;
+
+			/// <summary>
+			/// Writes the pending images
+			/// </summary>
+			~image_writer();
+
+			/// <summary>
+			/// Returns true if the extension of the file is a supported format
+			/// </summary>
+			static bool is_supported(std::string_view file_name);
+
+			/// <summary>
+			/// Queues an image to be saved. The outcome is logged
+			/// </summary>
+			/// <param name="image">The image, copied</param>
+			/// <param name="file_name">The file</param>
+			/// <param name="options">The conversion options</param>
+			void write(const rt::image& image, const std::string& file_name, const image_output_options& options = {});
+
+			/// <summary>
+			/// Waits until all the queued images are written
+			/// </summary>
+			void wait();
+
+		private:
+			// Declared first to be destroyed last: pending writes still convert images
+			task_pool m_converters;
+			task_pool m_writer{ 1 };
+
+			bool write_now(const rt::image& image, const std::string& file_name, const image_output_options& options);
+
+			/// <summary>
+			/// Tone maps, gamma corrects and quantizes an image to 8 bit RGB, in parallel
+			/// </summary>
+			std::vector<uint8_t> to_display(const rt::image& image, bool tone_mapping);
+		};
+	}
+}
@@ -0,0 +1,106 @@
+#include "mapped_file.h"
+
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rt::utility
+{
+	mapped_file::mapped_file(std::string_view file_name, access access_hint)
+	{
+		const std::string path(file_name);
+
+#ifdef _WIN32
+		const DWORD flags = access_hint == access::sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | flags, nullptr);
+
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER size;
+
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+			if (mapping)
+			{
+				m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				m_size = m_data ? size_t(size.QuadPart) : 0;
+
+				// The view keeps the mapping alive
+				CloseHandle(mapping);
+			}
+		}
+
+		CloseHandle(file);
+#else
+		const int fd = open(path.c_str(), O_RDONLY);
+
+		if (fd < 0)
+			return;
+
+		struct stat st;
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (data != MAP_FAILED)
+			{
+				madvise(data, size_t(st.st_size), access_hint == access::sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+				m_data = static_cast<const char*>(data);
+				m_size = size_t(st.st_size);
+			}
+		}
+
+		::close(fd);
+#endif
+	}
+
+	mapped_file::mapped_file(mapped_file&& other) noexcept :
+		m_data(std::exchange(other.m_data, nullptr)),
+		m_size(std::exchange(other.m_size, 0))
+	{
+	}
+
+	mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			m_data = std::exchange(other.m_data, nullptr);
+			m_size = std::exchange(other.m_size, 0);
+		}
+		return *this;
+	}
+
+	mapped_file::~mapped_file()
+	{
+		close();
+	}
+
+	void mapped_file::close()
+	{
+		if (m_data == nullptr)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+#else
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+
+		m_data = nullptr;
+		m_size = 0;
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cinttypes>
+#include <string_view>
+
+namespace rt::utility
+{
+	/// <summary>
+	/// A read-only memory mapped file
+	/// </summary>
+	class mapped_file
+	{
+	public:
+		/// <summary>
+		/// How the content is going to be accessed, used as a hint for the OS
+		/// </summary>
+		enum class access { sequential, random };
+
+		mapped_file() = default;
+
+		/// <summary>
+		/// Maps the given file. If it fails, the instance is left empty (see "is_open")
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="access_hint">The expected access pattern</param>
+		mapped_file(std::string_view file_name, access access_hint = access::sequential);
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		mapped_file(mapped_file&& other) noexcept;
+		mapped_file& operator=(mapped_file&& other) noexcept;
+
+		~mapped_file();
+
+		/// <summary>
+		/// Returns true if the file has been mapped
+		/// </summary>
+		bool is_open() const { return m_data != nullptr; }
+
+		/// <summary>
+		/// Returns the content of the file
+		/// </summary>
+		const char* data() const { return m_data; }
+
+		/// <summary>
+		/// Returns the size of the file in bytes
+		/// </summary>
+		size_t size() const { return m_size; }
+
+	private:
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+
+		void close();
+	};
+}
@@ -0,0 +1,358 @@
+#include "mesh_cache.h"
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "scene.h"
+#include "mapped_file.h"
+#include "temp_file.h"
+#include "mesh_loader.h"
+
+namespace rt::utility
+{
+	namespace
+	{
+		// Bump when the layout of the file, rt::triangle or rt::kd_tree_node changes
+		static constexpr uint32_t s_version = 2;
+		static constexpr char s_magic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0' };
+		static constexpr uint64_t s_alignment = 16;
+
+		static_assert(std::is_trivially_copyable_v<rt::triangle>, "triangles are stored as-is");
+		static_assert(sizeof(glm::vec3) == 12 && sizeof(glm::vec2) == 8, "vertex streams are stored as-is");
+		static_assert(std::is_trivially_copyable_v<rt::kd_tree_node>, "KD-tree nodes are stored as-is");
+
+		struct cache_header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t triangle_size;
+			uint32_t node_size;
+			uint32_t mesh_count;
+			mesh_source source;
+		};
+
+		enum section : uint32_t
+		{
+			name_section,
+			positions_section,
+			normals_section,
+			uvs_section,
+			indices_section,
+			triangles_section,
+			nodes_section,
+			node_triangles_section,
+			section_count
+		};
+
+		/// <summary>
+		/// Describes a mesh: offset (from the start of the file) and number of elements of each section
+		/// </summary>
+		struct cache_entry
+		{
+			uint64_t offsets[section_count];
+			uint64_t counts[section_count];
+			rt::bounding_box bounds;
+
+			// Fills the tail padding, so that the written bytes are all initialized
+			uint32_t reserved[2] = {};
+		};
+
+		static_assert(sizeof(cache_entry) == 2 * section_count * sizeof(uint64_t) + sizeof(rt::bounding_box) + 2 * sizeof(uint32_t), "cache entries have no padding");
+
+		uint64_t align(uint64_t offset) { return (offset + s_alignment - 1) / s_alignment * s_alignment; }
+
+		/// <summary>
+		/// Checks that an array of "count" T at the given offset is inside the file and aligned
+		/// </summary>
+		template<typename T>
+		bool check_section(const mapped_file& file, uint64_t offset, uint64_t count)
+		{
+			return offset % alignof(T) == 0 && offset <= file.size() && count <= (file.size() - offset) / sizeof(T);
+		}
+
+		template<typename T>
+		bool check_section(const mapped_file& file, const cache_entry& entry, section s)
+		{
+			return check_section<T>(file, entry.offsets[s], entry.counts[s]);
+		}
+
+		/// <summary>
+		/// Returns a buffer referencing a section of the mapped file
+		/// </summary>
+		template<typename T>
+		rt::data_buffer<T> map_section(const std::shared_ptr<mapped_file>& file, const cache_entry& entry, section s)
+		{
+			return { reinterpret_cast<const T*>(file->data() + entry.offsets[s]), entry.counts[s], file };
+		}
+
+		/// <summary>
+		/// Checks that all the indices are lower than the given count
+		/// </summary>
+		bool check_indices(const rt::data_buffer<uint32_t>& indices, uint64_t count)
+		{
+			for (const auto i : indices)
+			{
+				if (i >= count)
+					return false;
+			}
+
+			return true;
+		}
+
+		/// <summary>
+		/// Checks that the tree only references existing nodes and triangles, and that it's
+		/// not deeper than what the traversal supports
+		/// </summary>
+		bool check_tree(const rt::kd_tree& tree, uint64_t triangle_count)
+		{
+			const auto& nodes = tree.get_nodes();
+			const auto& indices = tree.get_triangle_indices();
+
+			const auto check_child = [&nodes](size_t parent, uint32_t child) {
+				return child == rt::kd_tree_node::s_no_child ||
+					(child > parent && child < nodes.size() && nodes[child].depth == nodes[parent].depth + 1);
+			};
+
+			if (!nodes.empty() && nodes[0].depth != 0)
+				return false;
+
+			for (size_t i = 0; i < nodes.size(); ++i)
+			{
+				const auto& node = nodes[i];
+
+				if (node.depth > rt::kd_tree::s_max_depth || !check_child(i, node.left) || !check_child(i, node.right) ||
+					uint64_t(node.first_triangle) + node.triangle_count > indices.size())
+					return false;
+			}
+
+			return check_indices(indices, triangle_count);
+		}
+	}
+
+	uint64_t hash_bytes(const char* data, size_t size)
+	{
+		static constexpr uint64_t s_prime = 0x100000001b3ull;
+		static constexpr uint64_t s_mix = 0x9e3779b97f4a7c15ull;
+
+		uint64_t h = 0xcbf29ce484222325ull ^ (size * s_mix);
+		size_t i = 0;
+
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t w;
+			std::memcpy(&w, data + i, 8);
+			w *= s_mix;
+			h = (h ^ (w ^ (w >> 32))) * s_prime;
+		}
+
+		for (; i < size; ++i)
+			h = (h ^ uint8_t(data[i])) * s_prime;
+
+		h ^= h >> 33;
+		h *= s_mix;
+		h ^= h >> 29;
+		return h;
+	}
+
+	bool get_mesh_source(std::string_view file_name, mesh_source& source)
+	{
+		const mapped_file file(file_name);
+		std::error_code error;
+		const auto mtime = std::filesystem::last_write_time(std::filesystem::path(file_name), error);
+
+		if (!file.is_open() || error)
+			return false;
+
+		source.size = file.size();
+		source.mtime = int64_t(mtime.time_since_epoch().count());
+		source.hash = hash_bytes(file.data(), file.size());
+		return true;
+	}
+
+	bool write_mesh_cache(std::string_view file_name, const mesh_source& source, const std::map<std::string, std::shared_ptr<rt::mesh>>& meshes)
+	{
+		cache_header header;
+		std::memcpy(header.magic, s_magic, sizeof(s_magic));
+		header.version = s_version;
+		header.triangle_size = sizeof(rt::triangle);
+		header.node_size = sizeof(rt::kd_tree_node);
+		header.mesh_count = uint32_t(meshes.size());
+		header.source = source;
+
+		// Lay out the sections after the header and the entries
+		std::vector<cache_entry> entries;
+		std::vector<std::array<std::pair<const void*, uint64_t>, section_count>> sections;
+		uint64_t offset = sizeof(cache_header) + meshes.size() * sizeof(cache_entry);
+
+		for (const auto& [name, mesh] : meshes)
+		{
+			if (!mesh->is_compiled())
+			{
+				spdlog::error("Mesh cache {0}: mesh {1} is not compiled", file_name, name);
+				return false;
+			}
+
+			const auto& tree = mesh->get_kd_tree();
+			cache_entry& entry = entries.emplace_back();
+			auto& data = sections.emplace_back();
+
+			entry.bounds = mesh->get_bounds();
+
+			const auto add_section = [&](section s, const auto& buffer) {
+				using element = std::decay_t<decltype(*buffer.data())>;
+				entry.offsets[s] = offset;
+				entry.counts[s] = buffer.size();
+				data[s] = { buffer.data(), buffer.size() * sizeof(element) };
+				offset = align(offset + data[s].second);
+			};
+
+			add_section(name_section, name);
+			add_section(positions_section, mesh->get_positions());
+			add_section(normals_section, mesh->get_normals());
+			add_section(uvs_section, mesh->get_uvs());
+			add_section(indices_section, mesh->get_indices());
+			add_section(triangles_section, mesh->get_triangles());
+			add_section(nodes_section, tree.get_nodes());
+			add_section(node_triangles_section, tree.get_triangle_indices());
+		}
+
+		// Write to a temporary file first, so that a partial file is never picked up
+		const std::string temp_file = get_temp_file_name(file_name);
+		std::ofstream os(temp_file, std::ios::binary | std::ios::trunc);
+
+		if (!os.good())
+			return false;
+
+		uint64_t position = 0;
+
+		const auto write = [&os, &position](uint64_t at, const void* data, uint64_t size) {
+			static const char s_padding[s_alignment] = {};
+			os.write(s_padding, std::streamsize(at - position));
+			os.write(static_cast<const char*>(data), std::streamsize(size));
+			position = at + size;
+		};
+
+		write(0, &header, sizeof(header));
+		write(position, entries.data(), entries.size() * sizeof(cache_entry));
+
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			for (uint32_t s = 0; s < section_count; ++s)
+				write(entries[i].offsets[s], sections[i][s].first, sections[i][s].second);
+		}
+
+		os.close();
+
+		std::error_code error;
+
+		if (!os.good())
+		{
+			std::filesystem::remove(temp_file, error);
+			return false;
+		}
+
+		std::filesystem::rename(temp_file, std::filesystem::path(file_name), error);
+		return !error;
+	}
+
+	bool read_mesh_cache(std::string_view file_name, const mesh_source& source, std::map<std::string, std::shared_ptr<rt::mesh>>& meshes)
+	{
+		// Meshes reference the mapping, it's released with the last of them
+		const auto file = std::make_shared<mapped_file>(file_name, mapped_file::access::random);
+
+		if (!file->is_open() || file->size() < sizeof(cache_header))
+			return false;
+
+		cache_header header;
+		std::memcpy(&header, file->data(), sizeof(header));
+
+		if (std::memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 ||
+			header.version != s_version ||
+			header.triangle_size != sizeof(rt::triangle) ||
+			header.node_size != sizeof(rt::kd_tree_node) ||
+			header.source != source ||
+			!check_section<cache_entry>(*file, sizeof(cache_header), header.mesh_count))
+			return false;
+
+		std::map<std::string, std::shared_ptr<rt::mesh>> result;
+
+		for (uint32_t i = 0; i < header.mesh_count; ++i)
+		{
+			cache_entry entry;
+			std::memcpy(&entry, file->data() + sizeof(cache_header) + i * sizeof(cache_entry), sizeof(entry));
+
+			if (!check_section<char>(*file, entry, name_section) ||
+				!check_section<glm::vec3>(*file, entry, positions_section) ||
+				!check_section<glm::vec3>(*file, entry, normals_section) ||
+				!check_section<glm::vec2>(*file, entry, uvs_section) ||
+				!check_section<uint32_t>(*file, entry, indices_section) ||
+				!check_section<rt::triangle>(*file, entry, triangles_section) ||
+				!check_section<rt::kd_tree_node>(*file, entry, nodes_section) ||
+				!check_section<uint32_t>(*file, entry, node_triangles_section))
+			{
+				spdlog::warn("Mesh cache {0} is corrupted", file_name);
+				return false;
+			}
+
+			auto positions = map_section<glm::vec3>(file, entry, positions_section);
+			auto normals = map_section<glm::vec3>(file, entry, normals_section);
+			auto uvs = map_section<glm::vec2>(file, entry, uvs_section);
+			auto indices = map_section<uint32_t>(file, entry, indices_section);
+			auto triangles = map_section<rt::triangle>(file, entry, triangles_section);
+
+			rt::kd_tree tree(map_section<rt::kd_tree_node>(file, entry, nodes_section), map_section<uint32_t>(file, entry, node_triangles_section));
+
+			if (normals.size() != positions.size() || uvs.size() != positions.size() ||
+				triangles.size() * 3 != indices.size() ||
+				!check_indices(indices, positions.size()) ||
+				!check_tree(tree, triangles.size()))
+			{
+				spdlog::warn("Mesh cache {0} is corrupted", file_name);
+				return false;
+			}
+
+			result[std::string(file->data() + entry.offsets[name_section], entry.counts[name_section])] = std::make_shared<rt::mesh>(
+				std::move(positions), std::move(normals), std::move(uvs), std::move(indices), std::move(triangles), std::move(tree), entry.bounds);
+		}
+
+		meshes = std::move(result);
+		return true;
+	}
+
+	std::map<std::string, std::shared_ptr<rt::mesh>> load_meshes_cached(std::string_view file_name)
+	{
+		const std::string cache_file = std::string(file_name) + ".rtmesh";
+		std::map<std::string, std::shared_ptr<rt::mesh>> result;
+		mesh_source source;
+
+		if (!get_mesh_source(file_name, source))
+		{
+			spdlog::error("Can't open file: {0}", file_name.data());
+			return result;
+		}
+
+		if (read_mesh_cache(cache_file, source, result))
+		{
+			spdlog::info("Loaded mesh cache: {0}", cache_file);
+			return result;
+		}
+
+		result = load_meshes_from_wavefront(file_name);
+
+		for (auto& [name, mesh] : result)
+			mesh->compile();
+
+		if (write_mesh_cache(cache_file, source, result))
+			spdlog::info("Mesh cache written: {0}", cache_file);
+		else
+			spdlog::warn("Can't write mesh cache: {0}", cache_file);
+
+		return result;
+	}
+}
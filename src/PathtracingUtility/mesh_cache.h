@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace rt
+{
+	class mesh;
+
+	namespace utility
+	{
+		/// <summary>
+		/// Identifies the content of the file a mesh cache was generated from
+		/// </summary>
+		struct mesh_source
+		{
+			uint64_t size = 0;
+			int64_t mtime = 0;
+			uint64_t hash = 0;
+
+			bool operator==(const mesh_source& other) const { return size == other.size && mtime == other.mtime && hash == other.hash; }
+			bool operator!=(const mesh_source& other) const { return !(*this == other); }
+		};
+
+		/// <summary>
+		/// Hashes bytes (FNV-1a on 64 bit words, then mixed). Unlike std::hash, the result doesn't
+		/// depend on the standard library, it can be stored in files
+		/// </summary>
+		uint64_t hash_bytes(const char* data, size_t size);
+
+		/// <summary>
+		/// Reads size, modification time and content hash of the given file
+		/// </summary>
+		/// <param name="file_name">The file</param>
+		/// <param name="source">The result</param>
+		/// <returns>true on success</returns>
+		bool get_mesh_source(std::string_view file_name, mesh_source& source);
+
+		/// <summary>
+		/// Writes compiled meshes (triangles and KD-tree) to a binary mesh cache
+		/// </summary>
+		/// <param name="file_name">The cache file</param>
+		/// <param name="source">The file the meshes were loaded from</param>
+		/// <param name="meshes">The meshes, must be compiled</param>
+		/// <returns>true on success</returns>
+		bool write_mesh_cache(std::string_view file_name, const mesh_source& source, const std::map<std::string, std::shared_ptr<rt::mesh>>& meshes);
+
+		/// <summary>
+		/// Maps a binary mesh cache. The meshes reference the mapped file directly, they are
+		/// already compiled
+		/// </summary>
+		/// <param name="file_name">The cache file</param>
+		/// <param name="source">The expected source, the cache is rejected if it was generated from something else</param>
+		/// <param name="meshes">The meshes found in the cache</param>
+		/// <returns>true if the cache exists and is valid</returns>
+		bool read_mesh_cache(std::string_view file_name, const mesh_source& source, std::map<std::string, std::shared_ptr<rt::mesh>>& meshes);
+
+		/// <summary>
+		/// Loads meshes from a Wavefront file through a mesh cache stored next to it ("file.obj.rtmesh").
+		/// The cache is generated on first use and regenerated when the source changes
+		/// </summary>
+		/// <param name="file_name">The Wavefront file</param>
+		/// <returns>A map of the compiled meshes found in the given file</returns>
+		std::map<std::string, std::shared_ptr<rt::mesh>> load_meshes_cached(std::string_view file_name);
+	}
+}
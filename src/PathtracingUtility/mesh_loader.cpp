@@ -1,160 +1,612 @@
 #include "mesh_loader.h"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <spdlog/spdlog.h>
 #include <glm/glm.hpp>
-#include <regex>
 
 #include "scene.h"
+#include "mapped_file.h"
 
 namespace rt::utility
 {
-    std::map<std::string, std::shared_ptr<rt::mesh>> load_meshes_from_wavefront(std::string_view file_name)
+    namespace
     {
-        std::map<std::string, std::shared_ptr<rt::mesh>> result;
+        bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
 
-        std::ifstream is;
-        is.open(file_name.data());
+        bool is_digit(char c) { return c >= '0' && c <= '9'; }
 
-        if (!is.is_open())
+        const char* skip_blanks(const char* p, const char* end)
         {
-            spdlog::error("Can't open file: {0}", file_name.data());
-            return result;
+            while (p < end && is_blank(*p)) ++p;
+            return p;
         }
 
-        std::string line;
-        std::string current_mesh_name = "default";
-        auto current_mesh = std::make_shared<rt::mesh>();
-        std::vector<glm::vec3> vertices, normals;
-        std::vector<glm::vec2> uvs;
+        const char* skip_line(const char* p, const char* end)
+        {
+            const auto eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            return eol ? eol + 1 : end;
+        }
 
-        const auto check_new_mesh = [&current_mesh, &result, &current_mesh_name] {
-            if (current_mesh->get_triangles().size() > 0) {
-                current_mesh->compile();
-                result[current_mesh_name] = std::move(current_mesh);
-                current_mesh = std::make_shared<rt::mesh>();
-            }
-        };
+        const char* token_end(const char* p, const char* end)
+        {
+            while (p < end && !is_blank(*p) && *p != '\n') ++p;
+            return p;
+        }
+
+        bool token_equals(const char* begin, const char* end, std::string_view token)
+        {
+            return size_t(end - begin) == token.size() && std::memcmp(begin, token.data(), token.size()) == 0;
+        }
+
+        bool parse_int(const char*& p, const char* end, int64_t& value)
+        {
+            bool negative = false;
+
+            if (p < end && (*p == '-' || *p == '+'))
+                negative = *p++ == '-';
 
+            if (p == end || !is_digit(*p))
+                return false;
 
-        const std::regex r_comment("#\\s+(.+)");
-        const std::regex r_vertex("v\\s+(-?[\\d\.]+)\\s+(-?[\\d\.]+)\\s+(-?[\\d\.]+)");
-        const std::regex r_normal("vn\\s+(-?[\\d\.]+)\\s+(-?[\\d\.]+)\\s+(-?[\\d\.]+)");
-        const std::regex r_uv("vt\\s+(-?[\\d\.]+)\\s+(-?[\\d\.]+)");
-        const std::regex r_object("[og]\\s+(.+)");
-        const std::regex r_face0("f\\s+([0-9]+)\\s+([0-9]+)\\s+([0-9]+)");
-        const std::regex r_face1(
-            "f\\s+"
-            "([0-9]+)//([0-9]+)\\s+"
-            "([0-9]+)//([0-9]+)\\s+"
-            "([0-9]+)//([0-9]+)");
-        const std::regex r_face2(
-            "f\\s+"
-            "([0-9]+)/([0-9]+)\\s+"
-            "([0-9]+)/([0-9]+)\\s+"
-            "([0-9]+)/([0-9]+)");
-        const std::regex r_face3(
-            "f\\s+"
-            "([0-9]+)/([0-9]+)/([0-9]+)\\s+"
-            "([0-9]+)/([0-9]+)/([0-9]+)\\s+"
-            "([0-9]+)/([0-9]+)/([0-9]+)");
-
-        while (is.good())
-        {
-            std::getline(is, line);
-            std::smatch matches;
-
-            if (std::regex_search(line, matches, r_vertex))
+            int64_t result = 0;
+
+            // Indices and exponents fit 32 bits, longer numbers are malformed
+            while (p < end && is_digit(*p))
             {
-                vertices.push_back({
-                    std::stof(matches.str(1)),
-                    std::stof(matches.str(2)),
-                    std::stof(matches.str(3))
-                    });
+                result = result * 10 + (*p++ - '0');
+
+                if (result > std::numeric_limits<int32_t>::max())
+                    return false;
             }
-            else if (std::regex_search(line, matches, r_normal))
+
+            value = negative ? -result : result;
+            return true;
+        }
+
+        bool parse_float(const char*& p, const char* end, float& value)
+        {
+            static constexpr double s_pow10[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+
+            bool negative = false;
+
+            if (p < end && (*p == '-' || *p == '+'))
+                negative = *p++ == '-';
+
+            uint64_t mantissa = 0;
+            int32_t exponent = 0;
+            int32_t digits = 0;
+            bool any_digit = false;
+
+            // Only the first 19 significant digits fit in the mantissa, the others
+            // only scale the value
+            for (; p < end && is_digit(*p); ++p, any_digit = true)
             {
-                normals.push_back({
-                    std::stof(matches.str(1)),
-                    std::stof(matches.str(2)),
-                    std::stof(matches.str(3))
-                    });
+                if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits += mantissa != 0; }
+                else ++exponent;
             }
-            else if (std::regex_search(line, matches, r_uv))
+
+            if (p < end && *p == '.')
             {
-                uvs.push_back({
-                    std::stof(matches.str(1)),
-                    std::stof(matches.str(2)),
-                    });
+                for (++p; p < end && is_digit(*p); ++p, any_digit = true)
+                {
+                    if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); digits += mantissa != 0; --exponent; }
+                }
             }
-            else if (std::regex_search(line, matches, r_face0))
+
+            if (!any_digit)
+                return false;
+
+            if (p < end && (*p == 'e' || *p == 'E'))
             {
-                auto& t = current_mesh->add_triangle();
+                int64_t e;
+                const char* q = p + 1;
 
-                for (size_t i = 0; i < 3; ++i)
+                if (parse_int(q, end, e))
                 {
-                    t.vertices[i].position = vertices[std::stoi(matches.str(1 + i)) - 1];
+                    exponent += int32_t(glm::clamp<int64_t>(e, -400, 400));
+                    p = q;
                 }
+            }
 
+            double result = double(mantissa);
+
+            while (exponent > 22) { result *= 1e22; exponent -= 22; }
+            while (exponent < -22) { result /= 1e22; exponent += 22; }
+
+            result = exponent >= 0 ? result * s_pow10[exponent] : result / s_pow10[-exponent];
+
+            value = float(negative ? -result : result);
+            return true;
+        }
+
+        /// <summary>
+        /// Parses a list of floats, up to the given count
+        /// </summary>
+        template<size_t N>
+        bool parse_floats(const char* p, const char* end, float (&values)[N])
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                p = skip_blanks(p, end);
+                if (!parse_float(p, end, values[i]))
+                    return false;
             }
-            else if (std::regex_search(line, matches, r_face1))
+            return true;
+        }
+
+        /// <summary>
+        /// Converts a 1-based (or negative, relative to the end) index to a 0-based one
+        /// </summary>
+        bool resolve_index(int64_t index, size_t count, size_t& result)
+        {
+            const int64_t resolved = index > 0 ? index - 1 : int64_t(count) + index;
+
+            if (index == 0 || resolved < 0 || resolved >= int64_t(count))
+                return false;
+
+            result = size_t(resolved);
+            return true;
+        }
+
+        /// <summary>
+        /// The OBJ indices of a face vertex, 0 when not present
+        /// </summary>
+        struct face_vertex
+        {
+            int64_t position = 0, uv = 0, normal = 0;
+        };
+
+        struct obj_face
+        {
+            size_t first_vertex, vertex_count;
+
+            // Number of positions, uvs and normals read by the chunk before this face,
+            // needed to resolve negative indices
+            size_t positions, uvs, normals;
+        };
+
+        /// <summary>
+        /// A triangle corner, with indices resolved in the whole file. Corners with the same
+        /// indices share a vertex in the mesh
+        /// </summary>
+        struct obj_corner
+        {
+            static constexpr uint32_t s_no_uv = std::numeric_limits<uint32_t>::max();
+            static constexpr uint32_t s_flat_normal = 1u << 31;
+
+            uint32_t position, uv, normal;
+
+            bool operator==(const obj_corner& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+        };
+
+        struct obj_corner_hash
+        {
+            size_t operator()(const obj_corner& c) const
             {
-                auto& t = current_mesh->add_triangle();
+                uint64_t h = c.position * 0x9e3779b97f4a7c15ull;
+                h = (h ^ c.uv) * 0xff51afd7ed558ccdull;
+                h = (h ^ c.normal) * 0xc4ceb9fe1a85ec53ull;
+                return size_t(h ^ (h >> 32));
+            }
+        };
 
-                for (size_t i = 0; i < 3; ++i)
-                {
-                    t.vertices[i].position = vertices[std::stoi(matches.str(1 + i * 2)) - 1];
-                    t.vertices[i].normal = normals[std::stoi(matches.str(2 + i * 2)) - 1];
-                }
+        struct obj_object
+        {
+            size_t first_face;
+            std::string name;
+        };
+
+        /// <summary>
+        /// A range of lines of an OBJ file, parsed independently from the others
+        /// </summary>
+        struct obj_chunk
+        {
+            const char* begin = nullptr;
+            const char* end = nullptr;
+
+            std::vector<glm::vec3> positions, normals;
+            std::vector<glm::vec2> uvs;
+            std::vector<face_vertex> face_vertices;
+            std::vector<obj_face> faces;
+            std::vector<obj_object> objects;
+
+            // Offsets of the chunk data in the whole file
+            size_t position_base = 0, uv_base = 0, normal_base = 0;
 
+            // Triangle corners and first triangle of each object, filled once indices are resolved.
+            // Faces without normals get a generated flat normal
+            std::vector<obj_corner> corners;
+            std::vector<glm::vec3> flat_normals;
+            std::vector<size_t> object_triangles;
+
+            size_t ignored_lines = 0, invalid_faces = 0;
+        };
+
+        /// <summary>
+        /// The vertex data of the whole file
+        /// </summary>
+        struct obj_attributes
+        {
+            std::vector<glm::vec3> positions, normals;
+            std::vector<glm::vec2> uvs;
+        };
+
+        static constexpr size_t s_min_chunk_size = 256 * 1024;
+
+        /// <summary>
+        /// Runs fn(i) for i in [0, count) on up to the given number of threads
+        /// </summary>
+        template<typename Fn>
+        void parallel_for(size_t count, size_t num_threads, const Fn& fn)
+        {
+            num_threads = std::min(count, num_threads);
+
+            if (num_threads <= 1)
+            {
+                for (size_t i = 0; i < count; ++i)
+                    fn(i);
+                return;
             }
-            else if (std::regex_search(line, matches, r_face2))
+
+            std::atomic<size_t> next = 0;
+            std::vector<std::thread> threads(num_threads);
+
+            for (auto& thread : threads)
             {
-                auto& t = current_mesh->add_triangle();
+                thread = std::thread([&] {
+                    for (size_t i = next++; i < count; i = next++)
+                        fn(i);
+                });
+            }
+
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        /// <summary>
+        /// Splits [begin, end) in up to "count" ranges, each ending at a line boundary
+        /// </summary>
+        std::vector<obj_chunk> split_chunks(const char* begin, const char* end, size_t count)
+        {
+            std::vector<obj_chunk> chunks;
+            const size_t chunk_size = size_t(end - begin) / count + 1;
+
+            for (const char* p = begin; p < end;)
+            {
+                auto& chunk = chunks.emplace_back();
+                chunk.begin = p;
+                chunk.end = size_t(end - p) > chunk_size ? skip_line(p + chunk_size, end) : end;
+                p = chunk.end;
+            }
+
+            return chunks;
+        }
+
+        void parse_chunk(obj_chunk& chunk)
+        {
+            const char* const end = chunk.end;
+
+            const auto parse_face = [&chunk](const char* p, const char* end) -> bool {
+                obj_face face{ chunk.face_vertices.size(), 0, chunk.positions.size(), chunk.uvs.size(), chunk.normals.size() };
 
-                for (size_t i = 0; i < 3; ++i)
+                for (p = skip_blanks(p, end); p < end && *p != '\n'; p = skip_blanks(p, end))
                 {
-                    t.vertices[i].position = vertices[std::stoi(matches.str(1 + i * 2)) - 1];
-                    t.vertices[i].uv = uvs[std::stoi(matches.str(2 + i * 2)) - 1];
+                    // v, v/vt, v//vn or v/vt/vn
+                    face_vertex v;
+
+                    if (!parse_int(p, end, v.position))
+                        return false;
+
+                    if (p < end && *p == '/')
+                    {
+                        ++p;
+
+                        if (p < end && *p != '/' && !parse_int(p, end, v.uv))
+                            return false;
+
+                        if (p < end && *p == '/')
+                        {
+                            ++p;
+                            if (!parse_int(p, end, v.normal))
+                                return false;
+                        }
+                    }
+
+                    chunk.face_vertices.push_back(v);
                 }
 
-            }
-            else if (std::regex_search(line, matches, r_face3))
+                face.vertex_count = chunk.face_vertices.size() - face.first_vertex;
+
+                if (face.vertex_count < 3)
+                    return false;
+
+                chunk.faces.push_back(face);
+                return true;
+            };
+
+            for (const char* p = chunk.begin; p < end; p = skip_line(p, end))
             {
-                auto& t = current_mesh->add_triangle();
+                p = skip_blanks(p, end);
+
+                if (p == end || *p == '\n' || *p == '#')
+                    continue;
 
-                for (size_t i = 0; i < 3; ++i)
+                const char* keyword_end = token_end(p, end);
+                const char* args = skip_blanks(keyword_end, end);
+
+                if (token_equals(p, keyword_end, "v"))
+                {
+                    float v[3];
+                    if (parse_floats(args, end, v))
+                        chunk.positions.push_back({ v[0], v[1], v[2] });
+                    else
+                        ++chunk.ignored_lines;
+                }
+                else if (token_equals(p, keyword_end, "vn"))
                 {
-                    t.vertices[i].position = vertices[std::stoi(matches.str(1 + i * 3)) - 1];
-                    t.vertices[i].uv = uvs[std::stoi(matches.str(2 + i * 3)) - 1];
-                    t.vertices[i].normal = normals[std::stoi(matches.str(3 + i * 3)) - 1];
+                    float n[3];
+                    if (parse_floats(args, end, n))
+                        chunk.normals.push_back({ n[0], n[1], n[2] });
+                    else
+                        ++chunk.ignored_lines;
                 }
+                else if (token_equals(p, keyword_end, "vt"))
+                {
+                    float uv[2];
+                    if (parse_floats(args, end, uv))
+                        chunk.uvs.push_back({ uv[0], uv[1] });
+                    else
+                        ++chunk.ignored_lines;
+                }
+                else if (token_equals(p, keyword_end, "f"))
+                {
+                    if (!parse_face(args, end))
+                    {
+                        chunk.face_vertices.resize(chunk.faces.empty() ? 0 : chunk.faces.back().first_vertex + chunk.faces.back().vertex_count);
+                        ++chunk.invalid_faces;
+                    }
+                }
+                else if (token_equals(p, keyword_end, "o") || token_equals(p, keyword_end, "g"))
+                {
+                    const char* name_end = static_cast<const char*>(std::memchr(args, '\n', end - args));
+                    name_end = name_end ? name_end : end;
 
+                    while (name_end > args && is_blank(name_end[-1]))
+                        --name_end;
 
+                    chunk.objects.push_back({ chunk.faces.size(), std::string(args, name_end) });
+                }
+                else if (!token_equals(p, keyword_end, "usemtl") && !token_equals(p, keyword_end, "mtllib") &&
+                    !token_equals(p, keyword_end, "s") && !token_equals(p, keyword_end, "l") && !token_equals(p, keyword_end, "p"))
+                {
+                    ++chunk.ignored_lines;
+                }
             }
-            else if (std::regex_search(line, matches, r_object))
+        }
+
+        /// <summary>
+        /// Resolves the face indices of a chunk against the vertex data of the whole file and triangulates the faces
+        /// </summary>
+        void build_triangles(obj_chunk& chunk, const obj_attributes& attributes)
+        {
+            std::vector<obj_corner> face;
+            size_t next_object = 0;
+
+            const auto resolve_face = [&](const obj_face& f) -> bool {
+                face.clear();
+                bool has_normals = true;
+
+                for (size_t i = 0; i < f.vertex_count; ++i)
+                {
+                    const auto& fv = chunk.face_vertices[f.first_vertex + i];
+                    obj_corner& c = face.emplace_back();
+                    size_t resolved;
+
+                    // Indices can only refer to data read before the face
+                    if (!resolve_index(fv.position, chunk.position_base + f.positions, resolved))
+                        return false;
+                    c.position = uint32_t(resolved);
+
+                    c.uv = obj_corner::s_no_uv;
+
+                    if (fv.uv != 0)
+                    {
+                        if (!resolve_index(fv.uv, chunk.uv_base + f.uvs, resolved))
+                            return false;
+                        c.uv = uint32_t(resolved);
+                    }
+
+                    if (fv.normal != 0)
+                    {
+                        if (!resolve_index(fv.normal, chunk.normal_base + f.normals, resolved))
+                            return false;
+                        c.normal = uint32_t(resolved);
+                    }
+
+                    has_normals = has_normals && fv.normal != 0;
+                }
+
+                // Faces without normals are flat shaded
+                if (!has_normals)
+                {
+                    const auto& p0 = attributes.positions[face[0].position];
+                    const auto& p1 = attributes.positions[face[1].position];
+                    const auto& p2 = attributes.positions[face[2].position];
+
+                    for (auto& c : face)
+                        c.normal = obj_corner::s_flat_normal | uint32_t(chunk.flat_normals.size());
+
+                    chunk.flat_normals.push_back(glm::normalize(glm::cross(p1 - p0, p2 - p0)));
+                }
+
+                // Triangle fan, works for convex polygons
+                for (size_t i = 1; i + 1 < face.size(); ++i)
+                {
+                    chunk.corners.push_back(face[0]);
+                    chunk.corners.push_back(face[i]);
+                    chunk.corners.push_back(face[i + 1]);
+                }
+
+                return true;
+            };
+
+            for (size_t i = 0; i < chunk.faces.size(); ++i)
             {
-                check_new_mesh();
-                current_mesh_name = matches.str(1);
+                for (; next_object < chunk.objects.size() && chunk.objects[next_object].first_face == i; ++next_object)
+                    chunk.object_triangles.push_back(chunk.corners.size() / 3);
+
+                if (!resolve_face(chunk.faces[i]))
+                    ++chunk.invalid_faces;
+            }
+
+            for (; next_object < chunk.objects.size(); ++next_object)
+                chunk.object_triangles.push_back(chunk.corners.size() / 3);
+        }
+    }
+
+    std::map<std::string, std::shared_ptr<rt::mesh>> load_meshes_from_wavefront(std::string_view file_name)
+    {
+        using seconds = std::chrono::duration<double, std::ratio<1>>;
+
+        std::map<std::string, std::shared_ptr<rt::mesh>> result;
+
+        const auto start_time = std::chrono::steady_clock::now();
+        const mapped_file file(file_name);
+
+        if (!file.is_open())
+        {
+            spdlog::error("Can't open file: {0}", file_name.data());
+            return result;
+        }
+
+        // Chunks are parsed in parallel, then a prefix sum over the chunk sizes places their
+        // data in the whole file, so the result doesn't depend on the number of chunks
+        const size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+        const size_t num_chunks = std::clamp<size_t>(file.size() / s_min_chunk_size, 1, num_threads);
+
+        auto chunks = split_chunks(file.data(), file.data() + file.size(), num_chunks);
+
+        parallel_for(chunks.size(), num_threads, [&chunks](size_t i) { parse_chunk(chunks[i]); });
+
+        obj_attributes attributes;
+        size_t positions = 0, uvs = 0, normals = 0;
+
+        for (auto& chunk : chunks)
+        {
+            chunk.position_base = positions;
+            chunk.uv_base = uvs;
+            chunk.normal_base = normals;
+            positions += chunk.positions.size();
+            uvs += chunk.uvs.size();
+            normals += chunk.normals.size();
+        }
+
+        attributes.positions.resize(positions);
+        attributes.uvs.resize(uvs);
+        attributes.normals.resize(normals);
+
+        parallel_for(chunks.size(), num_threads, [&chunks, &attributes](size_t i) {
+            auto& chunk = chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), attributes.positions.begin() + chunk.position_base);
+            std::copy(chunk.uvs.begin(), chunk.uvs.end(), attributes.uvs.begin() + chunk.uv_base);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), attributes.normals.begin() + chunk.normal_base);
+            chunk.positions = {};
+            chunk.uvs = {};
+            chunk.normals = {};
+        });
+
+        parallel_for(chunks.size(), num_threads, [&chunks, &attributes](size_t i) { build_triangles(chunks[i], attributes); });
+
+        std::string current_mesh_name = "default";
+        auto current_mesh = std::make_shared<rt::mesh>();
+        size_t ignored_lines = 0, invalid_faces = 0;
+
+        // Maps the corners of the current mesh to its vertices
+        std::unordered_map<obj_corner, uint32_t, obj_corner_hash> mesh_vertices;
+        size_t flat_normal_base = 0;
+
+        const auto check_new_mesh = [&current_mesh, &result, &current_mesh_name, &mesh_vertices] {
+            if (current_mesh->get_triangle_count() > 0) {
+                result[current_mesh_name] = std::move(current_mesh);
+                current_mesh = std::make_shared<rt::mesh>();
+                mesh_vertices.clear();
             }
-            else if (std::regex_search(line, matches, r_comment))
+        };
+
+        const auto add_triangles = [&](const obj_chunk& chunk, size_t first, size_t last) {
+            uint32_t v[3];
+
+            for (size_t i = first * 3; i < last * 3; ++i)
             {
-                spdlog::info("Comment: {0}", matches.str(1));
+                auto key = chunk.corners[i];
+                const bool flat = (key.normal & obj_corner::s_flat_normal) != 0;
+
+                if (flat)
+                    key.normal = obj_corner::s_flat_normal | uint32_t(flat_normal_base + (key.normal & ~obj_corner::s_flat_normal));
+
+                const auto [it, inserted] = mesh_vertices.try_emplace(key, uint32_t(current_mesh->get_vertex_count()));
+
+                if (inserted)
+                {
+                    const auto& c = chunk.corners[i];
+
+                    current_mesh->add_vertex({
+                        attributes.positions[c.position],
+                        flat ? chunk.flat_normals[c.normal & ~obj_corner::s_flat_normal] : attributes.normals[c.normal],
+                        c.uv != obj_corner::s_no_uv ? attributes.uvs[c.uv] : glm::vec2(0.0f)
+                    });
+                }
+
+                v[i % 3] = it->second;
+
+                if (i % 3 == 2)
+                    current_mesh->add_triangle(v[0], v[1], v[2]);
             }
-            else
+        };
+
+        for (const auto& chunk : chunks)
+        {
+            size_t first = 0;
+
+            for (size_t i = 0; i < chunk.objects.size(); ++i)
             {
-                spdlog::warn("Unable to parse: {0}", line);
+                add_triangles(chunk, first, chunk.object_triangles[i]);
+                first = chunk.object_triangles[i];
+
+                check_new_mesh();
+                current_mesh_name = chunk.objects[i].name;
             }
 
+            add_triangles(chunk, first, chunk.corners.size() / 3);
 
+            flat_normal_base += chunk.flat_normals.size();
+            ignored_lines += chunk.ignored_lines;
+            invalid_faces += chunk.invalid_faces;
         }
 
         check_new_mesh();
 
-        is.close();
+        const double elapsed = seconds(std::chrono::steady_clock::now() - start_time).count();
+        const double size_mb = file.size() / (1024.0 * 1024.0);
 
-        return result;
+        if (ignored_lines > 0)
+            spdlog::warn("{0}: {1} lines could not be parsed", file_name, ignored_lines);
 
-    }
+        if (invalid_faces > 0)
+            spdlog::warn("{0}: {1} invalid faces", file_name, invalid_faces);
 
-}
\ No newline at end of file
+        spdlog::info("Parsed {0}: {1:.2f} MB in {2:.3f} s ({3:.1f} MB/s, {4} chunks)", file_name, size_mb, elapsed, size_mb / elapsed, chunks.size());
+
+        return result;
+    }
+}
@@ -1,12 +1,16 @@
 #include "scene_loader.h"
 
-#include "mesh_loader.h"
+#include "asset_cache.h"
+#include "task_pool.h"
 
+#include <chrono>
 #include <fstream>
+#include <set>
 #include <json.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <sampler.h>
+#include <profiler.h>
 #include <spdlog/spdlog.h>
 
 namespace glm {
@@ -31,6 +35,32 @@ namespace rt
         if (str == "linear") s = rt::sample_mode::linear;
         else if (str == "nearest") s = rt::sample_mode::nearest;
     }
+
+    void to_json(nlohmann::json& j, const rt::pixel_layout& l) {
+        if (l == rt::pixel_layout::linear) j = "linear";
+        else if (l == rt::pixel_layout::tiled) j = "tiled";
+    }
+
+    void from_json(const nlohmann::json& j, rt::pixel_layout& l) {
+        auto str = j.get<std::string>();
+        if (str == "linear") l = rt::pixel_layout::linear;
+        else if (str == "tiled") l = rt::pixel_layout::tiled;
+    }
+
+    void to_json(nlohmann::json& j, const rt::texel_format& f) {
+        if (f == rt::texel_format::rgb32f) j = "rgb32f";
+        else if (f == rt::texel_format::rgba8_srgb) j = "rgba8_srgb";
+        else if (f == rt::texel_format::rgb16f) j = "rgb16f";
+        else if (f == rt::texel_format::rgb9e5) j = "rgb9e5";
+    }
+
+    void from_json(const nlohmann::json& j, rt::texel_format& f) {
+        auto str = j.get<std::string>();
+        if (str == "rgb32f") f = rt::texel_format::rgb32f;
+        else if (str == "rgba8_srgb") f = rt::texel_format::rgba8_srgb;
+        else if (str == "rgb16f") f = rt::texel_format::rgb16f;
+        else if (str == "rgb9e5") f = rt::texel_format::rgb9e5;
+    }
 }
 
 
@@ -38,6 +68,8 @@ namespace rt::utility
 {
 	scene load_scene(std::string_view file_name)
 	{
+        RT_PROFILE_ZONE("load_scene");
+
         using json = nlohmann::json;
         
         scene result;
@@ -53,23 +85,82 @@ namespace rt::utility
         is >> scene_def;
 
 
-        std::map<std::string, std::shared_ptr<rt::mesh>> meshes;
-        std::map<std::string, std::shared_ptr<rt::sampler_2d>> samplers_2d;
-        std::map<std::string, std::shared_ptr<rt::sampler_3d>> samplers_3d;
+        using mesh_asset = std::shared_future<std::shared_ptr<rt::mesh>>;
+        using sampler_2d_asset = std::shared_future<std::shared_ptr<const rt::sampler_2d>>;
+        using sampler_3d_asset = std::shared_future<std::shared_ptr<const rt::sampler_3d>>;
+
+        const auto start_time = std::chrono::steady_clock::now();
+
+        // Dependency pass: collect the assets referenced by the nodes and the background
+        std::set<std::string> used_meshes, used_samplers;
+
+        if (scene_def.contains("nodes"))
+        {
+            for (const auto& node_def : scene_def["nodes"])
+            {
+                if (node_def.contains("mesh"))
+                    used_meshes.insert(node_def["mesh"].get<std::string>());
+
+                if (node_def.contains("material"))
+                {
+                    for (const auto& [channel, id] : node_def["material"].items())
+                        used_samplers.insert(id.get<std::string>());
+                }
+            }
+        }
+
+        if (scene_def.contains("background") && scene_def["background"].contains("color"))
+            used_samplers.insert(scene_def["background"]["color"].get<std::string>());
+
+        // Assets are loaded on a task pool through the asset cache, which compiles the meshes and
+        // shares them with previous and later loads. Unreferenced assets are not loaded
+        task_pool pool;
+        auto& cache = asset_cache::get_instance();
+
+        std::map<std::string, mesh_asset> meshes;
+        std::map<std::string, sampler_2d_asset> samplers_2d;
+        std::map<std::string, sampler_3d_asset> samplers_3d;
+
+        const auto ready = [](auto value) {
+            std::promise<decltype(value)> promise;
+            promise.set_value(std::move(value));
+            return promise.get_future().share();
+        };
 
         if (scene_def.contains("meshes"))
         {
             for (const auto& mesh_def : scene_def["meshes"])
             {
                 const auto ids = mesh_def["ids"].get<std::vector<std::string>>();
-                for (auto [name, mesh] : load_meshes_from_wavefront(mesh_def["file"].get<std::string>()))
+                const auto file = mesh_def["file"].get<std::string>();
+                const bool use_cache = !mesh_def.contains("cache") || mesh_def["cache"].get<bool>();
+
+                if (std::none_of(ids.begin(), ids.end(), [&used_meshes](const auto& id) { return used_meshes.count(id) > 0; }))
+                    continue;
+
+                auto file_meshes = pool.submit([&cache, file, use_cache] {
+                    return cache.load_meshes(file, use_cache);
+                });
+
+                for (const auto& id : ids)
                 {
-                    if (std::find(ids.begin(), ids.end(), name) != ids.end())
-                    {
-                        meshes[name] = std::move(mesh);
-                    }
+                    if (used_meshes.count(id) == 0)
+                        continue;
+
+                    // Queued after the file it comes from, see task_pool
+                    meshes[id] = pool.submit([id, file, file_meshes]() -> std::shared_ptr<rt::mesh> {
+                        const auto& all = *file_meshes.get();
+                        const auto it = all.find(id);
+
+                        if (it == all.end())
+                        {
+                            spdlog::error("Mesh {0} not found in {1}", id, file);
+                            return nullptr;
+                        }
+
+                        return it->second;
+                    });
                 }
-
             }
         }
 
@@ -92,27 +183,57 @@ namespace rt::utility
         {
             for (const auto& sampler_def : scene_def["samplers"])
             {
+                const auto id = sampler_def["id"].get<std::string>();
+
+                if (used_samplers.count(id) == 0)
+                    continue;
+
                 if (sampler_def.contains("file"))
                 {
-                    const auto id = sampler_def["id"].get<std::string>();
-                    auto image = std::make_shared<rt::image>();
-                    image->load(sampler_def["file"].get<std::string>());
+                    const auto file = sampler_def["file"].get<std::string>();
+                    image_options options;
+
+                    if (sampler_def.contains("layout"))
+                        options.layout = sampler_def["layout"].get<rt::pixel_layout>();
 
-                    if (sampler_def.contains("ldr") && sampler_def["ldr"].get<bool>())
-                        image->to_ldr();
+                    options.ldr = sampler_def.contains("ldr") && sampler_def["ldr"].get<bool>();
 
                     if (sampler_def.contains("mode"))
-                        sampler_def["mode"].get_to(image->sample_mode);
+                        options.mode = sampler_def["mode"].get<rt::sample_mode>();
+
+                    // Without an explicit format, it's chosen from the file
+                    if (sampler_def.contains("format") && sampler_def["format"].get<std::string>() != "auto")
+                        options.format = sampler_def["format"].get<rt::texel_format>();
+
+                    const auto load_image = [&cache, file, options] {
+                        return cache.load_image(file, options);
+                    };
 
                     std::string type = sampler_def.contains("type") ? sampler_def["type"].get<std::string>() : "image";
 
-                    if (type == "image")
+                    // Streamed images are loaded tile by tile when sampled
+                    const bool streaming = sampler_def.contains("streaming") && sampler_def["streaming"].get<bool>();
+
+                    if (type == "image" && streaming)
                     {
-                        samplers_2d[id] = std::move(image);
+                        samplers_2d[id] = pool.submit([&cache, file, options]() -> std::shared_ptr<const rt::sampler_2d> {
+                            if (auto image = cache.load_tiled_image(file, options))
+                                return image;
+
+                            return std::make_shared<rt::image>();
+                        });
+                    }
+                    else if (type == "image")
+                    {
+                        samplers_2d[id] = pool.submit([load_image]() -> std::shared_ptr<const rt::sampler_2d> {
+                            return load_image();
+                        });
                     }
                     else if (type == "equirectangular")
                     {
-                        samplers_3d[id] = std::make_shared<rt::equirectangular_map>(image);
+                        samplers_3d[id] = pool.submit([load_image]() -> std::shared_ptr<const rt::sampler_3d> {
+                            return std::make_shared<rt::equirectangular_map>(load_image());
+                        });
                     }
                     else
                     {
@@ -121,12 +242,11 @@ namespace rt::utility
                 }
                 else if (sampler_def.contains("color"))
                 {
-                    auto id = sampler_def["id"].get<std::string>();
                     auto sampler = std::make_shared<rt::color_sampler>(sampler_def["color"].get<glm::vec3>());
 
 
-                    samplers_2d[id] = sampler;
-                    samplers_3d[id] = sampler;
+                    samplers_2d[id] = ready(std::shared_ptr<const rt::sampler_2d>(sampler));
+                    samplers_3d[id] = ready(std::shared_ptr<const rt::sampler_3d>(sampler));
                 }
             }
         }
@@ -136,7 +256,7 @@ namespace rt::utility
             auto background = scene_def["background"];
 
             if (background.contains("color"))
-                result.background = samplers_3d.at(background["color"].get<std::string>());
+                result.background = samplers_3d.at(background["color"].get<std::string>()).get();
 
         }
 
@@ -162,7 +282,13 @@ namespace rt::utility
                     node->scale(node_def["scale"].get<glm::vec3>());
 
                 if (node_def.contains("mesh"))
-                    node->shape = meshes.at(node_def["mesh"].get<std::string>());
+                {
+                    node->shape = meshes.at(node_def["mesh"].get<std::string>()).get();
+
+                    // Not found in the file, already reported
+                    if (!node->shape)
+                        continue;
+                }
 
                 else if (node_def.contains("shape") && node_def["shape"].get<std::string>() == "sphere")
                     node->shape = std::make_shared<rt::sphere>();
@@ -172,16 +298,16 @@ namespace rt::utility
                     const auto mat_def = node_def["material"];
 
                     if (mat_def.contains("albedo"))
-                        node->material.albedo = samplers_2d.at(mat_def["albedo"].get<std::string>());
+                        node->material.albedo = samplers_2d.at(mat_def["albedo"].get<std::string>()).get();
 
                     if (mat_def.contains("emission"))
-                        node->material.emission = samplers_2d.at(mat_def["emission"].get<std::string>());
+                        node->material.emission = samplers_2d.at(mat_def["emission"].get<std::string>()).get();
 
                     if (mat_def.contains("roughness"))
-                        node->material.roughness = samplers_2d.at(mat_def["roughness"].get<std::string>());
+                        node->material.roughness = samplers_2d.at(mat_def["roughness"].get<std::string>()).get();
 
                     if (mat_def.contains("metallic"))
-                        node->material.metallic = samplers_2d.at(mat_def["metallic"].get<std::string>());
+                        node->material.metallic = samplers_2d.at(mat_def["metallic"].get<std::string>()).get();
 
                 }
 
@@ -190,6 +316,7 @@ namespace rt::utility
             }
         }
 
+        spdlog::info("Scene loaded in {0:.3f} s", std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
 
         return result;
 	}
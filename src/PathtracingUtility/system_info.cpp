@@ -0,0 +1,74 @@
+#include "system_info.h"
+
+#include <cstring>
+#include <fstream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define RT_HAS_CPUID 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define RT_HAS_CPUID 1
+#endif
+
+namespace rt::utility
+{
+	namespace
+	{
+		std::string trim(const std::string& s)
+		{
+			const auto begin = s.find_first_not_of(" \t");
+			const auto end = s.find_last_not_of(" \t\r\n");
+			return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+		}
+	}
+
+	std::string get_cpu_model()
+	{
+#ifdef RT_HAS_CPUID
+		// The brand string is returned by 3 extended leaves, 16 bytes each
+		unsigned int regs[12] = {};
+
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0x80000000);
+
+		if (unsigned(info[0]) >= 0x80000004)
+		{
+			for (int i = 0; i < 3; ++i)
+				__cpuid(reinterpret_cast<int*>(&regs[4 * i]), 0x80000002 + i);
+		}
+#else
+		if (__get_cpuid_max(0x80000000, nullptr) >= 0x80000004)
+		{
+			for (unsigned int i = 0; i < 3; ++i)
+				__get_cpuid(0x80000002 + i, &regs[4 * i], &regs[4 * i + 1], &regs[4 * i + 2], &regs[4 * i + 3]);
+		}
+#endif
+
+		char brand[sizeof(regs) + 1] = {};
+		std::memcpy(brand, regs, sizeof(regs));
+
+		if (const auto model = trim(brand); !model.empty())
+			return model;
+#endif
+
+		// Other architectures on Linux
+		std::ifstream cpuinfo("/proc/cpuinfo");
+
+		for (std::string line; std::getline(cpuinfo, line);)
+		{
+			const auto colon = line.find(':');
+
+			if (colon == std::string::npos)
+				continue;
+
+			const auto key = trim(line.substr(0, colon));
+
+			if (key == "model name" || key == "Model" || key == "Hardware")
+				return trim(line.substr(colon + 1));
+		}
+
+		return "unknown";
+	}
+}
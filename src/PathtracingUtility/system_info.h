@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+namespace rt::utility
+{
+	/// <summary>
+	/// Returns the name of the CPU, e.g. "Intel(R) Core(TM) i7-8700 CPU @ 3.20GHz", or "unknown"
+	/// </summary>
+	std::string get_cpu_model();
+}
@@ -0,0 +1,61 @@
+#include "task_pool.h"
+
+#include <algorithm>
+
+namespace rt::utility
+{
+	task_pool::task_pool(size_t num_threads)
+	{
+		if (num_threads == 0)
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+		m_threads.reserve(num_threads);
+
+		for (size_t i = 0; i < num_threads; ++i)
+			m_threads.emplace_back([this] { run(); });
+	}
+
+	task_pool::~task_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+
+		m_condition.notify_all();
+
+		for (auto& thread : m_threads)
+			thread.join();
+	}
+
+	void task_pool::push(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push_back(std::move(task));
+		}
+
+		m_condition.notify_one();
+	}
+
+	void task_pool::run()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+
+				if (m_tasks.empty())
+					return;
+
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace rt::utility
+{
+	/// <summary>
+	/// A fixed set of threads running tasks in submission order.
+	/// A task may wait for tasks submitted before it, never for later ones: since tasks are
+	/// started in order, the ones it waits for are already running or done
+	/// </summary>
+	class task_pool
+	{
+	public:
+		/// <summary>
+		/// Starts the threads
+		/// </summary>
+		/// <param name="num_threads">Number of threads, 0 means one per hardware thread</param>
+		task_pool(size_t num_threads = 0);
+
+		task_pool(const task_pool&) = delete;
+		task_pool& operator=(const task_pool&) = delete;
+
+		/// <summary>
+		/// Runs the remaining tasks and stops the threads
+		/// </summary>
+		~task_pool();
+
+		/// <summary>
+		/// Queues a task
+		/// </summary>
+		/// <param name="fn">The task</param>
+		/// <returns>A future for the result of the task</returns>
+		template<typename Fn>
+		std::shared_future<std::invoke_result_t<Fn>> submit(Fn&& fn)
+		{
+			using result_type = std::invoke_result_t<Fn>;
+
+			auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Fn>(fn));
+			std::shared_future<result_type> future = task->get_future().share();
+
+			push([task] { (*task)(); });
+			return future;
+		}
+
+		/// <summary>
+		/// Returns the number of threads
+		/// </summary>
+		size_t get_num_threads() const { return m_threads.size(); }
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<std::function<void()>> m_tasks;
+		std::vector<std::thread> m_threads;
+		bool m_stop = false;
+
+		void push(std::function<void()> task);
+		void run();
+	};
+}
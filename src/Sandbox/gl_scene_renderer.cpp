@@ -52,7 +52,7 @@ namespace rtsb
 
 
 		auto sphere_mesh = rt::utility::load_meshes_from_wavefront("res/meshes/sphere.obj")["sphere"];
-		m_shere_vao = create_mesh(*sphere_mesh);
+		m_shere_vao = create_vao(*sphere_mesh);
 
 		m_program = load_program(s_vertex_shader, s_fragment_shader);
 
@@ -67,7 +67,7 @@ namespace rtsb
 			if (mesh != nullptr)
 			{
 				if (m_vao.find(mesh->id) == m_vao.end())
-					m_vao[mesh->id] = create_mesh(*mesh);
+					m_vao[mesh->id] = create_vao(*mesh);
 
 				const auto& vao = m_vao[mesh->id];
 
@@ -75,7 +75,7 @@ namespace rtsb
 					node->get_transform(), 
 					s_colors[idx % s_colors.size()],
 					vao.id,
-					vao.vertex_count
+					vao.index_count
 				});
 
 			}
@@ -85,7 +85,7 @@ namespace rtsb
 					node->get_transform(),
 					s_colors[idx % s_colors.size()],
 					m_shere_vao.id,
-					m_shere_vao.vertex_count
+					m_shere_vao.index_count
 				});
 			}
 		
@@ -104,11 +104,13 @@ namespace rtsb
 
 		glDeleteVertexArrays(1, &(m_shere_vao.id));
 		glDeleteBuffers(1, &(m_shere_vao.vb_id));
+		glDeleteBuffers(1, &(m_shere_vao.ib_id));
 
 		for (const auto [key, val] : m_vao)
 		{
 			glDeleteVertexArrays(1, &(val.id));
 			glDeleteBuffers(1, &(val.vb_id));
+			glDeleteBuffers(1, &(val.ib_id));
 		}
 	}
 
@@ -135,45 +137,51 @@ namespace rtsb
 			glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(node.transform));
 			glUniform3fv(color_loc, 1, glm::value_ptr(node.color));
 			glBindVertexArray(node.vao_id);
-			glDrawArrays(GL_TRIANGLES, 0, node.vertex_count);
+			glDrawElements(GL_TRIANGLES, GLsizei(node.index_count), GL_UNSIGNED_INT, nullptr);
 			glBindVertexArray(0);
 		}
 
 	}
 
 
-	gl_vao gl_scene_renderer::create_mesh(rt::mesh& mesh) const
+	gl_vao gl_scene_renderer::create_vao(const rt::mesh& mesh) const
 	{
-		std::vector<gl_vertex> vertices;
-		vertices.reserve(mesh.get_triangles().size() * 3);
+		// The mesh streams are uploaded as they are, one after the other in the same buffer
+		const auto& positions = mesh.get_positions();
+		const auto& normals = mesh.get_normals();
+		const auto& uvs = mesh.get_uvs();
+		const auto& indices = mesh.get_indices();
 
-		for (const auto& triangle : mesh.get_triangles())
-			for (const auto& v : triangle.vertices)
-				vertices.push_back({ v.position, v.normal, v.uv });
+		const size_t positions_size = positions.size() * sizeof(glm::vec3);
+		const size_t normals_size = normals.size() * sizeof(glm::vec3);
+		const size_t uvs_size = uvs.size() * sizeof(glm::vec2);
 
-		return create_vao(vertices);
-
-	}
-
-	gl_vao gl_scene_renderer::create_vao(const std::vector<gl_vertex>& vertices) const
-	{
-		uint32_t vao, vb;
+		uint32_t vao, vb, ib;
 		glGenVertexArrays(1, &vao);
 		glBindVertexArray(vao);
 
 		glGenBuffers(1, &vb);
 		glBindBuffer(GL_ARRAY_BUFFER, vb);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(gl_vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, positions_size + normals_size + uvs_size, nullptr, GL_STATIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, positions_size, positions.data());
+		glBufferSubData(GL_ARRAY_BUFFER, positions_size, normals_size, normals.data());
+		glBufferSubData(GL_ARRAY_BUFFER, positions_size + normals_size, uvs_size, uvs.data());
+
+		glGenBuffers(1, &ib);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
 
 		glEnableVertexAttribArray(0);
 		glEnableVertexAttribArray(1);
 		glEnableVertexAttribArray(2);
 
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(gl_vertex), (void*)0);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(gl_vertex), (void*)12);
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(gl_vertex), (void*)24);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)positions_size);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)(positions_size + normals_size));
+
+		glBindVertexArray(0);
 
-		return { vao, vb, vertices.size() };
+		return { vao, vb, ib, indices.size() };
 	}
 
 	gl_program gl_scene_renderer::load_program(std::string_view vs_source, std::string_view fs_source) const
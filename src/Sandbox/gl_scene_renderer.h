@@ -17,26 +17,20 @@ namespace rt
 namespace rtsb
 {
 
-	struct gl_vertex
-	{
-		glm::vec3 position;
-		glm::vec3 normal;
-		glm::vec2 uv;
-	};
-
 	struct gl_scene_node
 	{
 		glm::mat4 transform = glm::identity<glm::mat4>();
 		glm::vec3 color = glm::vec3(1.0f);
 		uint32_t vao_id = 0;
-		size_t vertex_count = 0;
+		size_t index_count = 0;
 	};
 
 	struct gl_vao
 	{
 		uint32_t id = 0;
 		uint32_t vb_id = 0;
-		size_t vertex_count = 0;
+		uint32_t ib_id = 0;
+		size_t index_count = 0;
 	};
 
 	struct gl_program
@@ -63,8 +57,7 @@ namespace rtsb
 		
 		std::vector<gl_scene_node> m_nodes;
 
-		gl_vao create_mesh(rt::mesh& mesh) const;
-		gl_vao create_vao(const std::vector<gl_vertex>& vertices) const;
+		gl_vao create_vao(const rt::mesh& mesh) const;
 		gl_program load_program(std::string_view vs_source, std::string_view fs_source) const;
 	};
 }
@@ -15,10 +15,11 @@
 #include <glm/ext.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <asset_cache.h>
 #include <mesh_loader.h>
 #include <scene_loader.h>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
+// Implemented in PathtracingUtility (image_io.cpp)
 #include <stb_image_write.h>
 
 #define RT_SANDBOX(window) ((sandbox*)glfwGetWindowUserPointer(window))
@@ -292,18 +293,22 @@ namespace rtsb
     void rtsb::sandbox::render_gui()
     {
 
-        const rt::trace_parameters renderTraceParams = {
+        rt::trace_parameters renderTraceParams = {
             std::thread::hardware_concurrency() - 1,
             0,
             16
         };
 
-        const rt::trace_parameters debugTraceParams = {
+        rt::trace_parameters debugTraceParams = {
             std::thread::hardware_concurrency() - 1,
             1,
             1
         };
 
+        // Debug renders can end before the handler is subscribed, they start afterwards
+        renderTraceParams.deferred_start = true;
+        debugTraceParams.deferred_start = true;
+
         m_toasts.erase(std::remove_if(m_toasts.begin(), m_toasts.end(), [](const toast& t) {
             return t.end_time < std::chrono::system_clock::now().time_since_epoch();
         }), m_toasts.end());
@@ -326,11 +331,15 @@ namespace rtsb
                 {
                     const auto modes = {
                         std::make_tuple("Pathtracer", static_cast<rt::abstract_pathtracer*>(&m_pathtracer)),
+                        std::make_tuple("Wavefront Pathtracer", static_cast<rt::abstract_pathtracer*>(&m_wavefront_pathtracer)),
                     };
 
                     const auto debug_modes = {
                         std::make_tuple("Albedo", rt::utility::debug_pathtracer::mode::albedo),
                         std::make_tuple("Normals", rt::utility::debug_pathtracer::mode::normal),
+                        std::make_tuple("Heatmap: Node Visits", rt::utility::debug_pathtracer::mode::node_visits),
+                        std::make_tuple("Heatmap: Triangle Tests", rt::utility::debug_pathtracer::mode::triangle_tests),
+                        std::make_tuple("Heatmap: Cast Time (ns)", rt::utility::debug_pathtracer::mode::cast_time),
                     };
 
                     for (const auto& [title, renderer] : modes)
@@ -352,8 +361,10 @@ namespace rtsb
                                     view_params.fov_y = s_fov_y;
 
                                     m_render_stats.current_iteration = 0;
+                                    m_tone_mapping = true;
                                     m_render_result = renderer->run(view_params, renderTraceParams, m_scene);
                                     m_render_result->on_iteration_end.subscribe(this, &sandbox::on_iteration_end_handler);
+                                    m_render_result->start();
                                     m_state = sandbox_state::rendering;
                                 }
                             }
@@ -366,6 +377,10 @@ namespace rtsb
                     {
                         for (const auto& [title, mode] : debug_modes)
                         {
+                            // Traversal heatmaps need the ray stats counters
+                            if (!rt::utility::debug_pathtracer::is_supported(mode))
+                                continue;
+
                             if (ImGui::MenuItem(title))
                             {
                                 rt::view_parameters view_params;
@@ -374,13 +389,30 @@ namespace rtsb
                                 view_params.width = vw;
                                 view_params.height = vh;
                                 view_params.fov_y = s_fov_y;
+                                // The scale is kept while rendering the same heatmap again
+                                if (m_debug.current_mode != mode)
+                                    m_heatmap_scale = rt::utility::debug_pathtracer::get_default_scale(mode);
+
                                 m_debug.current_mode = mode;
+                                m_tone_mapping = !rt::utility::debug_pathtracer::is_heatmap(mode);
                                 m_render_result = m_debug.run(view_params, debugTraceParams, m_scene);
                                 m_render_result->on_iteration_end.subscribe(this, &sandbox::on_iteration_end_handler);
+                                m_render_result->start();
                                 m_state = sandbox_state::rendering;
                             }
                         }
 
+                        ImGui::Separator();
+
+                        if (ImGui::BeginMenu("Heatmap Scale"))
+                        {
+                            auto& scale = m_heatmap_scale;
+                            ImGui::DragFloat("Min", &scale.min, 1.0f, 0.0f, scale.max);
+                            ImGui::DragFloat("Max", &scale.max, 1.0f, scale.min, 1e9f);
+                            ImGui::Checkbox("Logarithmic", &scale.logarithmic);
+                            ImGui::EndMenu();
+                        }
+
                         ImGui::EndMenu();
                     }
 
@@ -399,6 +431,20 @@ namespace rtsb
                     ImGui::EndMenu();
                 }
 
+                {
+                    auto& cache = rt::utility::asset_cache::get_instance();
+                    const std::string label = "Clear Asset Cache (" + std::to_string(cache.get_size_in_bytes() / (1024 * 1024)) + " MB)";
+
+                    if (ImGui::MenuItem(label.c_str()))
+                        cache.clear();
+
+                    // In MB, lowering it evicts right away
+                    int budget = int(cache.get_memory_budget() >> 20);
+
+                    if (ImGui::DragInt("Asset Cache Budget (MB)", &budget, 16.0f, 0, 1 << 20))
+                        cache.set_memory_budget(size_t(std::max(budget, 0)) << 20);
+                }
+
                 ImGui::Separator();
 
                 if (ImGui::MenuItem("Quit"))
@@ -430,6 +476,9 @@ namespace rtsb
             ImGui::Begin("Render", nullptr, ImGuiWindowFlags_NoDecoration);
             ImGui::Text("Elapsted Time: %.2f", m_render_result->get_elapsed_time());
             ImGui::Text("%.2f spp/second", m_render_stats.ssp_per_second);
+            ImGui::Text("%.2f Mrays/second", m_render_stats.mrays_per_second);
+            ImGui::Text("%.1f nodes, %.1f triangles per ray", m_render_stats.nodes_per_ray, m_render_stats.triangles_per_ray);
+            ImGui::Text("%.2f rays per path", m_render_stats.average_path_length);
             ImGui::Text("iteration #%d", iteration);
             ImGui::ProgressBar(m_render_result->progress);
             if (ImGui::Button("Interrupt", { -1.0f, 0.0f })) {
@@ -509,11 +558,19 @@ namespace rtsb
                     auto color = image.get_pixel(x, y);
                     
                     
-                    // Tone mapping
-                    color = glm::vec3(1.0f) - glm::exp(-color);
+                    if (m_tone_mapping)
+                    {
+                        // Tone mapping
+                        color = glm::vec3(1.0f) - glm::exp(-color);
 
-                    // Gamma correction
-                    color = glm::pow(color, glm::vec3(1.0f / 2.2f));
+                        // Gamma correction
+                        color = glm::pow(color, glm::vec3(1.0f / 2.2f));
+                    }
+                    else
+                    {
+                        // Heatmaps are mapped once averaged
+                        color = rt::utility::debug_pathtracer::heatmap_color(color.r, m_heatmap_scale);
+                    }
 
                     m_pixels[y * image.get_width() + x] =
                         ((uint32_t(color.r * 255) << 0)) |
@@ -556,6 +613,13 @@ namespace rtsb
         m_texture_needs_update = true;
         m_render_stats.current_iteration = iteration + 1;
         m_render_stats.ssp_per_second = m_render_result->samples_per_pixel.load() / m_render_result->get_elapsed_time();
+
+        const auto ray_stats = m_render_result->get_ray_stats();
+        const auto rays = std::max<uint64_t>(ray_stats.get_total_rays(), 1);
+        m_render_stats.mrays_per_second = ray_stats.get_total_rays() / m_render_result->get_elapsed_time() * 1e-6f;
+        m_render_stats.nodes_per_ray = float(ray_stats.nodes_visited) / rays;
+        m_render_stats.triangles_per_ray = float(ray_stats.triangles_tested) / rays;
+        m_render_stats.average_path_length = float(ray_stats.get_average_path_length());
     }
 
     std::tuple<float, float> sandbox::spherical_angles(const glm::vec3& dir)
@@ -11,6 +11,7 @@
 #include <scene.h>
 #include <debug_pathtracer.h>
 #include <pathtracer.h>
+#include <wavefront_pathtracer.h>
 
 #include "gl_scene_renderer.h"
 
@@ -78,6 +79,10 @@ namespace rtsb
 		struct {
 			uint64_t current_iteration = 0;
 			float ssp_per_second = 0.0f; 
+			float mrays_per_second = 0.0f;
+			float nodes_per_ray = 0.0f;
+			float triangles_per_ray = 0.0f;
+			float average_path_length = 0.0f;
 		} m_render_stats;
 
 		sandbox_state m_state = sandbox_state::idle;
@@ -88,10 +93,22 @@ namespace rtsb
 
 		rt::utility::debug_pathtracer m_debug;
 		rt::pathtracer m_pathtracer;
+		rt::wavefront_pathtracer m_wavefront_pathtracer;
 		std::unique_ptr<gl_scene_renderer> m_gl_renderer;
 
 		rt::image m_image;
 
+		/// <summary>
+		/// Whether the rendered image is tone mapped for display. Heatmaps are costs, mapped to
+		/// colors with m_heatmap_scale instead
+		/// </summary>
+		bool m_tone_mapping = true;
+
+		/// <summary>
+		/// Only read by the UI thread, the render threads output the raw costs
+		/// </summary>
+		rt::utility::debug_pathtracer::heatmap_scale m_heatmap_scale;
+
 		std::shared_ptr<rt::pathtracer_result> m_render_result = nullptr;
 		uint32_t m_render_texture;
 